@@ -0,0 +1,32 @@
+import os
+import subprocess
+import sys
+import time
+
+# usage: python3 bench/bench.py [PL0 binary]
+code = sys.argv[1] if len(sys.argv) > 1 else "build/src/PL0"
+path = "bench"
+repeat = 5
+configs = [
+    ["--no-tiering", "--dispatch", "switch"],
+    ["--no-tiering"],
+    [],
+    ["--register-vm"],
+    ["--jit"],
+]
+
+for file in sorted(os.listdir(path)):
+  if not file.endswith(".p"): continue
+  source = os.path.join(path, file)
+  stdin = source[:-2] + ".in"
+  print(file)
+  for flags in configs:
+    # best of several runs
+    elapsed = float("inf")
+    for _ in range(repeat):
+      with open(stdin if os.path.exists(stdin) else os.devnull) as fin:
+        start = time.perf_counter()
+        subprocess.run([code] + flags + [source], stdin=fin,
+                       stdout=subprocess.DEVNULL, check=True)
+        elapsed = min(elapsed, time.perf_counter() - start)
+    print("  %-20s %8.3fs" % (" ".join(flags) or "(default)", elapsed))
@@ -0,0 +1,17 @@
+var n, r, i, s;
+procedure fib;
+var a, t;
+begin
+  if n < 2 then r := n
+  else begin
+    a := n;
+    n := a - 1; call fib; t := r;
+    n := a - 2; call fib;
+    r := r + t
+  end
+end;
+begin
+  read n;
+  call fib;
+  write r
+end.
@@ -0,0 +1,44 @@
+var n, total;
+
+procedure level1;
+var a1;
+  procedure level2;
+  var a2;
+    procedure level3;
+    var a3;
+      procedure level4;
+      var a4;
+        procedure level5;
+        var a5;
+          procedure level6;
+          var a6;
+            procedure level7;
+            var a7;
+              procedure level8;
+              var a8;
+                procedure level9;
+                var i;
+                begin
+                  i := 0;
+                  while i < n do
+                  begin
+                    total := total + a1 + a2 + a3 + a4;
+                    a5 := a5 + a6 - a7 + a8;
+                    i := i + 1
+                  end
+                end;
+              begin a8 := 8; call level9 end;
+            begin a7 := 7; call level8 end;
+          begin a6 := 6; call level7 end;
+        begin a5 := 5; call level6 end;
+      begin a4 := 4; call level5 end;
+    begin a3 := 3; call level4 end;
+  begin a2 := 2; call level3 end;
+begin a1 := 1; call level2 end;
+
+begin
+  read n;
+  total := 0;
+  call level1;
+  write total
+end.
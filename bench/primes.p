@@ -0,0 +1,32 @@
+const max = 20000;
+var arg, ret, cnt;
+
+procedure isprime;
+var i;
+begin
+	ret := 1;
+	i := 2;
+	while i < arg do
+	begin
+		if arg / i * i = arg then
+		begin
+			ret := 0;
+			i := arg
+		end;
+		i := i + 1
+	end
+end;
+
+procedure primes;
+begin
+	arg := 2;
+	while arg < max do
+	begin
+		call isprime;
+		if ret = 1 then cnt := cnt + 1;
+		arg := arg + 1
+	end
+end;
+
+begin cnt := 0; call primes; write cnt end
+.
\ No newline at end of file
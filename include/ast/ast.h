@@ -55,6 +55,12 @@ enum class AstNodeType : int { AST_NODE_LIST(DEF_ENUM_AST_NODE_TYPE) };
     return field##_;                        \
   }
 
+// for passes rewriting the tree, the previous child is not deleted
+#define PROPERTY_SETTER(field)                 \
+  void set_##field(decltype(field##_) field) { \
+    field##_ = std::move(field);               \
+  }
+
 class AstNode {
  public:
   explicit AstNode(AstNodeType type) : type_(type) {}
@@ -172,11 +178,15 @@ class Block final : public Statement {
 
   PROPERTY_CONST_REF_GETTER(sub_procedures)
 
+  PROPERTY_SETTER(sub_procedures)
+
   PROPERTY_GETTER(body)
+
+  PROPERTY_SETTER(body)
 };
 
 class StatementList final : public Statement {
-  const std::vector<Statement *> statements_;
+  std::vector<Statement *> statements_;
 
  public:
   using ListType = std::vector<Statement *>;
@@ -188,6 +198,8 @@ class StatementList final : public Statement {
   ~StatementList() final = default;
 
   PROPERTY_CONST_REF_GETTER(statements)
+
+  PROPERTY_SETTER(statements)
 };
 
 class IfStatement final : public Statement {
@@ -220,6 +232,12 @@ class IfStatement final : public Statement {
   PROPERTY_GETTER(then_statement)
 
   PROPERTY_GETTER(else_statement)
+
+  PROPERTY_SETTER(condition)
+
+  PROPERTY_SETTER(then_statement)
+
+  PROPERTY_SETTER(else_statement)
 };
 
 class WhileStatement final : public Statement {
@@ -238,6 +256,10 @@ class WhileStatement final : public Statement {
   PROPERTY_GETTER(cond)
 
   PROPERTY_GETTER(body)
+
+  PROPERTY_SETTER(cond)
+
+  PROPERTY_SETTER(body)
 };
 
 class CallStatement final : public Statement {
@@ -267,7 +289,7 @@ class ReadStatement final : public Statement {
 };
 
 class WriteStatement final : public Statement {
-  const std::vector<Expression *> expressions_;
+  std::vector<Expression *> expressions_;
 
  public:
   using ListType = std::vector<Expression *>;
@@ -279,6 +301,8 @@ class WriteStatement final : public Statement {
   ~WriteStatement() final = default;
 
   PROPERTY_CONST_REF_GETTER(expressions)
+
+  PROPERTY_SETTER(expressions)
 };
 
 class VariableProxy final : public Expression {
@@ -311,6 +335,8 @@ class AssignStatement final : public Statement {
   PROPERTY_GETTER(target)
 
   PROPERTY_GETTER(expr)
+
+  PROPERTY_SETTER(expr)
 };
 
 class ReturnStatement final : public Statement {
@@ -333,6 +359,8 @@ class UnaryOperation final : public Expression {
   PROPERTY_GETTER(op)
 
   PROPERTY_GETTER(expr)
+
+  PROPERTY_SETTER(expr)
 };
 
 class BinaryOperation final : public Expression {
@@ -357,6 +385,12 @@ class BinaryOperation final : public Expression {
   PROPERTY_GETTER(left)
 
   PROPERTY_GETTER(right)
+
+  PROPERTY_SETTER(op)
+
+  PROPERTY_SETTER(left)
+
+  PROPERTY_SETTER(right)
 };
 
 class Literal final : public Expression {
@@ -369,8 +403,33 @@ class Literal final : public Expression {
   ~Literal() final = default;
 
   PROPERTY_GETTER(value)
+
+  PROPERTY_SETTER(value)
 };
 
+// Whether evaluating node may trap: division by anything but a constant other
+// than 0 and -1 may. Such an expression is kept even where its value is not
+// needed.
+inline bool MayTrap(Expression *node) {
+  switch (node->type()) {
+    case AstNodeType::kBinaryOperation: {
+      auto *operation = dynamic_cast<BinaryOperation *>(node);
+      if (operation->op() == Token::DIV) {
+        auto *divisor = dynamic_cast<Literal *>(operation->right());
+        if (divisor == nullptr || divisor->value() == 0
+            || divisor->value() == -1) {
+          return true;
+        }
+      }
+      return MayTrap(operation->left()) || MayTrap(operation->right());
+    }
+    case AstNodeType::kUnaryOperation:
+      return MayTrap(dynamic_cast<UnaryOperation *>(node)->expr());
+    default:
+      return false;
+  }
+}
+
 template<class Visitor>
 class AstVisitor {
  protected:
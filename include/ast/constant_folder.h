@@ -0,0 +1,45 @@
+#ifndef AST_CONSTANT_FOLDER_H
+#define AST_CONSTANT_FOLDER_H
+
+#include "ast.h"
+
+namespace pl0::ast {
+
+/**
+ * Rewrites a program in place before code generation. Constants and
+ * operations on literals are folded with the wrapping int arithmetic of the
+ * machine, identities such as x + 0, x * 1 and x * 0 are dropped (expressions
+ * have no side effects in PL/0; x * 0 is kept where x may trap, see MayTrap),
+ * and constants added to or subtracted from an expression are combined. An
+ * if with a constant condition is replaced by the branch taken and a while
+ * whose condition is constantly false by nothing.
+ *
+ * Division by a constant zero is reported instead of being left to trap at run
+ * time; INT_MIN / -1 is left to trap as before.
+ */
+class ConstantFolder : public AstVisitor<ConstantFolder> {
+ public:
+  /**
+   * @throw GeneralError on a division by a constant zero
+   */
+  void Fold(Block *program) { VisitBlock(program); }
+
+  DECLARE_VISIT_METHODS
+
+ private:
+  DEFINE_AST_VISITOR_SUBCLASS_MEMBERS
+
+  // the node to put in place of node
+  Expression *Fold(Expression *node);
+  Statement *Fold(Statement *node);
+
+  Expression *Combine(BinaryOperation *node);
+
+  // set by every visit to the replacement of the visited node
+  Expression *expression_{nullptr};
+  Statement *statement_{nullptr};
+};
+
+} // namespace pl0::ast
+
+#endif // AST_CONSTANT_FOLDER_H
@@ -0,0 +1,48 @@
+#ifndef AST_DEAD_CODE_ELIMINATOR_H
+#define AST_DEAD_CODE_ELIMINATOR_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.h"
+
+namespace pl0::ast {
+
+/**
+ * Removes code from a program before code generation that either never runs
+ * or has no effect anyone could observe: statements after one that never
+ * completes (a return, an if both branches of which return, a loop whose
+ * condition is constantly true), procedures not reachable by calls from the
+ * main program, and assignments to variables nothing left reads. Assignments
+ * whose expression could trap, dividing by a variable, are kept.
+ *
+ * Calls are followed by name as the compiler resolves them, so a procedure
+ * only an unreachable one calls is dropped as well.
+ */
+class DeadCodeEliminator : public AstVisitor<DeadCodeEliminator> {
+ public:
+  void Eliminate(Block *program);
+
+  DECLARE_VISIT_METHODS
+
+ private:
+  DEFINE_AST_VISITOR_SUBCLASS_MEMBERS
+
+  void Collect(Block *program);
+  void RemoveUnreachable(Block *node);
+  void RemoveDeadStores(Block *node);
+  // the statement to put in place of node
+  Statement *RemoveDeadStores(Statement *node);
+
+  // the procedures each one calls, nullptr being the main program
+  std::unordered_map<Procedure *, std::vector<Procedure *>> calls_;
+  std::unordered_set<Procedure *> reachable_;
+  std::unordered_set<Variable *> read_;
+  Procedure *current_{nullptr};
+  Scope *scope_{nullptr};
+};
+
+} // namespace pl0::ast
+
+#endif // AST_DEAD_CODE_ELIMINATOR_H
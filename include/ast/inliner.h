@@ -0,0 +1,71 @@
+#ifndef AST_INLINER_H
+#define AST_INLINER_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+
+namespace pl0::ast {
+
+/**
+ * Decides which calls the compiler expands in place of a CAL. The body of
+ * the callee is then compiled into the frame of the caller, its locals moved
+ * to slots of their own there; names keep resolving in the callee's scope
+ * and every other variable is reached by its lexical level as before.
+ *
+ * A procedure can be expanded if it declares no procedures of its own, which
+ * would need its frame as their static link, has no return, which would leave
+ * the caller, and is not part of a recursive cycle. Whether it is, is decided
+ * by its size in AST nodes, counting the calls expanded within it: tiny ones
+ * are always expanded, larger ones only where they are called from a loop or
+ * from a single place.
+ */
+class Inliner : public AstVisitor<Inliner> {
+ public:
+  // in AST nodes
+  static constexpr int kMaxSize = 16;
+  static constexpr int kMaxHotSize = 96;
+
+  explicit Inliner(Block *program);
+
+  /**
+   * The body to compile in place of a call to callee, nullptr to call it.
+   * loop_depth is the number of loops around the call site.
+   */
+  [[nodiscard]] Block *Expansion(Procedure *callee, int loop_depth);
+
+  DECLARE_VISIT_METHODS
+
+ private:
+  DEFINE_AST_VISITOR_SUBCLASS_MEMBERS
+
+  struct CallSite {
+    Procedure *callee;
+    int loop_depth;
+  };
+
+  struct Info {
+    Block *body = nullptr;
+    int size = 0;
+    bool returns = false;
+    bool recursive = false;
+    int call_sites = 0;
+    std::vector<CallSite> calls;
+    // size with the calls expanded, -1 until computed
+    int expanded_size = -1;
+  };
+
+  [[nodiscard]] bool Reaches(Procedure *from, Procedure *to) const;
+  int ExpandedSize(Procedure *procedure);
+
+  std::unordered_map<Procedure *, Info> procedures_;
+  // the procedure being visited, nullptr in the main program
+  Procedure *current_{nullptr};
+  Scope *scope_{nullptr};
+  int loop_depth_{0};
+};
+
+} // namespace pl0::ast
+
+#endif // AST_INLINER_H
@@ -18,15 +18,17 @@ public:
     void Store(int distance, int index);
     void        Call(int distance, int entry);
     Backpatcher Call(int caller_level);
+    Backpatcher TailCall(int caller_level);
     void        Branch(int target);
     Backpatcher Branch();
     void        BranchIfFalse(int target);
     Backpatcher BranchIfFalse();
-    void Enter(int scope_var_count);
+    Backpatcher Enter(int scope_var_count);
     void leave();
     void Read();
     void Write();
     void Operation(Token tk);
+    void Divisible();
 
     const bytecode &code();
 };
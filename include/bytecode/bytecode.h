@@ -7,7 +7,23 @@
 
 namespace pl0 {
 
-#define OPCODE_LIST(T) T(LIT) T(LOD) T(STO) T(CAL) T(INT) T(JMP) T(JPC) T(OPR)
+// Classic PL/0 folds every operation into OPR and selects it by the operand,
+// here each one is an opcode of its own (see Classic for the old encoding).
+// DVD has no classic counterpart: it pops b and a and pushes whether b
+// divides a, i.e. a / b * b = a, trapping where DIV would. Neither has DUP,
+// which pushes a copy of the top of the stack.
+#define BASIC_OPCODE_LIST(T)                                              \
+  T(LIT) T(LOD) T(STO) T(CAL) T(TCL) T(INT) T(JMP) T(JPC) T(ADD) T(SUB)   \
+  T(MUL) T(DIV) T(DVD) T(ODD) T(LT) T(LE) T(GT) T(GE) T(EQ) T(NE)         \
+  T(READ) T(WRITE) T(RET) T(DUP)
+
+// Superinstructions are only introduced by FuseSuperinstructions, see
+// superinstruction.h for the sequences they stand for.
+#define SUPERINSTRUCTION_LIST(T)                                         \
+  T(INC) T(DEC) T(LOD2) T(LODLIT) T(MOV) T(LADD) T(LSUB) T(LMUL) T(LDIV) \
+  T(JLT) T(JLE) T(JGT) T(JGE) T(JEQ) T(JNE) T(DUPSTO)
+
+#define OPCODE_LIST(T) BASIC_OPCODE_LIST(T) SUPERINSTRUCTION_LIST(T)
 
 #define T(x) x,
 enum class opcode : int { OPCODE_LIST(T) };
@@ -21,6 +37,14 @@ inline const char *operator*(opcode opc) {
   return opcode_name[static_cast<int>(opc)];
 }
 
+// TCL is a CAL in tail position: the callee takes over the frame of the
+// calling procedure and returns straight to its caller. The compiler only
+// emits it when the callee cannot see that frame, i.e. for a level distance
+// of at least one.
+inline bool IsCall(opcode op) {
+  return op == opcode::CAL || op == opcode::TCL;
+}
+
 enum class opt : int {
   RET = 0,
   SUB,
@@ -42,10 +66,33 @@ inline constexpr int operator*(opt x) {
   return static_cast<int>(x);
 }
 
-#define OPERATOR(name, string) {Token::name, opt::name},
-const std::unordered_map<Token, opt> token2opt = {
-    TOKEN_LIST(IGNORE_TOKEN, OPERATOR, IGNORE_TOKEN)};
-#undef OPERATOR
+const std::unordered_map<Token, opcode> token2opcode = {
+    {Token::ODD, opcode::ODD}, {Token::ADD, opcode::ADD},
+    {Token::SUB, opcode::SUB}, {Token::MUL, opcode::MUL},
+    {Token::DIV, opcode::DIV}, {Token::EQ, opcode::EQ},
+    {Token::NEQ, opcode::NE},  {Token::LE, opcode::LT},
+    {Token::LEQ, opcode::LE},  {Token::GE, opcode::GT},
+    {Token::GEQ, opcode::GE}};
+
+#define CLASSIC_OPERATION_LIST(V) \
+  V(RET, RET)                     \
+  V(ADD, ADD)                     \
+  V(SUB, SUB)                     \
+  V(MUL, MUL)                     \
+  V(DIV, DIV)                     \
+  V(ODD, ODD)                     \
+  V(LT, LE)                       \
+  V(LE, LEQ)                      \
+  V(GT, GE)                       \
+  V(GE, GEQ)                      \
+  V(EQ, EQ)                       \
+  V(NE, NEQ)                      \
+  V(READ, READ)                   \
+  V(WRITE, WRITE)
+
+// The operand of INT counts the three classic bookkeeping slots (static link,
+// dynamic link and return address) in addition to the locals.
+constexpr int kFrameBookkeeping = 3;
 
 struct Instruction {
   opcode op;
@@ -55,6 +102,28 @@ struct Instruction {
 
 using bytecode = std::vector<Instruction>;
 
+struct ClassicInstruction {
+  const char *op;
+  int level;
+  int address;
+};
+
+/**
+ * The classic PL/0 encoding of an instruction, operations are turned back into
+ * OPR 0 n. Only meant for presentation.
+ */
+inline ClassicInstruction Classic(const Instruction &ins) {
+  switch (ins.op) {
+#define V(name, operation) \
+  case opcode::name:       \
+    return {"OPR", 0, *opt::operation};
+    CLASSIC_OPERATION_LIST(V)
+#undef V
+    default:
+      return {*ins.op, ins.level, ins.address};
+  }
+}
+
 class Backpatcher {
   int pos_;
   bytecode *code_;
@@ -0,0 +1,77 @@
+#ifndef BYTECODE_CACHE_H
+#define BYTECODE_CACHE_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "../snapshot.h"
+#include "bytecode.h"
+
+namespace pl0 {
+
+/**
+ * Compiled programs kept on disk as images (see image.h), named by a hash of
+ * the source text, the compiler build and the flags that affect code
+ * generation. Entries are written to a temporary file and renamed into place,
+ * so concurrent runs never see half an image. A hit refreshes the modification
+ * time of its entry, and the least recently used entries are evicted once the
+ * directory grows beyond its capacity. A program folded by partial evaluation
+ * is kept as a snapshot (see snapshot.h) instead, holding the folded state
+ * along with the code.
+ *
+ * The cache is best effort: an entry that cannot be read or written counts as
+ * a miss and never fails a run. Statistics are kept in the directory as well;
+ * concurrent runs may lose an update of them.
+ */
+class CompilationCache {
+ public:
+  struct Statistics {
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t evictions = 0;
+  };
+
+  struct Entry {
+    bytecode code;
+    // the state partial evaluation folded the program to, if it was
+    std::optional<Snapshot> prefix;
+  };
+
+  static constexpr uint64_t kDefaultCapacity = 64 << 20;
+
+  CompilationCache(std::string directory, uint64_t capacity);
+
+  // $PL0_CACHE_DIR, else $XDG_CACHE_HOME/pl0, else $HOME/.cache/pl0
+  static std::string DefaultDirectory();
+
+  /**
+   * The key of source compiled with flags, which has to spell out every
+   * option affecting the bytecode
+   */
+  static std::string Key(const std::string &source, const std::string &flags);
+
+  // a hit or a miss, recorded in the statistics
+  std::optional<Entry> Find(const std::string &key);
+
+  // prefix, if given, is stored in place of code
+  void Store(
+      const std::string &key,
+      const bytecode &code,
+      const Snapshot *prefix = nullptr);
+
+  [[nodiscard]] Statistics statistics() const;
+
+ private:
+  [[nodiscard]] std::string PathOf(
+      const std::string &key, const char *extension) const;
+  void Record(int64_t Statistics::*counter, int64_t count = 1);
+  void Evict();
+
+  std::string directory_;
+  uint64_t capacity_;
+};
+
+} // namespace pl0
+
+#endif
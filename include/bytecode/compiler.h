@@ -1,7 +1,10 @@
 #ifndef BYTECODE_COMPILER_H
 #define BYTECODE_COMPILER_H
 
+#include <memory>
+
 #include "../ast/ast.h"
+#include "../ast/inliner.h"
 #include "../util.h"
 #include "assembler.h"
 
@@ -11,15 +14,36 @@ class Compiler : public ast::AstVisitor<Compiler> {
   std::unordered_map<Procedure *, int> entry_points_;
   std::unordered_map<Procedure *, std::vector<Backpatcher>> patch_list_;
   assembler assembler_;
+  // the scope whose frame the code runs in
   Scope *top_scope_{nullptr};
+  // the scope names are resolved in, the callee's within an expanded call
+  Scope *lexical_scope_{nullptr};
+  // the statement being compiled is the last one of its procedure
+  bool tail_{false};
+  int loop_depth_{0};
+
+  bool inlining_;
+  bool lazy_;
+  std::unique_ptr<ast::Inliner> inliner_;
+  // slots of the current frame holding the locals of expanded callees
+  std::unordered_map<Variable *, int> moved_;
+  int frame_size_{0};
+  int frame_peak_{0};
 
   DECLARE_VISIT_METHODS
   DEFINE_AST_VISITOR_SUBCLASS_MEMBERS
 
   void VisitRvalue(ast::VariableProxy *node);
   void VisitLvalue(ast::VariableProxy *node);
+  void Expand(ast::Block *callee);
+  void EmitProcedures(ast::Block *program);
 
  public:
+  // inlining expands small or hot procedures in place of their calls, lazy
+  // leaves out the procedures no emitted call reaches
+  explicit Compiler(bool inlining = true, bool lazy = true)
+      : inlining_(inlining), lazy_(lazy) {}
+
   void Generate(ast::Block *program);
   const bytecode &code() { return assembler_.code(); }
 };
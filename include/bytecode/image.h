@@ -0,0 +1,52 @@
+#ifndef BYTECODE_IMAGE_H
+#define BYTECODE_IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../util.h"
+#include "bytecode.h"
+
+namespace pl0 {
+
+/**
+ * A compiled program on disk, so that running it again skips lexing, parsing
+ * and code generation. The file is a header followed by the instructions, in
+ * the layout of Instruction, and the procedure entry table:
+ *
+ *   magic "PL0B", version, opcode count, instruction count, entry count
+ *   instruction count * {opcode, level, address}
+ *   entry count * entry
+ *
+ * Every field is a 32-bit integer in host byte order; an image written on a
+ * machine of the other byte order fails the magic check. Images are only
+ * valid for a build with the same opcode set.
+ */
+struct Image {
+  static constexpr uint32_t kMagic = 0x42304c50; // "PL0B" read little-endian
+  static constexpr uint32_t kVersion = 1;
+
+  bytecode code;
+  // the main program and every procedure, in ascending order
+  std::vector<int> entries;
+};
+
+// Positions of the main program and of every CAL target, in ascending order
+std::vector<int> ProcedureEntries(const bytecode &code);
+
+/**
+ * @throw GeneralError if the file cannot be written
+ */
+void WriteImage(const bytecode &code, const std::string &path);
+
+/**
+ * Map an image and check it: the header, that every call lands on an entry of
+ * the table, and the code as VerifyBytecode does.
+ * @throw GeneralError if the file cannot be read or is not a valid image
+ */
+Image LoadImage(const std::string &path);
+
+} // namespace pl0
+
+#endif
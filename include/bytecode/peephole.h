@@ -0,0 +1,29 @@
+#ifndef BYTECODE_PEEPHOLE_H
+#define BYTECODE_PEEPHOLE_H
+
+#include "bytecode.h"
+
+namespace pl0 {
+
+/**
+ * Cleans up the final code of either compiler before superinstructions are
+ * fused, until nothing changes:
+ *
+ *   JMP a ... a: JMP b    JMP b      (likewise JPC, nested ifs and loops)
+ *   JMP a ... a: RET      RET
+ *   JMP a; a:             a:
+ *   STO x; LOD x          DUP; STO x
+ *
+ * Instructions no path from the start reaches are deleted, as is the INT at
+ * the entry of a procedure without locals: CAL already reserved what it
+ * needs, and it only sets up the header. The code is compacted and every
+ * address of a JMP, JPC, CAL and TCL moved along, those the Backpatcher
+ * filled in included, since they sit in the code like any other by now.
+ * A LOD that is jumped to is left alone, as is one after LOD y; STO x,
+ * which fuse to MOV.
+ */
+void OptimizePeepholes(bytecode &code);
+
+} // namespace pl0
+
+#endif // BYTECODE_PEEPHOLE_H
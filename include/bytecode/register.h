@@ -0,0 +1,74 @@
+#ifndef BYTECODE_REGISTER_H
+#define BYTECODE_REGISTER_H
+
+#include <vector>
+
+namespace pl0::reg {
+
+/**
+ * Three-address register bytecode. Registers are the slots of the current
+ * frame: the variables of the procedure come first, temporaries follow.
+ * Operand names refer to the fields of Instruction, R[x] is register x.
+ *
+ *   MOVE  a b     R[a] = R[b]
+ *   LOADK a k     R[a] = k
+ *   GETUP a l i   R[a] = variable i of the frame l static links up
+ *   SETUP a l i   variable i of the frame l static links up = R[a]
+ *   ADD   a b c   R[a] = R[b] + R[c]   (likewise SUB, MUL, DIV)
+ *   ADDK  a b k   R[a] = R[b] + k      (likewise SUBK, MULK, DIVK)
+ *   JMP   t       jump to t
+ *   JLT   t b c   jump to t if R[b] < R[c]  (likewise JLE, JGT, JGE, JEQ, JNE)
+ *   JLTK  t b k   jump to t if R[b] < k     (likewise JLEK, ..., JNEK)
+ *   JEVEN t b     jump to t if R[b] is even
+ *   CALL  l t     call the procedure at t whose static link is l links up
+ *   ENTER n       allocate n zero-initialized registers
+ *   RET           return to the caller
+ *   READ  a       read an integer into R[a]
+ *   WRITE a       write R[a]
+ */
+#define REGISTER_ARITHMETIC_LIST(V) \
+  V(ADD, +)                         \
+  V(SUB, -)                         \
+  V(MUL, *)                         \
+  V(DIV, /)
+
+#define REGISTER_BRANCH_LIST(V) \
+  V(JLT, <)                     \
+  V(JLE, <=)                    \
+  V(JGT, >)                     \
+  V(JGE, >=)                    \
+  V(JEQ, ==)                    \
+  V(JNE, !=)
+
+#define REGISTER_BINARY_OPCODES(name, op) T(name) T(name##K)
+
+#define REGISTER_OPCODE_LIST(T)                           \
+  T(MOVE) T(LOADK) T(GETUP) T(SETUP)                      \
+  REGISTER_ARITHMETIC_LIST(REGISTER_BINARY_OPCODES)       \
+  T(JMP) REGISTER_BRANCH_LIST(REGISTER_BINARY_OPCODES)    \
+  T(JEVEN) T(CALL) T(ENTER) T(RET) T(READ) T(WRITE)
+
+#define T(x) x,
+enum class opcode : int { REGISTER_OPCODE_LIST(T) };
+#undef T
+
+#define T(name) #name,
+const char *const opcode_name[] = {REGISTER_OPCODE_LIST(T)};
+#undef T
+
+inline const char *operator*(opcode opc) {
+  return opcode_name[static_cast<int>(opc)];
+}
+
+struct Instruction {
+  opcode op;
+  int a;
+  int b;
+  int c;
+};
+
+using bytecode = std::vector<Instruction>;
+
+} // namespace pl0::reg
+
+#endif
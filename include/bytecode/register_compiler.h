@@ -0,0 +1,51 @@
+#ifndef BYTECODE_REGISTER_COMPILER_H
+#define BYTECODE_REGISTER_COMPILER_H
+
+#include "../ast/ast.h"
+#include "../util.h"
+#include "register.h"
+
+namespace pl0::code {
+
+/**
+ * Generates register bytecode. Variables of the current procedure are used
+ * as operands in place, so most statements compile to a single instruction;
+ * temporaries are allocated above them and released after every statement.
+ */
+class RegisterCompiler : public ast::AstVisitor<RegisterCompiler> {
+  // either a register or an immediate value
+  struct Operand {
+    bool constant;
+    int value;
+  };
+
+  static constexpr int kNoRegister = -1;
+
+  std::unordered_map<Procedure *, int> entry_points_;
+  std::vector<std::pair<Procedure *, int>> patch_list_;
+  reg::bytecode code_;
+  Scope *top_scope_{nullptr};
+  int next_temporary_{0};
+  int register_count_{0};
+  Operand result_{};
+  int destination_{kNoRegister};
+
+  DECLARE_VISIT_METHODS
+  DEFINE_AST_VISITOR_SUBCLASS_MEMBERS
+
+  int Emit(reg::opcode op, int a = 0, int b = 0, int c = 0);
+  int GetNextAddress() { return static_cast<int>(code_.size()); }
+  int NewTemporary();
+  void VisitStatement(ast::Statement *node);
+  Operand Evaluate(ast::Expression *node, int destination = kNoRegister);
+  int EvaluateToRegister(ast::Expression *node);
+  int BranchIfFalse(ast::Expression *cond);
+
+ public:
+  void Generate(ast::Block *program);
+  const reg::bytecode &code() { return code_; }
+};
+
+} // namespace pl0::code
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BYTECODE_SUPERINSTRUCTION_H
+#define BYTECODE_SUPERINSTRUCTION_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+
+namespace pl0 {
+
+/**
+ * Superinstructions are fused in place: only the opcode of the first
+ * instruction of a sequence is replaced, its operands and the remaining
+ * instructions are left untouched. The fused handler reads the operands it
+ * needs from the following slots and skips them, while a jump landing in the
+ * middle of a sequence still executes the original instructions. No address
+ * has to be relocated.
+ *
+ *   INC  x      LOD x; LIT k; ADD; STO x
+ *   DEC  x      LOD x; LIT k; SUB; STO x
+ *   LOD2 x      LOD x; LOD y
+ *   LODLIT x    LOD x; LIT k
+ *   MOV  x      LOD x; STO y
+ *   LADD x      LOD x; ADD     (likewise LSUB, LMUL, LDIV)
+ *   JGE         LT; JPC t      (likewise JLT, JLE, JGT, JEQ, JNE, jumping
+ *                               when the comparison fails)
+ *   DUPSTO x    DUP; STO x
+ *
+ * The set was picked from the loop-weighted n-gram frequencies of the
+ * programs under example/, see PrintNgrams.
+ */
+void FuseSuperinstructions(bytecode &code);
+
+/**
+ * The opcode a superinstruction replaced in its first slot, basic opcodes map
+ * to themselves.
+ */
+opcode Unfused(opcode op);
+
+/**
+ * Whether the instruction at pos is followed by the remaining slots of the
+ * sequence it was fused from, always true for basic opcodes. Only code that
+ * does not come from FuseSuperinstructions can fail this.
+ */
+bool IsWellFused(const bytecode &code, size_t pos);
+
+/**
+ * Estimated relative execution frequency of every instruction. Code inside
+ * loops is weighted by its loop depth and procedures by the weight of their
+ * call sites.
+ */
+std::vector<double> EstimateFrequencies(const bytecode &code);
+
+/**
+ * Print the most frequent opcode n-grams of a program, weighted by the
+ * estimated frequencies.
+ */
+void PrintNgrams(const bytecode &code, std::ostream &out, int top = 10);
+
+} // namespace pl0
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef BYTECODE_VERIFIER_H
+#define BYTECODE_VERIFIER_H
+
+#include "bytecode.h"
+
+namespace pl0 {
+
+/**
+ * Check code that does not come straight from the compiler, an image or a
+ * snapshot, before the interpreter trusts it. Whatever the code does, the
+ * machine then stays within its code, display and stack:
+ *
+ * - every opcode exists, and every superinstruction is followed by the slots
+ *   of the sequence it was fused from;
+ * - jumps stay inside their procedure, calls land on a procedure entry, and
+ *   no procedure runs off into the next one;
+ * - the main program starts with INT, other procedures only may, no jump
+ *   runs it again, and every INT reserves the bookkeeping slots and a sane
+ *   number of locals;
+ * - every procedure is called at one lexical level, below the display size,
+ *   and neither calls nor LOD and STO reach out further than the main
+ *   program;
+ * - LOD and STO stay below the locals the INT of every procedure they may
+ *   find at that level reserved;
+ * - the operand stack is as high wherever control meets, never pops what is
+ *   not there and never grows beyond MaxOperandDepth.
+ *
+ * Procedures no call from the main program reaches are only checked for the
+ * first two.
+ * @throw GeneralError naming the first check that fails
+ */
+void VerifyBytecode(const bytecode &code);
+
+// What a machine resumed in the middle of code needs to check its frames
+// against, per instruction of code VerifyBytecode accepts.
+struct ProcedureLayout {
+  // lexical level of the procedure, -1 if no call from the main program
+  // reaches it
+  std::vector<int> levels;
+  // locals the INT of the procedure reserves
+  std::vector<int> locals;
+};
+
+/**
+ * @throw GeneralError if the levels or frames of code are inconsistent
+ */
+ProcedureLayout LayOutProcedures(const bytecode &code);
+
+} // namespace pl0
+
+#endif // BYTECODE_VERIFIER_H
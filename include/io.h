@@ -0,0 +1,163 @@
+#ifndef IO_H
+#define IO_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PL0_BUFFERED_IO 1
+#else
+#define PL0_BUFFERED_IO 0
+#endif
+
+namespace pl0 {
+
+/**
+ * Where READ takes its integers from and WRITE puts them, one per line. Every
+ * engine goes through this, so the choice of channel is made once per run.
+ */
+class Io {
+ public:
+  virtual ~Io() = default;
+
+  /**
+   * Next integer of the input, parsed like std::cin >> int: 0 once the input
+   * is exhausted or malformed, clamped to the range of int on overflow
+   */
+  virtual int Read() = 0;
+  virtual void Write(int value) = 0;
+  // anything written so far reaches the output
+  virtual void Flush() = 0;
+};
+
+enum class IoMode {
+  kStream,   // std::cin and std::cout
+  kBuffered, // large buffers on the standard file descriptors
+};
+
+constexpr bool kBufferedIoAvailable = PL0_BUFFERED_IO;
+
+/**
+ * std::cin and std::cout, as used before there was a choice. std::cin is tied
+ * to std::cout, so every READ flushes the output.
+ */
+class StreamIo : public Io {
+ public:
+  int Read() override;
+  void Write(int value) override;
+  void Flush() override;
+};
+
+/**
+ * Reads a file descriptor in large blocks and parses integers by hand, formats
+ * WRITE into an output buffer for another one. The output is flushed when the
+ * buffer is full, on Flush and on destruction, and before every READ if the
+ * input is a terminal so that prompts show up. Output is byte for byte that of
+ * StreamIo. The descriptors are not closed.
+ */
+class BufferedIo : public Io {
+ public:
+  static constexpr int kBufferSize = 1 << 16;
+
+  // standard input and output by default
+  explicit BufferedIo(int input_fd = 0, int output_fd = 1);
+  ~BufferedIo() override;
+  BufferedIo(const BufferedIo &) = delete;
+  BufferedIo &operator=(const BufferedIo &) = delete;
+
+  int Read() override;
+  void Write(int value) override;
+  void Flush() override;
+
+ private:
+  // next byte of the input without consuming it, -1 at the end
+  int Peek();
+
+  int input_fd_;
+  int output_fd_;
+  std::unique_ptr<char[]> input_;
+  std::unique_ptr<char[]> output_;
+  int input_begin_{0};
+  int input_end_{0};
+  int output_size_{0};
+  bool interactive_{false};
+  // like the failbit of a stream, every later READ gives 0
+  bool failed_{false};
+};
+
+// Input taken from a string, output collected in one.
+class MemoryIo : public Io {
+ public:
+  explicit MemoryIo(std::string input = {}) : input_(std::move(input)) {}
+
+  int Read() override;
+  void Write(int value) override;
+  void Flush() override {}
+
+  [[nodiscard]] const std::string &output() const { return output_; }
+
+ private:
+  std::string input_;
+  size_t position_{0};
+  std::string output_;
+  bool failed_{false};
+};
+
+// Every READ and WRITE handed to a function of the embedder.
+class CallbackIo : public Io {
+ public:
+  CallbackIo(
+      std::function<int()> read,
+      std::function<void(int)> write,
+      std::function<void()> flush = {})
+      : read_(std::move(read)),
+        write_(std::move(write)),
+        flush_(std::move(flush)) {}
+
+  int Read() override { return read_(); }
+  void Write(int value) override { write_(value); }
+  void Flush() override {
+    if (flush_) { flush_(); }
+  }
+
+ private:
+  std::function<int()> read_;
+  std::function<void(int)> write_;
+  std::function<void()> flush_;
+};
+
+// Passes everything on to another channel and keeps a copy of what is written.
+class RecordingIo : public Io {
+ public:
+  explicit RecordingIo(Io &io) : io_(io) {}
+
+  int Read() override { return io_.Read(); }
+  void Write(int value) override {
+    if (recording_) { written_.push_back(value); }
+    io_.Write(value);
+  }
+  void Flush() override { io_.Flush(); }
+
+  [[nodiscard]] const std::vector<int> &written() const { return written_; }
+  void StopRecording() { recording_ = false; }
+
+ private:
+  Io &io_;
+  std::vector<int> written_;
+  bool recording_{true};
+};
+
+/**
+ * The channel for a run on the standard streams, StreamIo where buffered I/O
+ * is unavailable
+ */
+std::unique_ptr<Io> MakeIo(IoMode mode);
+
+// std::cin and std::cout, shared by every caller that does not choose
+Io &StandardIo();
+
+} // namespace pl0
+
+#endif
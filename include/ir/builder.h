@@ -0,0 +1,86 @@
+#ifndef IR_BUILDER_H
+#define IR_BUILDER_H
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../ast/ast.h"
+#include "../ast/inliner.h"
+#include "ir.h"
+
+namespace pl0::ir {
+
+/**
+ * Translates a program into SSA form as it goes, with the algorithm of Braun
+ * et al., "Simple and Efficient Construction of Static Single Assignment
+ * Form": an assignment to a promoted variable only records the value for the
+ * block, a use looks it up through the predecessors and places a phi where
+ * they disagree; phis found trivial are removed right away.
+ *
+ * Calls the inliner decides to expand are built into the caller as the code
+ * generator does. Functions are built for the main program and for every
+ * procedure an emitted call reaches, in the order they are declared; without
+ * lazy, for every procedure.
+ */
+class Builder : public ast::AstVisitor<Builder> {
+ public:
+  explicit Builder(bool inlining = true, bool lazy = true)
+      : inlining_(inlining), lazy_(lazy) {}
+
+  /**
+   * @throw GeneralError on a call of something but a procedure, an assignment
+   *   to something but a variable or a procedure used as a value
+   */
+  std::unique_ptr<Module> Build(ast::Block *program);
+
+  DECLARE_VISIT_METHODS
+
+ private:
+  DEFINE_AST_VISITOR_SUBCLASS_MEMBERS
+
+  void BuildFunction(Procedure *symbol, ast::Block *block);
+  void Expand(ast::Block *callee);
+  Procedure *ResolveCallee(ast::CallStatement *node);
+
+  void Enter(BasicBlock *block);
+  Instruction *Evaluate(ast::Expression *node);
+  void Assign(ast::VariableProxy *target, Instruction *value);
+  Instruction *Append(Opcode op, std::vector<Instruction *> operands = {});
+  Instruction *Const(int value);
+  void Jump(BasicBlock *target);
+  void Branch(Instruction *cond, BasicBlock *on_true, BasicBlock *on_false);
+  // a block nothing jumps to for the code following a return
+  void StartUnreachable();
+
+  void WriteVariable(Variable *var, BasicBlock *block, Instruction *value);
+  Instruction *ReadVariable(Variable *var, BasicBlock *block);
+  Instruction *ReadVariableRecursive(Variable *var, BasicBlock *block);
+  Instruction *AddPhiOperands(Variable *var, Instruction *phi);
+  Instruction *TryRemoveTrivialPhi(Instruction *phi);
+  void Seal(BasicBlock *block);
+
+  bool inlining_;
+  bool lazy_;
+  std::unique_ptr<ast::Inliner> inliner_;
+  std::unique_ptr<Module> module_;
+  // variables a function reaches in a frame other than its own, all others
+  // are kept in SSA values
+  std::unordered_set<Variable *> escaping_;
+
+  Function *function_{nullptr};
+  BasicBlock *block_{nullptr};
+  Scope *lexical_scope_{nullptr};
+  int loop_depth_{0};
+  Instruction *value_{nullptr};
+
+  std::unordered_map<BasicBlock *, std::unordered_map<Variable *, Instruction *>>
+      definitions_;
+  std::unordered_set<BasicBlock *> sealed_;
+  std::unordered_map<BasicBlock *, std::vector<std::pair<Variable *, Instruction *>>>
+      incomplete_phis_;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_BUILDER_H
@@ -0,0 +1,38 @@
+#ifndef IR_CLOSED_FORM_H
+#define IR_CLOSED_FORM_H
+
+#include <unordered_set>
+
+#include "pass.h"
+
+namespace pl0::ir {
+
+/**
+ * Replaces a loop that only computes values by the values it computes.
+ *
+ * The loop has to be left from its header alone, on comparing an induction
+ * variable stepped by a constant with an invariant bound, and nothing in it
+ * may have an effect or trap. Every phi of the header used after the loop
+ * must be an induction variable or a sum of values affine in the number of
+ * the iteration: s := s + i and s := s + 2 * i + k but not s := s + s or
+ * s := s * i. Its value after T iterations is then a polynomial of degree
+ * two in T, which wrapping arithmetic computes modulo 2^32 just as the loop
+ * would, T (T - 1) / 2 included, by halving whichever factor is even.
+ *
+ * The number of iterations is only right if the induction variable does not
+ * wrap around on the way to its bound, and their distance fits an integer.
+ * Where the bounds are not known, both are tested before the loop, which is
+ * kept for when they do not hold.
+ */
+class ClosedForm : public Pass {
+ public:
+  bool Run(Function &function) override;
+
+ private:
+  // headers of the loops already summarized, kept as the fallback
+  std::unordered_set<BasicBlock *> done_;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_CLOSED_FORM_H
@@ -0,0 +1,52 @@
+#ifndef IR_GVN_H
+#define IR_GVN_H
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "loops.h"
+#include "mod_ref.h"
+#include "pass.h"
+
+namespace pl0::ir {
+
+/**
+ * Global value numbering over the dominator tree: an instruction computing
+ * what one dominating it already computed is replaced by it. Operands are
+ * compared by value, constants by what they are, and the operands of Add,
+ * Mul, Eq and Ne in either order, Gt and Ge being Lt and Le swapped. A
+ * division may trap, but not after an equal one did not.
+ *
+ * A load gets the value last loaded from or stored to its variable, unless
+ * something may have stored to it since: a store, a call of a procedure that
+ * ModRef says stores to it, or, for the first block of an if or a loop, any
+ * of those between the block dominating it and it.
+ */
+class GlobalValueNumbering : public Pass {
+ public:
+  void Initialize(Module &module) override;
+  bool Run(Function &function) override;
+
+ private:
+  // an operation and the value numbers of its operands
+  using Key = std::vector<int64_t>;
+  using ValueTable = std::map<Key, Instruction *>;
+  using MemoryTable = std::unordered_map<Variable *, Instruction *>;
+
+  void Visit(BasicBlock *block, ValueTable values, MemoryTable memory);
+  void Kill(BasicBlock *block, MemoryTable &memory) const;
+  [[nodiscard]] Instruction *Find(Instruction *value) const;
+  [[nodiscard]] Key KeyOf(Instruction *instruction) const;
+
+  std::unique_ptr<ModRef> mod_ref_;
+  std::unique_ptr<Dominators> dominators_;
+  std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> children_;
+  // what each removed instruction was replaced by
+  std::unordered_map<Instruction *, Instruction *> replaced_;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_GVN_H
@@ -0,0 +1,253 @@
+#ifndef IR_IR_H
+#define IR_IR_H
+
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "../parsing/scope.h"
+#include "../parsing/symbol.h"
+#include "../parsing/token.h"
+
+namespace pl0::ir {
+
+/**
+ * The middle end between the AST and the stack bytecode. Every procedure
+ * left after inlining is a Function, a control flow graph of basic blocks in
+ * SSA form: a variable only its own procedure uses is nothing but the values
+ * assigned to it, joined by phis, while one a nested procedure can see stays
+ * in the frame and is read and written by explicit loads and stores, which a
+ * call may clobber. Operands are instructions, every instruction producing a
+ * value is that value.
+ *
+ *   Const k         the integer k
+ *   Add a b         a + b, wrapping (likewise Sub, Mul), Div truncates
+ *   Lt a b          1 if a < b, 0 otherwise (likewise Le, Gt, Ge, Eq, Ne)
+ *   Odd a           a % 2
+ *   Divisible a b   1 if a / b * b = a, 0 otherwise, trapping like Div
+ *   Phi a b ...     the operand of the predecessor control came from
+ *   Load v          variable v, in the frame of its level
+ *   Store v a       a into variable v
+ *   Call p          calls procedure p
+ *   Read            an integer from the input
+ *   Write a         writes a to the output
+ *   Jump t          continues at block t
+ *   Branch a t f    continues at t if a is not 0, at f otherwise
+ *   Return          leaves the procedure
+ *
+ * Every block ends with one of the last three, its phis come first.
+ */
+#define IR_BINARY_LIST(V) \
+  V(Add, ADD)             \
+  V(Sub, SUB)             \
+  V(Mul, MUL)             \
+  V(Div, DIV)             \
+  V(Lt, LE)               \
+  V(Le, LEQ)              \
+  V(Gt, GE)               \
+  V(Ge, GEQ)              \
+  V(Eq, EQ)               \
+  V(Ne, NEQ)
+
+#define IR_BINARY_OPCODE(name, token) T(name)
+
+#define IR_OPCODE_LIST(T)                                              \
+  T(Const) IR_BINARY_LIST(IR_BINARY_OPCODE) T(Odd) T(Divisible) T(Phi) \
+  T(Load) T(Store) T(Call) T(Read) T(Write) T(Jump) T(Branch) T(Return)
+
+#define T(x) k##x,
+enum class Opcode : int { IR_OPCODE_LIST(T) };
+#undef T
+
+#define T(x) #x,
+const char *const opcode_name[] = {IR_OPCODE_LIST(T)};
+#undef T
+
+inline const char *operator*(Opcode op) {
+  return opcode_name[static_cast<int>(op)];
+}
+
+[[nodiscard]] bool IsBinary(Opcode op);
+// the operator op computes, Token::ODD for Odd
+[[nodiscard]] Token OperatorOf(Opcode op);
+// the opcode computing the binary operator tk
+[[nodiscard]] Opcode BinaryOf(Token tk);
+
+class BasicBlock;
+
+class Instruction {
+ public:
+  Instruction(int id, Opcode op, std::vector<Instruction *> operands)
+      : id_(id), op_(op), operands_(std::move(operands)) {}
+
+  // unique within the function, below Function::instruction_count()
+  [[nodiscard]] int id() const { return id_; }
+  [[nodiscard]] Opcode op() const { return op_; }
+  void set_op(Opcode op) { op_ = op; }
+
+  [[nodiscard]] const std::vector<Instruction *> &operands() const {
+    return operands_;
+  }
+  [[nodiscard]] Instruction *operand(size_t i) const { return operands_[i]; }
+  void set_operand(size_t i, Instruction *value) { operands_[i] = value; }
+  void set_operands(std::vector<Instruction *> operands) {
+    operands_ = std::move(operands);
+  }
+  void AddOperand(Instruction *value) { operands_.push_back(value); }
+  void RemoveOperand(size_t i) { operands_.erase(operands_.begin() + i); }
+
+  // of a Const
+  [[nodiscard]] int value() const { return value_; }
+  void set_value(int value) { value_ = value; }
+  // of a Load or a Store
+  [[nodiscard]] Variable *variable() const { return variable_; }
+  void set_variable(Variable *variable) { variable_ = variable; }
+  // of a Call
+  [[nodiscard]] Procedure *callee() const { return callee_; }
+  void set_callee(Procedure *callee) { callee_ = callee; }
+  // of a Jump or a Branch, the block taken first
+  [[nodiscard]] const std::vector<BasicBlock *> &targets() const {
+    return targets_;
+  }
+  void set_targets(std::vector<BasicBlock *> targets) {
+    targets_ = std::move(targets);
+  }
+  void set_target(size_t i, BasicBlock *target) { targets_[i] = target; }
+
+  [[nodiscard]] BasicBlock *block() const { return block_; }
+  void set_block(BasicBlock *block) { block_ = block; }
+
+  [[nodiscard]] bool IsConstant() const { return op_ == Opcode::kConst; }
+  [[nodiscard]] bool IsTerminator() const {
+    return op_ == Opcode::kJump || op_ == Opcode::kBranch
+           || op_ == Opcode::kReturn;
+  }
+  [[nodiscard]] bool HasValue() const;
+  // whether it does something besides computing its value
+  [[nodiscard]] bool HasSideEffects() const;
+  // a division or divisibility test by anything but a constant other than 0
+  // and -1
+  [[nodiscard]] bool MayTrap() const;
+
+ private:
+  int id_;
+  Opcode op_;
+  std::vector<Instruction *> operands_;
+  int value_{0};
+  Variable *variable_{nullptr};
+  Procedure *callee_{nullptr};
+  std::vector<BasicBlock *> targets_;
+  BasicBlock *block_{nullptr};
+};
+
+class BasicBlock {
+ public:
+  using ListType = std::vector<Instruction *>;
+
+  explicit BasicBlock(int id) : id_(id) {}
+
+  [[nodiscard]] int id() const { return id_; }
+
+  [[nodiscard]] const ListType &instructions() const { return instructions_; }
+  // phis are inserted before the other instructions, anything else before
+  // the terminator if there is one
+  void Append(Instruction *instruction);
+  void Insert(size_t position, Instruction *instruction);
+  // the instruction is left in no block
+  void Remove(Instruction *instruction);
+  void set_instructions(ListType instructions);
+
+  // nullptr while the block is being built
+  [[nodiscard]] Instruction *terminator() const;
+  [[nodiscard]] std::vector<BasicBlock *> successors() const;
+  [[nodiscard]] size_t phi_count() const;
+
+  // the order phi operands are in
+  [[nodiscard]] const std::vector<BasicBlock *> &predecessors() const {
+    return predecessors_;
+  }
+  void AddPredecessor(BasicBlock *block) { predecessors_.push_back(block); }
+  // the operands of the phis are left to the caller
+  void set_predecessors(std::vector<BasicBlock *> blocks) {
+    predecessors_ = std::move(blocks);
+  }
+  // one edge from block, and the operands of the phis coming along it
+  void RemovePredecessor(BasicBlock *block);
+  void ReplacePredecessor(BasicBlock *from, BasicBlock *to);
+
+ private:
+  int id_;
+  ListType instructions_;
+  std::vector<BasicBlock *> predecessors_;
+};
+
+class Function {
+ public:
+  // symbol is nullptr for the main program
+  Function(Procedure *symbol, Scope *scope) : symbol_(symbol), scope_(scope) {}
+
+  [[nodiscard]] Procedure *symbol() const { return symbol_; }
+  [[nodiscard]] Scope *scope() const { return scope_; }
+  // of the frame the code runs in
+  [[nodiscard]] int level() const { return scope_->level(); }
+
+  // in layout order, the entry first
+  [[nodiscard]] const std::vector<BasicBlock *> &blocks() const {
+    return blocks_;
+  }
+  void set_blocks(std::vector<BasicBlock *> blocks) {
+    blocks_ = std::move(blocks);
+  }
+  [[nodiscard]] BasicBlock *entry() const { return blocks_.front(); }
+
+  // slots of the frame holding variables nested procedures reach, every
+  // other one is free for values
+  [[nodiscard]] const std::vector<int> &reserved_slots() const {
+    return reserved_slots_;
+  }
+  void Reserve(int slot) { reserved_slots_.push_back(slot); }
+
+  // appended to the layout
+  BasicBlock *NewBlock();
+  // laid out right before position
+  BasicBlock *NewBlockBefore(BasicBlock *position);
+  void MoveToEnd(BasicBlock *block);
+  // placed in no block yet
+  Instruction *New(Opcode op, std::vector<Instruction *> operands = {});
+  [[nodiscard]] int instruction_count() const {
+    return static_cast<int>(instructions_.size());
+  }
+
+  void ReplaceAllUses(Instruction *of, Instruction *with);
+  // edge from pred to succ becomes one through a new empty block
+  BasicBlock *SplitEdge(BasicBlock *pred, BasicBlock *succ);
+
+ private:
+  Procedure *symbol_;
+  Scope *scope_;
+  std::vector<BasicBlock *> blocks_;
+  std::vector<int> reserved_slots_;
+  // owners, whatever the blocks still refer to
+  std::vector<std::unique_ptr<BasicBlock>> block_pool_;
+  std::vector<std::unique_ptr<Instruction>> instructions_;
+};
+
+class Module {
+ public:
+  // the main program is the first one
+  [[nodiscard]] const std::vector<std::unique_ptr<Function>> &functions()
+      const {
+    return functions_;
+  }
+  Function *NewFunction(Procedure *symbol, Scope *scope);
+
+ private:
+  std::vector<std::unique_ptr<Function>> functions_;
+};
+
+void Print(const Module &module, std::ostream &out);
+
+} // namespace pl0::ir
+
+#endif // IR_IR_H
@@ -0,0 +1,33 @@
+#ifndef IR_LICM_H
+#define IR_LICM_H
+
+#include <memory>
+
+#include "loops.h"
+#include "mod_ref.h"
+#include "pass.h"
+
+namespace pl0::ir {
+
+/**
+ * Moves what a loop computes the same way on every iteration to its
+ * preheader: arithmetic on values defined outside the loop, and loads of
+ * variables neither the loop nor a procedure it calls stores to. A load from
+ * the function's own frame is only moved for arithmetic using it, by itself
+ * it costs no more than reading the slot it would be kept in. A division that
+ * may trap stays, the loop might have been left before getting to it.
+ */
+class LoopInvariantCodeMotion : public Pass {
+ public:
+  void Initialize(Module &module) override;
+  bool Run(Function &function) override;
+
+ private:
+  bool Hoist(Function &function, const Loop &loop);
+
+  std::unique_ptr<ModRef> mod_ref_;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_LICM_H
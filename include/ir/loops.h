@@ -0,0 +1,93 @@
+#ifndef IR_LOOPS_H
+#define IR_LOOPS_H
+
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ir.h"
+
+namespace pl0::ir {
+
+/**
+ * The dominator tree of the blocks the entry reaches, as in "A Simple, Fast
+ * Dominance Algorithm" by Cooper, Harvey and Kennedy.
+ */
+class Dominators {
+ public:
+  explicit Dominators(const Function &function);
+
+  // in reverse postorder
+  [[nodiscard]] const std::vector<BasicBlock *> &order() const {
+    return order_;
+  }
+  [[nodiscard]] bool IsReached(BasicBlock *block) const {
+    return index_.count(block) != 0;
+  }
+  // a block dominates itself
+  [[nodiscard]] bool Dominates(BasicBlock *a, BasicBlock *b) const;
+  // nullptr for the entry
+  [[nodiscard]] BasicBlock *ImmediateDominator(BasicBlock *block) const;
+
+ private:
+  [[nodiscard]] int Intersect(int a, int b) const;
+
+  std::vector<BasicBlock *> order_;
+  // of the blocks by their index in reverse postorder
+  std::unordered_map<BasicBlock *, int> index_;
+  std::vector<int> idom_;
+};
+
+/**
+ * A natural loop: its header, which dominates every block of the loop, and
+ * the blocks the header is reached again from without leaving the loop.
+ */
+struct Loop {
+  BasicBlock *header;
+  // the header included
+  std::unordered_set<BasicBlock *> blocks;
+
+  [[nodiscard]] bool Contains(BasicBlock *block) const {
+    return blocks.count(block) != 0;
+  }
+};
+
+// inner loops before those containing them
+[[nodiscard]] std::vector<Loop> FindLoops(const Dominators &dominators);
+[[nodiscard]] inline std::vector<Loop> FindLoops(const Function &function) {
+  return FindLoops(Dominators(function));
+}
+
+// the block every edge from outside the loop into the header comes through,
+// made when there is none; nullptr if the loop is not entered at all
+BasicBlock *Preheader(Function &function, const Loop &loop);
+
+/**
+ * A loop with no loop inside, entered along one edge and repeated along
+ * another, and left from its header alone once counter, a phi of the header
+ * stepped by a constant on every iteration, no longer compares as op with a
+ * bound defined before the loop: counting up while below the bound, down
+ * while above it, or by one until it.
+ */
+struct CountedLoop {
+  BasicBlock *latch;
+  // the successor of the header outside the loop
+  BasicBlock *exit;
+  // of the edges into the header, as the operands of its phis are
+  size_t entry;
+  size_t back;
+  Instruction *counter;
+  int step;
+  // Lt, Le, Gt, Ge or Ne
+  Opcode op;
+  Instruction *bound;
+};
+
+// nothing if the loop is not counted
+[[nodiscard]] std::optional<CountedLoop> AsCounted(
+    const Loop &loop, const Dominators &dominators);
+
+} // namespace pl0::ir
+
+#endif // IR_LOOPS_H
@@ -0,0 +1,91 @@
+#ifndef IR_LOWERING_H
+#define IR_LOWERING_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../bytecode/assembler.h"
+#include "ir.h"
+
+namespace pl0::ir {
+
+/**
+ * Generates stack bytecode from a module, laid out as Compiler lays out a
+ * program: the main program first, then the other functions in order.
+ *
+ * A value used once, later in its own block with nothing in between having
+ * an effect, is computed where it is used, on the operand stack. Every other
+ * value lives in a slot of the frame. Slots are allocated by coloring the
+ * interference of the live ranges, a phi taking the slot of an operand it
+ * does not interfere with so that the copy on that edge goes away; the slots
+ * of variables nested procedures cannot see are reused, the frame only grows
+ * once they run out. The copies for the phis of a block are made at the end
+ * of each predecessor, all operands pushed before any slot is written, so
+ * that phis swapping their values need no temporaries. Edges into a block
+ * with phis from a block with two successors are split first.
+ *
+ * A call followed by nothing but a return, to a procedure that cannot see
+ * the frame, becomes a TCL.
+ */
+class Lowering {
+ public:
+  void Generate(Module &module);
+  const bytecode &code() { return assembler_.code(); }
+
+ private:
+  void LowerFunction(Function &function);
+
+  void SplitCriticalEdges();
+  void FindDeferred();
+  void ComputeLiveness();
+  void AllocateSlots();
+  void JoinSplitEdges();
+  void Emit();
+
+  // the values whose slots are read when instruction is emitted, the
+  // operands of deferred operands included
+  void SlotOperands(Instruction *instruction, std::vector<Instruction *> &out);
+  [[nodiscard]] bool IsDeferred(Instruction *instruction) const {
+    return deferred_[instruction->id()];
+  }
+  // kept in a slot, computed where it is defined
+  [[nodiscard]] bool IsMaterialized(Instruction *instruction) const;
+  // emitted where it is, rather than where it is used or not at all
+  [[nodiscard]] bool IsEmitted(Instruction *instruction) const;
+  [[nodiscard]] bool IsTailCall(Instruction *call, size_t position) const;
+  void Interfere(Instruction *a, Instruction *b);
+  [[nodiscard]] int Find(int value);
+  [[nodiscard]] int SlotOf(Instruction *value) {
+    return slot_[Find(value->id())];
+  }
+
+  void Push(Instruction *value);
+  void Compute(Instruction *instruction);
+  void EmitCopies(BasicBlock *from, BasicBlock *to);
+  void EmitJump(BasicBlock *target, bool conditional);
+
+  assembler assembler_;
+  std::unordered_map<Procedure *, int> entry_points_;
+  std::unordered_map<Procedure *, std::vector<Backpatcher>> patch_list_;
+
+  // of the function being lowered, indexed by instruction id
+  Function *function_{nullptr};
+  std::vector<BasicBlock *> split_;
+  std::vector<bool> deferred_;
+  std::vector<std::vector<Instruction *>> users_;
+  std::unordered_map<BasicBlock *, std::vector<bool>> live_out_;
+  std::unordered_map<BasicBlock *, std::vector<bool>> live_in_;
+  std::vector<std::unordered_set<int>> interference_;
+  // union-find of values sharing a slot
+  std::vector<int> parent_;
+  std::vector<int> slot_;
+  int frame_size_{0};
+  std::unordered_map<BasicBlock *, int> addresses_;
+  std::unordered_map<BasicBlock *, std::vector<Backpatcher>> pending_;
+  BasicBlock *next_block_{nullptr};
+};
+
+} // namespace pl0::ir
+
+#endif // IR_LOWERING_H
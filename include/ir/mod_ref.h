@@ -0,0 +1,40 @@
+#ifndef IR_MOD_REF_H
+#define IR_MOD_REF_H
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ir.h"
+
+namespace pl0::ir {
+
+/**
+ * What calling a procedure of the module may do to the variables kept in
+ * frames: it stores to every variable it or a procedure it calls stores to,
+ * and loads every one they load. A procedure the module has no function for
+ * may do anything.
+ */
+class ModRef {
+ public:
+  explicit ModRef(const Module &module);
+
+  [[nodiscard]] bool Modifies(Procedure *procedure, Variable *variable) const;
+  [[nodiscard]] bool References(Procedure *procedure, Variable *variable) const;
+  // whether instruction, a store or a call, may change variable
+  [[nodiscard]] bool Clobbers(const Instruction *instruction,
+                              Variable *variable) const;
+
+ private:
+  struct Summary {
+    std::unordered_set<Variable *> modified;
+    std::unordered_set<Variable *> referenced;
+    std::unordered_set<Procedure *> callees;
+    bool unknown{false};
+  };
+
+  std::unordered_map<Procedure *, Summary> summaries_;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_MOD_REF_H
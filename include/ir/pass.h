@@ -0,0 +1,38 @@
+#ifndef IR_PASS_H
+#define IR_PASS_H
+
+#include <memory>
+#include <vector>
+
+#include "ir.h"
+
+namespace pl0::ir {
+
+/**
+ * A transformation of the functions of a module, one at a time. A pass that
+ * needs to know about the whole module, e.g. what the procedures a call
+ * reaches do, looks at it in Initialize before the first function.
+ */
+class Pass {
+ public:
+  virtual ~Pass() = default;
+
+  virtual void Initialize(Module & /*module*/) {}
+  // whether the function changed
+  virtual bool Run(Function &function) = 0;
+};
+
+class PassManager {
+ public:
+  void Add(std::unique_ptr<Pass> pass) { passes_.push_back(std::move(pass)); }
+
+  // every pass over every function, in the order they were added
+  void Run(Module &module);
+
+ private:
+  std::vector<std::unique_ptr<Pass>> passes_;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_PASS_H
@@ -0,0 +1,30 @@
+#ifndef IR_SIMPLIFY_H
+#define IR_SIMPLIFY_H
+
+#include "pass.h"
+
+namespace pl0::ir {
+
+/**
+ * Cleans up the control flow graph: branches on constants become jumps,
+ * blocks no path from the entry reaches are removed, a block jumping to one
+ * only it jumps to is merged with it, jumps to a block doing nothing but jump
+ * go to where it jumps, and phis left with a single value are replaced by it.
+ */
+class SimplifyCfg : public Pass {
+ public:
+  bool Run(Function &function) override;
+};
+
+/**
+ * Removes instructions whose value is not used and which have no effect, a
+ * division that may trap being an effect.
+ */
+class DeadCodeElimination : public Pass {
+ public:
+  bool Run(Function &function) override;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_SIMPLIFY_H
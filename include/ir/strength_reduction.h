@@ -0,0 +1,29 @@
+#ifndef IR_STRENGTH_REDUCTION_H
+#define IR_STRENGTH_REDUCTION_H
+
+#include "pass.h"
+
+namespace pl0::ir {
+
+/**
+ * Replaces operations by cheaper ones computing the same, traps included.
+ *
+ * For want of a remainder operator, a / b * b = a is how PL/0 asks whether b
+ * divides a; it becomes a single Divisible. In a loop, the product of an
+ * induction variable, a phi of the header stepped by an invariant amount on
+ * every iteration, and an invariant becomes an induction variable of its
+ * own, stepped by the product of the two invariants. Wrapping around, both
+ * agree modulo 2^32, so they agree on every value.
+ *
+ * Division and multiplication by a constant are left to the JIT, which turns
+ * them into shifts and multiplications by magic numbers: interpreted, any
+ * sequence replacing one DIV would take longer than it.
+ */
+class StrengthReduction : public Pass {
+ public:
+  bool Run(Function &function) override;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_STRENGTH_REDUCTION_H
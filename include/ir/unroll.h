@@ -0,0 +1,46 @@
+#ifndef IR_UNROLL_H
+#define IR_UNROLL_H
+
+#include <unordered_set>
+
+#include "loops.h"
+#include "pass.h"
+
+namespace pl0::ir {
+
+/**
+ * Unrolls counted loops counting up or down to their bound: while there are
+ * at least factor iterations left, copies of the loop run that many for one
+ * test of the counter, the copies jumping into each other where the loop
+ * jumped back to its header, which SimplifyCfg then merges. The loop itself
+ * is kept after them for the iterations left over, and for when moving the
+ * bound by the iterations tested at once would wrap it around.
+ *
+ * A loop making a call is left alone, the test saved is nothing next to
+ * it. No loop grows by more than budget instructions, the factor shrinks to
+ * fit, down to leaving the loop as it is.
+ */
+class LoopUnrolling : public Pass {
+ public:
+  static constexpr int kDefaultFactor = 4;
+  static constexpr int kDefaultBudget = 64;
+
+  // a factor of 1 leaves every loop as it is
+  LoopUnrolling(int factor, int budget) : factor_(factor), budget_(budget) {}
+
+  bool Run(Function &function) override;
+
+ private:
+  bool Unroll(Function &function, const Dominators &dominators,
+              const Loop &loop);
+
+  int factor_;
+  int budget_;
+  // headers of the loops kept for the iterations left over, and of their
+  // copies
+  std::unordered_set<BasicBlock *> done_;
+};
+
+} // namespace pl0::ir
+
+#endif // IR_UNROLL_H
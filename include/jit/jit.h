@@ -0,0 +1,81 @@
+#ifndef JIT_JIT_H
+#define JIT_JIT_H
+
+#include <memory>
+
+#include "../bytecode/bytecode.h"
+#include "../vm.h"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define PL0_JIT_SUPPORTED 1
+#else
+#define PL0_JIT_SUPPORTED 0
+#endif
+
+namespace pl0::jit {
+
+struct Analysis;
+class ExecutableMemory;
+class MachineStack;
+
+constexpr bool kJitAvailable = PL0_JIT_SUPPORTED;
+
+/**
+ * A baseline template JIT translating procedures into x86-64 code, one
+ * bytecode instruction at a time. Frames live on the same contiguous Stack the
+ * interpreter uses, with non-local variables reached through the display at a
+ * slot known at compile time. The operand stack is kept in registers and
+ * constants are folded as long as a statement is being evaluated. READ and
+ * WRITE call back into the runtime.
+ *
+ * A procedure is compiled together with everything it may call, so native
+ * code never returns to the interpreter before its own procedure does. Loop
+ * headers get entry points of their own for on-stack replacement.
+ *
+ * Native code runs on a machine stack of its own sized after the VM stack, so
+ * deep recursion reports a stack overflow just like the interpreter does.
+ */
+class NativeCode : public NativeTier {
+  const bytecode &code_;
+  std::unique_ptr<Analysis> analysis_;
+  // the trampoline followed by the code of every Compile
+  std::vector<std::unique_ptr<ExecutableMemory>> chunks_;
+  // native entry point of every compiled procedure and loop header
+  std::vector<const uint8_t *> compiled_;
+  std::unique_ptr<MachineStack> machine_stack_;
+  int machine_stack_capacity_{0};
+  size_t code_size_{0};
+
+ public:
+  /**
+   * Nothing is compiled up front, superinstructions are compiled as the
+   * sequences they stand for.
+   * @throw GeneralError if there is no native backend for this platform
+   */
+  explicit NativeCode(const bytecode &code);
+  ~NativeCode() override;
+
+  /**
+   * @throw GeneralError if the code cannot be compiled, the caller is expected
+   * to keep interpreting it
+   */
+  const void *Compile(int pos) override;
+
+  void Enter(
+      Stack &stack, Display &display, Io &io, int bp, const void *code)
+      override;
+
+  /**
+   * Compile the whole program and run it to completion
+   * @throw GeneralError if it cannot be compiled
+   * @throw RuntimeError on stack overflow or a division CheckDivision rejects
+   */
+  void Run(int stack_size = Stack::kDefaultCapacity, Io &io = StandardIo());
+
+  // bytes of machine code generated so far
+  [[nodiscard]] size_t code_size() const { return code_size_; }
+};
+
+} // namespace pl0::jit
+
+#endif
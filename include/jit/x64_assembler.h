@@ -0,0 +1,151 @@
+#ifndef JIT_X64_ASSEMBLER_H
+#define JIT_X64_ASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pl0::jit {
+
+enum Reg : uint8_t {
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+  kNoReg = 0xff
+};
+
+// condition codes as encoded in Jcc and SETcc
+enum Condition : uint8_t {
+  kEqual = 0x4,
+  kNotEqual = 0x5,
+  kBelowEqual = 0x6,
+  kAbove = 0x7,
+  kLess = 0xc,
+  kGreaterEqual = 0xd,
+  kLessEqual = 0xe,
+  kGreater = 0xf
+};
+
+inline Condition Negate(Condition cc) {
+  return Condition(cc ^ 1);
+}
+
+// [base + index * scale + disp]
+struct Mem {
+  Reg base;
+  int32_t disp = 0;
+  Reg index = kNoReg;
+  uint8_t scale = 1;
+};
+
+/**
+ * A minimal x86-64 encoder covering what the template JIT emits. Unless the
+ * name says otherwise, operations work on 32-bit registers, which is the
+ * width of PL/0 integers.
+ */
+class X64Assembler {
+  std::vector<uint8_t> buffer_;
+
+  void Byte(uint8_t byte) { buffer_.push_back(byte); }
+  void Int32(int32_t value);
+  void Int64(int64_t value);
+  void Rex(bool wide, uint8_t reg, uint8_t index, uint8_t base, bool byte_reg);
+  void ModRM(uint8_t reg, Reg rm);
+  void ModRM(uint8_t reg, const Mem &mem);
+  void RegReg(uint8_t opcode, uint8_t reg, Reg rm, bool wide = false);
+  void RegMem(uint8_t opcode, uint8_t reg, const Mem &mem, bool wide = false);
+  void Group1(uint8_t ext, Reg dst, int32_t imm, bool wide);
+
+ public:
+  [[nodiscard]] int size() const { return static_cast<int>(buffer_.size()); }
+  [[nodiscard]] const std::vector<uint8_t> &buffer() const { return buffer_; }
+
+  void Mov(Reg dst, Reg src);
+  void Mov(Reg dst, int32_t imm);
+  void Mov(Reg dst, const Mem &src);
+  void Mov(const Mem &dst, Reg src);
+  void Mov(const Mem &dst, int32_t imm);
+  void Mov64(Reg dst, Reg src);
+  void Mov64(Reg dst, int64_t imm);
+  void Mov64(Reg dst, const Mem &src);
+  void Mov64(const Mem &dst, Reg src);
+  void Movsxd(Reg dst, Reg src);
+  void Movsxd(Reg dst, const Mem &src);
+  void Lea64(Reg dst, const Mem &src);
+
+  void Add(Reg dst, Reg src);
+  void Add(Reg dst, int32_t imm);
+  void Sub(Reg dst, Reg src);
+  void Sub(Reg dst, int32_t imm);
+  void And(Reg dst, int32_t imm);
+  void Xor(Reg dst, Reg src);
+  void Cmp(Reg lhs, Reg rhs);
+  void Cmp(Reg lhs, int32_t imm);
+  void Test(Reg lhs, Reg rhs);
+  void Imul(Reg dst, Reg src);
+  void Imul(Reg dst, Reg src, int32_t imm);
+  void Idiv(Reg divisor);
+  void Cdq();
+  void Neg(Reg dst);
+  void Shl(Reg dst, uint8_t count);
+  void Shr(Reg dst, uint8_t count);
+  void Sar(Reg dst, uint8_t count);
+  void Setcc(Condition cc, Reg dst);
+  void Movzxb(Reg dst, Reg src);
+
+  void Add64(Reg dst, int32_t imm);
+  void Sub64(Reg dst, Reg src);
+  void Sub64(Reg dst, int32_t imm);
+  void Cmp64(Reg lhs, Reg rhs);
+  void Imul64(Reg dst, Reg src, int32_t imm);
+  void Shr64(Reg dst, uint8_t count);
+  void Sar64(Reg dst, uint8_t count);
+
+  void Push(Reg reg);
+  void Pop(Reg reg);
+  void Call(Reg target);
+  void Jmp(Reg target);
+  void Ret();
+  void RepStosd();
+
+  // Branches return the position of their rel32 field for Patch.
+  int Jmp();
+  int Jcc(Condition cc);
+  int Call();
+  void Patch(int fixup, int target);
+};
+
+/**
+ * Memory mapped writable and then sealed as executable.
+ */
+class ExecutableMemory {
+  void *memory_{nullptr};
+  size_t size_{0};
+
+ public:
+  explicit ExecutableMemory(const std::vector<uint8_t> &code);
+  ~ExecutableMemory();
+  ExecutableMemory(const ExecutableMemory &) = delete;
+  ExecutableMemory &operator=(const ExecutableMemory &) = delete;
+
+  [[nodiscard]] const uint8_t *data() const {
+    return static_cast<const uint8_t *>(memory_);
+  }
+};
+
+} // namespace pl0::jit
+
+#endif
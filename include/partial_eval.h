@@ -0,0 +1,29 @@
+#ifndef PARTIAL_EVAL_H
+#define PARTIAL_EVAL_H
+
+#include <cstdint>
+
+#include "vm.h"
+
+namespace pl0 {
+
+/**
+ * Run the part of a program that does not depend on its input at compile
+ * time. The code is interpreted from the start by a plain evaluator that
+ * records what is written instead of writing it, and stops at the first READ,
+ * at the end of the program or once fuel instructions have been executed. An
+ * instruction that would fail at run time, a division by zero or a call that
+ * overflows a stack of stack_size slots, stops it as well and is left for the
+ * run to fail on.
+ *
+ * The result resumes on a VirtualMachine exactly like a snapshot: the output
+ * is written at once and the program goes on from the state it was folded to.
+ * A program that reads nothing and finishes within the fuel is reduced to its
+ * output. Superinstructions are evaluated as the sequence they replaced, so
+ * the code may be fused or not.
+ */
+Snapshot EvaluatePrefix(const bytecode &code, int64_t fuel, int stack_size);
+
+} // namespace pl0
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef REGISTER_VM_H
+#define REGISTER_VM_H
+
+#include "bytecode/register.h"
+#include "vm.h"
+
+namespace pl0::reg {
+
+/**
+ * Run register bytecode to completion. Frames live on the same contiguous
+ * Stack as those of the stack machine, the registers of a frame directly
+ * follow its header. READ and WRITE go through io.
+ */
+void Execute(
+    const bytecode &code,
+    int stack_size = Stack::kDefaultCapacity,
+    Dispatch dispatch = Dispatch::kThreaded,
+    Io &io = StandardIo());
+
+} // namespace pl0::reg
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+
+#include "vm.h"
+
+namespace pl0 {
+
+/**
+ * A Snapshot on disk: the header "PL0S", version and opcode count, then the
+ * code, the registers, the display, the stack and the output, each vector
+ * preceded by its length. Every field is a 32-bit integer in host byte order,
+ * like in images.
+ * @throw GeneralError if the file cannot be written
+ */
+void WriteSnapshot(const Snapshot &snapshot, const std::string &path);
+
+/**
+ * Read a snapshot and check its code as VerifyBytecode does, its frames are
+ * left to VirtualMachine::Restore.
+ * @throw GeneralError if the file cannot be read or is not a snapshot
+ */
+Snapshot LoadSnapshot(const std::string &path);
+
+} // namespace pl0
+
+#endif
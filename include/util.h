@@ -1,6 +1,7 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <cstdint>
 #include <sstream>
 
 namespace pl0 {
@@ -12,6 +13,12 @@ inline std::string Concat(Args... args) {
   return oss.str();
 }
 
+// The low 32 bits of a wider result, which is what int arithmetic wraps to on
+// every machine the interpreter runs on.
+inline int Wrap(int64_t value) {
+  return static_cast<int>(static_cast<uint32_t>(value));
+}
+
 struct Location {
   int line = 1;
   int column = 1;
@@ -37,6 +44,12 @@ class GeneralError : public BasicError {
   explicit GeneralError(Args... args) : BasicError(Concat(args...)) {}
 };
 
+class RuntimeError : public BasicError {
+ public:
+  template<typename... Args>
+  explicit RuntimeError(Args... args) : BasicError(Concat(args...)) {}
+};
+
 class SyntaxError : public BasicError {
  public:
   template<typename... Args>
@@ -1,71 +1,320 @@
 #ifndef VM_H
 #define VM_H
 
-#include <functional>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 #include "bytecode/bytecode.h"
+#include "io.h"
+#include "util.h"
 
-namespace pl0 {
+// Labels-as-values are a GNU extension, also provided by Clang.
+#if defined(__GNUC__)
+#define PL0_THREADED_DISPATCH 1
+#else
+#define PL0_THREADED_DISPATCH 0
+#endif
 
-class StackFrame {
-  int return_address_;
-  StackFrame *static_link_;
-  StackFrame *dynamic_link_;
-  std::vector<int> intermediates_;
-  std::vector<std::pair<std::string, int>> locals_;
+namespace pl0 {
 
+/**
+ * One contiguous value stack holding every activation record. A frame is just
+ * a base offset into it: the header (dynamic link, return address and what is
+ * needed to restore the Display) is followed by the locals, and the operand
+ * stack of the running procedure grows right above them. Links are stored as
+ * offsets, so calling and returning never allocate.
+ */
+class Stack {
  public:
-  StackFrame(int ret_address, StackFrame *dyn_link, StackFrame *static_link)
-      : return_address_(ret_address)
-      , dynamic_link_(dyn_link)
-      , static_link_(static_link) {}
+  enum Header : int {
+    kDynamicLink,
+    kReturnAddress,
+    kSavedDisplay, // display entry replaced by this frame
+    kCallerLevel,
+    kHeaderSize
+  };
+
+  static constexpr int kDefaultCapacity = 1 << 22;
+
+  // Slots are left uninitialized so that untouched pages are never committed.
+  explicit Stack(int capacity = kDefaultCapacity)
+      : slots_(new int[capacity]), capacity_(capacity) {}
+
+  int &operator[](int pos) { return slots_[pos]; }
+  int *data() { return slots_.get(); }
+  [[nodiscard]] const int *data() const { return slots_.get(); }
+
+  [[nodiscard]] int capacity() const { return capacity_; }
 
   /**
-   * Destroy and immediately return to enclosing stack frame
-   * @param return_address
-   * @param frame_pointer
+   * Make sure count more slots fit above sp
+   * @throw RuntimeError on stack overflow
    */
-  void Leave(int &return_address, StackFrame *&frame_pointer) {
-    return_address = return_address_;
-    frame_pointer = dynamic_link_;
-    delete this;
+  void Reserve(int sp, int count) const {
+    if (count > capacity_ - sp) { throw RuntimeError("stack overflow"); }
+  }
+
+ private:
+  std::unique_ptr<int[]> slots_;
+  int capacity_;
+};
+
+/**
+ * The display holds the frame base of the innermost active procedure of every
+ * lexical level, so a variable any number of levels out is reached with a
+ * single lookup instead of a walk along static links. A call at level distance
+ * d enters level level() - d + 1; the entry it replaces is saved in the new
+ * frame and put back on return. A tail call leaves the level of the calling
+ * procedure and enters the one of the callee in the same frame.
+ */
+class Display {
+ public:
+  // levels bounds the lexical level of any procedure, see DisplaySize
+  explicit Display(int levels)
+      : frames_(new int[levels]()), levels_(levels) {}
+
+  [[nodiscard]] int level() const { return level_; }
+  [[nodiscard]] int levels() const { return levels_; }
+  int *frames() { return frames_.get(); }
+  [[nodiscard]] const int *frames() const { return frames_.get(); }
+
+  [[nodiscard]] int Resolve(int level_dist) const {
+    return frames_[level_ - level_dist];
+  }
+
+  void Enter(Stack &stack, int bp, int level_dist) {
+    const int level = level_ - level_dist + 1;
+    stack[bp + Stack::kSavedDisplay] = frames_[level];
+    stack[bp + Stack::kCallerLevel] = level_;
+    frames_[level] = bp;
+    level_ = level;
   }
 
-  StackFrame *Resolve(int level_dist) {
-    StackFrame *target_frame = this;
-    while (level_dist > 0) {
-      target_frame = target_frame->static_link_;
-      level_dist--;
-    }
-    return target_frame;
+  void Leave(Stack &stack, int bp) {
+    frames_[level_] = stack[bp + Stack::kSavedDisplay];
+    level_ = stack[bp + Stack::kCallerLevel];
   }
 
-  void Allocate(int count) {
-    for (int i = 0; i < count; i++)
-      locals_.emplace_back(std::pair{std::string{}, 0});
+  void Replace(Stack &stack, int bp, int level_dist) {
+    const int level = level_ - level_dist + 1;
+    Leave(stack, bp);
+    Enter(stack, bp, level_ - level + 1);
   }
 
-  int &Local(int level_dist, int index) {
-    return Resolve(level_dist)->locals_[index].second;
+  // back to the caller of the frame at bp, whose entry is already put back
+  void Return(Stack &stack, int bp) {
+    level_ = stack[bp + Stack::kCallerLevel];
   }
 
-  void Push(int value) { intermediates_.push_back(value); }
+  // back to the main program, as before the first call
+  void Reset() {
+    std::fill_n(frames_.get(), levels_, 0);
+    level_ = 0;
+  }
 
-  int Pop() {
-    int result = intermediates_.back();
-    intermediates_.pop_back();
-    return result;
+  // take over the entries of a saved display of the same size
+  void Restore(int level, const int *frames) {
+    std::copy_n(frames, levels_, frames_.get());
+    level_ = level;
   }
+
+ private:
+  std::unique_ptr<int[]> frames_;
+  int levels_;
+  int level_{0};
 };
 
-const std::unordered_map<opt, std::function<int(int, int)>> opt2functor = {
-    {opt::ADD, std::plus<>()},    {opt::SUB, std::minus<>()},
-    {opt::DIV, std::divides<>()}, {opt::MUL, std::multiplies<>()},
-    {opt::LE, std::less<>()},     {opt::LEQ, std::less_equal<>()},
-    {opt::GE, std::greater<>()},  {opt::GEQ, std::greater_equal<>()},
-    {opt::EQ, std::equal_to<>()}, {opt::NEQ, std::not_equal_to<>()}};
+/**
+ * Number of display entries a program needs. Every active level belongs to
+ * at least one called procedure, so the number of call targets plus the main
+ * program is an upper bound.
+ */
+template<typename Code, typename Target>
+int DisplaySize(const Code &code, Target target) {
+  std::vector<int> targets;
+  for (const auto &ins : code) {
+    int pos = target(ins);
+    if (pos >= 0) { targets.push_back(pos); }
+  }
+  std::sort(targets.begin(), targets.end());
+  return static_cast<int>(
+             std::unique(targets.begin(), targets.end()) - targets.begin())
+         + 1;
+}
+
+/**
+ * Upper bound of the operand stack height of any procedure. The compiler only
+ * leaves values on the operand stack within a statement, so a linear scan is
+ * enough; it lets frames reserve their operand space once on entry instead of
+ * checking every push.
+ */
+int MaxOperandDepth(const bytecode &code);
+
+/**
+ * The divisions the machine would trap on, a zero divisor and INT_MIN / -1,
+ * are reported like any other runtime error, so that the output written
+ * before them is flushed.
+ * @throw RuntimeError for such a division
+ */
+inline void CheckDivision(int dividend, int divisor) {
+  if (divisor == 0) { throw RuntimeError("division by zero"); }
+  if (divisor == -1 && dividend == INT_MIN) {
+    throw RuntimeError("division overflow");
+  }
+}
+
+enum class Dispatch {
+  kSwitch,   // one switch over the opcode per instruction
+  kThreaded, // direct-threaded code using computed goto
+};
+
+constexpr bool kThreadedDispatchAvailable = PL0_THREADED_DISPATCH;
+
+/**
+ * A faster implementation of the same bytecode the interpreter hands hot code
+ * to, such as jit::NativeCode.
+ */
+class NativeTier {
+ public:
+  virtual ~NativeTier() = default;
+
+  /**
+   * Code to run from pos on, pos is either a procedure entry or the target of
+   * a backward jump
+   * @throw GeneralError if it cannot be compiled
+   */
+  virtual const void *Compile(int pos) = 0;
+
+  /**
+   * Run code on the frame at bp until its procedure returns. The header of
+   * the frame is set up and the display entered; the display entries are put
+   * back but the level and the frame itself are left for the caller to pop,
+   * the procedure may have tail called one of another level.
+   * @throw RuntimeError on stack overflow or a division CheckDivision rejects
+   */
+  virtual void Enter(
+      Stack &stack, Display &display, Io &io, int bp, const void *code)
+      = 0;
+};
+
+struct Tiering {
+  NativeTier *tier = nullptr;
+  // calls of a procedure, or iterations of a loop, before it is promoted
+  int threshold = 1000;
+  // report every promotion on std::cerr
+  bool verbose = false;
+};
+
+/**
+ * Everything needed to resume a VirtualMachine, taken while it waits on its
+ * first READ so that no input has been consumed yet.
+ */
+struct Snapshot {
+  bytecode code;
+  int program_counter = 0;
+  int bp = 0;
+  int sp = 0;
+  int display_level = 0;
+  std::vector<int> display;
+  // the slots below sp: frames and the operand stack on top of them
+  std::vector<int> stack;
+  // values written before the snapshot, written again on restore
+  std::vector<int> output;
+};
+
+/**
+ * A program being run on the stack machine. Everything a run changes lives in
+ * the instance, so machines on separate threads may share the bytecode, which
+ * is only ever read; their Io channels and native tiers must not be shared.
+ */
+class VirtualMachine {
+ public:
+  // counted by the interpreter, not by code running in a native tier
+  struct Statistics {
+    int64_t calls = 0;
+    int64_t promotions = 0;
+    // highest top of the stack on entry to a procedure, in slots
+    int peak_stack = 0;
+  };
+
+  VirtualMachine(
+      const bytecode &code, Io &io, int stack_size = Stack::kDefaultCapacity);
+
+  /**
+   * Run the program from the start to completion. The threaded engine
+   * silently falls back to the switch engine where computed goto is
+   * unavailable. With a tier, procedures and loops that get hot continue in
+   * it.
+   * @throw RuntimeError on stack overflow or a division CheckDivision rejects
+   */
+  void Run(
+      Dispatch dispatch = Dispatch::kThreaded, const Tiering &tiering = {});
+
+  /**
+   * Run the program from the start until it is about to execute its first
+   * READ. Code handed to a tier would read on its own, so there is none.
+   * @return false if the program ended without reading
+   * @throw RuntimeError on stack overflow or a division CheckDivision rejects
+   */
+  bool RunToFirstRead(Dispatch dispatch = Dispatch::kThreaded);
+
+  /**
+   * Continue a program stopped by RunToFirstRead or restored from a snapshot
+   * @throw RuntimeError on stack overflow or a division CheckDivision rejects
+   */
+  void Continue(
+      Dispatch dispatch = Dispatch::kThreaded, const Tiering &tiering = {});
+
+  // the state of the machine, without the output
+  [[nodiscard]] Snapshot Save() const;
+
+  /**
+   * Take over the state of a snapshot of the code this machine runs. The
+   * frames are checked against the code and the restored stack: every link
+   * and display entry leads to a frame on it, and every frame has the locals
+   * and the level of the procedure running in it.
+   * @throw RuntimeError if it does not fit this machine
+   */
+  void Restore(const Snapshot &snapshot);
+
+  [[nodiscard]] int program_counter() const { return program_counter_; }
+  [[nodiscard]] const Statistics &statistics() const { return statistics_; }
+
+ private:
+  void Start();
+  // @throw RuntimeError unless the frames of snapshot fit its stack
+  void CheckFrames(const Snapshot &snapshot) const;
+
+  // true if stopped before a READ
+  template<bool kThreaded>
+  bool Interpret(const Tiering &tiering, bool stop_at_read);
+  bool Interpret(Dispatch dispatch, const Tiering &tiering, bool stop_at_read);
+
+  const bytecode &code_;
+  Io &io_;
+  Stack stack_;
+  Display display_;
+  // operand space and header reserved on top of every frame
+  int reserve_;
+  int program_counter_{0};
+  int bp_{0};
+  int sp_{0};
+  Statistics statistics_;
+};
 
-void Execute(const bytecode &code);
+/**
+ * Run a program to completion on a VirtualMachine of its own. READ and WRITE
+ * go through io.
+ */
+void Execute(
+    const bytecode &code,
+    int stack_size = Stack::kDefaultCapacity,
+    Dispatch dispatch = Dispatch::kThreaded,
+    const Tiering &tiering = {},
+    Io &io = StandardIo());
 
 } // namespace pl0
 
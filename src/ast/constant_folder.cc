@@ -0,0 +1,253 @@
+#include "ast/constant_folder.h"
+
+#include <climits>
+
+namespace pl0::ast {
+
+namespace {
+
+Literal *AsLiteral(Expression *node) {
+  return node->type() == AstNodeType::kLiteral ? dynamic_cast<Literal *>(node)
+                                               : nullptr;
+}
+
+// what a statement folded away becomes
+StatementList *Nothing() {
+  return new StatementList({});
+}
+
+bool IsNothing(Statement *node) {
+  return node->type() == AstNodeType::kStatementList
+         && dynamic_cast<StatementList *>(node)->statements().empty();
+}
+
+int Evaluate(Token op, int lhs, int rhs) {
+  const int64_t l = lhs, r = rhs;
+  switch (op) {
+    case Token::ADD:
+      return Wrap(l + r);
+    case Token::SUB:
+      return Wrap(l - r);
+    case Token::MUL:
+      return Wrap(l * r);
+    case Token::DIV:
+      return lhs / rhs;
+    case Token::EQ:
+      return lhs == rhs;
+    case Token::NEQ:
+      return lhs != rhs;
+    case Token::LE:
+      return lhs < rhs;
+    case Token::LEQ:
+      return lhs <= rhs;
+    case Token::GE:
+      return lhs > rhs;
+    case Token::GEQ:
+      return lhs >= rhs;
+    default:
+      throw GeneralError("token ", *op, " cannot be used as operator");
+  }
+}
+
+} // namespace
+
+Expression *ConstantFolder::Fold(Expression *node) {
+  expression_ = node;
+  Visit(node);
+  return expression_;
+}
+
+Statement *ConstantFolder::Fold(Statement *node) {
+  statement_ = node;
+  Visit(node);
+  return statement_;
+}
+
+void ConstantFolder::VisitVariableDeclaration(VariableDeclaration * /*node*/) {
+}
+
+void ConstantFolder::VisitConstantDeclaration(ConstantDeclaration * /*node*/) {
+}
+
+void ConstantFolder::VisitProcedureDeclaration(ProcedureDeclaration *node) {
+  VisitBlock(node->main_block());
+}
+
+void ConstantFolder::VisitBlock(Block *node) {
+  node->set_body(Fold(node->body()));
+  for (auto *procedure : node->sub_procedures()) {
+    VisitProcedureDeclaration(procedure);
+  }
+}
+
+void ConstantFolder::VisitStatementList(StatementList *node) {
+  StatementList::ListType statements;
+  for (auto *statement : node->statements()) {
+    auto *folded = Fold(statement);
+    if (IsNothing(folded)) {
+      delete folded;
+    } else {
+      statements.push_back(folded);
+    }
+  }
+  node->set_statements(std::move(statements));
+  statement_ = node;
+}
+
+void ConstantFolder::VisitIfStatement(IfStatement *node) {
+  node->set_condition(Fold(node->condition()));
+  node->set_then_statement(Fold(node->then_statement()));
+  if (node->has_else_statement()) {
+    node->set_else_statement(Fold(node->else_statement()));
+  }
+  statement_ = node;
+
+  auto *condition = AsLiteral(node->condition());
+  if (condition == nullptr) { return; }
+  Statement *taken = nullptr;
+  if (condition->value() != 0) {
+    taken = node->then_statement();
+    node->set_then_statement(nullptr);
+  } else {
+    taken = node->else_statement();
+    node->set_else_statement(nullptr);
+  }
+  delete node;
+  statement_ = taken != nullptr ? taken : Nothing();
+}
+
+void ConstantFolder::VisitWhileStatement(WhileStatement *node) {
+  node->set_cond(Fold(node->cond()));
+  node->set_body(Fold(node->body()));
+  statement_ = node;
+
+  // a constantly true condition is left for the compiler to drop the test
+  auto *condition = AsLiteral(node->cond());
+  if (condition != nullptr && condition->value() == 0) {
+    delete node;
+    statement_ = Nothing();
+  }
+}
+
+void ConstantFolder::VisitCallStatement(CallStatement *node) {
+  statement_ = node;
+}
+
+void ConstantFolder::VisitReadStatement(ReadStatement *node) {
+  statement_ = node;
+}
+
+void ConstantFolder::VisitWriteStatement(WriteStatement *node) {
+  WriteStatement::ListType expressions;
+  for (auto *expr : node->expressions()) { expressions.push_back(Fold(expr)); }
+  node->set_expressions(std::move(expressions));
+  statement_ = node;
+}
+
+void ConstantFolder::VisitAssignStatement(AssignStatement *node) {
+  node->set_expr(Fold(node->expr()));
+  statement_ = node;
+}
+
+void ConstantFolder::VisitReturnStatement(ReturnStatement *node) {
+  statement_ = node;
+}
+
+void ConstantFolder::VisitUnaryOperation(UnaryOperation *node) {
+  node->set_expr(Fold(node->expr()));
+  expression_ = node;
+  if (auto *operand = AsLiteral(node->expr())) {
+    expression_ = new Literal(operand->value() % 2);
+    delete node;
+  }
+}
+
+void ConstantFolder::VisitBinaryOperation(BinaryOperation *node) {
+  node->set_left(Fold(node->left()));
+  node->set_right(Fold(node->right()));
+  expression_ = Combine(node);
+}
+
+// node with folded operands, or what replaces it
+Expression *ConstantFolder::Combine(BinaryOperation *node) {
+  const auto op = node->op();
+  auto *left = AsLiteral(node->left());
+  auto *right = AsLiteral(node->right());
+  // node is deleted, except for the operand kept
+  auto keep_left = [node] {
+    auto *kept = node->left();
+    node->set_left(nullptr);
+    delete node;
+    return kept;
+  };
+  auto replace = [node](Expression *replacement) {
+    delete node;
+    return replacement;
+  };
+
+  if (op == Token::DIV && right != nullptr && right->value() == 0) {
+    throw GeneralError("division by zero");
+  }
+  if (left != nullptr && right != nullptr) {
+    if (op == Token::DIV && left->value() == INT_MIN && right->value() == -1) {
+      return node;
+    }
+    return replace(new Literal(Evaluate(op, left->value(), right->value())));
+  }
+
+  // constant operands of commutative operations go to the right
+  if (left != nullptr && (op == Token::ADD || op == Token::MUL)) {
+    node->set_left(node->right());
+    node->set_right(left);
+    std::swap(left, right);
+  }
+  if (right == nullptr) { return node; }
+
+  const int value = right->value();
+  if ((value == 0 && (op == Token::ADD || op == Token::SUB))
+      || (value == 1 && (op == Token::MUL || op == Token::DIV))) {
+    return keep_left();
+  }
+  // x * 0 still has to trap where x does
+  if (value == 0 && op == Token::MUL && !MayTrap(node->left())) {
+    return replace(new Literal(0));
+  }
+  if (op != Token::ADD && op != Token::SUB) { return node; }
+
+  // (x + c1) - c2 becomes x + (c1 - c2), which wraps the same way
+  int64_t offset = op == Token::ADD ? value : -int64_t{value};
+  auto *inner = dynamic_cast<BinaryOperation *>(node->left());
+  if (inner != nullptr
+      && (inner->op() == Token::ADD || inner->op() == Token::SUB)) {
+    if (auto *constant = AsLiteral(inner->right())) {
+      offset += inner->op() == Token::ADD ? constant->value()
+                                          : -int64_t{constant->value()};
+      auto *operand = inner->left();
+      inner->set_left(nullptr);
+      delete node;
+      return Combine(new BinaryOperation(
+          Token::ADD, operand, new Literal(Wrap(offset))));
+    }
+  }
+  // x + -c reads better as x - c
+  if (op == Token::ADD && value < 0 && value != INT_MIN) {
+    node->set_op(Token::SUB);
+    right->set_value(-value);
+  }
+  return node;
+}
+
+void ConstantFolder::VisitLiteral(Literal *node) {
+  expression_ = node;
+}
+
+void ConstantFolder::VisitVariableProxy(VariableProxy *node) {
+  expression_ = node;
+  if (node->target()->IsConstant()) {
+    auto *constant = dynamic_cast<Constant *>(node->target());
+    expression_ = new Literal(constant->value());
+    delete node;
+  }
+}
+
+} // namespace pl0::ast
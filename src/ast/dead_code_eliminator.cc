@@ -0,0 +1,221 @@
+#include "ast/dead_code_eliminator.h"
+
+namespace pl0::ast {
+
+namespace {
+
+// whether control can fall out of the end of node; the statements of a list
+// following one that cannot are dropped
+bool Truncate(Statement *node) {
+  switch (node->type()) {
+    case AstNodeType::kReturnStatement:
+      return false;
+    case AstNodeType::kStatementList: {
+      auto *list = dynamic_cast<StatementList *>(node);
+      auto statements = list->statements();
+      for (size_t i = 0; i < statements.size(); i++) {
+        if (Truncate(statements[i])) { continue; }
+        for (size_t j = i + 1; j < statements.size(); j++) {
+          delete statements[j];
+        }
+        statements.resize(i + 1);
+        list->set_statements(std::move(statements));
+        return false;
+      }
+      return true;
+    }
+    case AstNodeType::kIfStatement: {
+      auto *branch = dynamic_cast<IfStatement *>(node);
+      const bool then_completes = Truncate(branch->then_statement());
+      if (!branch->has_else_statement()) { return true; }
+      const bool else_completes = Truncate(branch->else_statement());
+      return then_completes || else_completes;
+    }
+    case AstNodeType::kWhileStatement: {
+      // nothing but a return leaves a loop whose condition folded to true
+      auto *loop = dynamic_cast<WhileStatement *>(node);
+      Truncate(loop->body());
+      auto *literal = dynamic_cast<Literal *>(loop->cond());
+      return literal == nullptr || literal->value() == 0;
+    }
+    default:
+      return true;
+  }
+}
+
+void Truncate(Block *node) {
+  Truncate(node->body());
+  for (auto *procedure : node->sub_procedures()) {
+    Truncate(procedure->main_block());
+  }
+}
+
+} // namespace
+
+void DeadCodeEliminator::Eliminate(Block *program) {
+  Truncate(program);
+  Collect(program);
+  std::vector<Procedure *> worklist{nullptr};
+  reachable_.insert(nullptr);
+  while (!worklist.empty()) {
+    auto *procedure = worklist.back();
+    worklist.pop_back();
+    for (auto *callee : calls_[procedure]) {
+      if (reachable_.insert(callee).second) { worklist.push_back(callee); }
+    }
+  }
+  RemoveUnreachable(program);
+  // only what is left counts as reading a variable
+  Collect(program);
+  RemoveDeadStores(program);
+}
+
+void DeadCodeEliminator::Collect(Block *program) {
+  calls_.clear();
+  read_.clear();
+  VisitBlock(program);
+}
+
+void DeadCodeEliminator::RemoveUnreachable(Block *node) {
+  std::vector<ProcedureDeclaration *> kept;
+  for (auto *procedure : node->sub_procedures()) {
+    if (reachable_.count(procedure->symbol()) == 0) {
+      delete procedure;
+      continue;
+    }
+    RemoveUnreachable(procedure->main_block());
+    kept.push_back(procedure);
+  }
+  node->set_sub_procedures(std::move(kept));
+}
+
+void DeadCodeEliminator::RemoveDeadStores(Block *node) {
+  node->set_body(RemoveDeadStores(node->body()));
+  for (auto *procedure : node->sub_procedures()) {
+    RemoveDeadStores(procedure->main_block());
+  }
+}
+
+Statement *DeadCodeEliminator::RemoveDeadStores(Statement *node) {
+  switch (node->type()) {
+    case AstNodeType::kAssignStatement: {
+      auto *assign = dynamic_cast<AssignStatement *>(node);
+      auto *target = assign->target()->target();
+      if (!target->IsVariable()
+          || read_.count(dynamic_cast<Variable *>(target)) != 0
+          || MayTrap(assign->expr())) {
+        return node;
+      }
+      delete node;
+      return new StatementList({});
+    }
+    case AstNodeType::kStatementList: {
+      auto *list = dynamic_cast<StatementList *>(node);
+      StatementList::ListType statements;
+      for (auto *statement : list->statements()) {
+        auto *kept = RemoveDeadStores(statement);
+        if (kept->type() == AstNodeType::kStatementList
+            && dynamic_cast<StatementList *>(kept)->statements().empty()) {
+          delete kept;
+        } else {
+          statements.push_back(kept);
+        }
+      }
+      list->set_statements(std::move(statements));
+      return list;
+    }
+    case AstNodeType::kIfStatement: {
+      auto *branch = dynamic_cast<IfStatement *>(node);
+      branch->set_then_statement(
+          RemoveDeadStores(branch->then_statement()));
+      if (branch->has_else_statement()) {
+        branch->set_else_statement(
+            RemoveDeadStores(branch->else_statement()));
+      }
+      return branch;
+    }
+    case AstNodeType::kWhileStatement: {
+      auto *loop = dynamic_cast<WhileStatement *>(node);
+      loop->set_body(RemoveDeadStores(loop->body()));
+      return loop;
+    }
+    default:
+      return node;
+  }
+}
+
+void DeadCodeEliminator::VisitVariableDeclaration(
+    VariableDeclaration * /*node*/) {}
+
+void DeadCodeEliminator::VisitConstantDeclaration(
+    ConstantDeclaration * /*node*/) {}
+
+void DeadCodeEliminator::VisitProcedureDeclaration(ProcedureDeclaration *node) {
+  auto *enclosing = current_;
+  current_ = node->symbol();
+  VisitBlock(node->main_block());
+  current_ = enclosing;
+}
+
+void DeadCodeEliminator::VisitBlock(Block *node) {
+  auto *enclosing = scope_;
+  scope_ = node->belonging_scope();
+  Visit(node->body());
+  for (auto *procedure : node->sub_procedures()) {
+    VisitProcedureDeclaration(procedure);
+  }
+  scope_ = enclosing;
+}
+
+void DeadCodeEliminator::VisitStatementList(StatementList *node) {
+  for (auto *statement : node->statements()) { Visit(statement); }
+}
+
+void DeadCodeEliminator::VisitIfStatement(IfStatement *node) {
+  Visit(node->condition());
+  Visit(node->then_statement());
+  if (node->has_else_statement()) { Visit(node->else_statement()); }
+}
+
+void DeadCodeEliminator::VisitWhileStatement(WhileStatement *node) {
+  Visit(node->cond());
+  Visit(node->body());
+}
+
+void DeadCodeEliminator::VisitCallStatement(CallStatement *node) {
+  auto *sym = scope_->Resolve(node->callee());
+  // the compiler reports calls of anything else
+  if (sym == nullptr || !sym->IsProcedure()) { return; }
+  calls_[current_].push_back(dynamic_cast<Procedure *>(sym));
+}
+
+void DeadCodeEliminator::VisitReadStatement(ReadStatement * /*node*/) {}
+
+void DeadCodeEliminator::VisitWriteStatement(WriteStatement *node) {
+  for (auto *expr : node->expressions()) { Visit(expr); }
+}
+
+void DeadCodeEliminator::VisitAssignStatement(AssignStatement *node) {
+  Visit(node->expr());
+}
+
+void DeadCodeEliminator::VisitReturnStatement(ReturnStatement * /*node*/) {}
+
+void DeadCodeEliminator::VisitBinaryOperation(BinaryOperation *node) {
+  Visit(node->left());
+  Visit(node->right());
+}
+
+void DeadCodeEliminator::VisitUnaryOperation(UnaryOperation *node) {
+  Visit(node->expr());
+}
+
+void DeadCodeEliminator::VisitLiteral(Literal * /*node*/) {}
+
+void DeadCodeEliminator::VisitVariableProxy(VariableProxy *node) {
+  if (node->target()->IsVariable()) {
+    read_.insert(dynamic_cast<Variable *>(node->target()));
+  }
+}
+
+} // namespace pl0::ast
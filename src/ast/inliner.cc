@@ -0,0 +1,150 @@
+#include "ast/inliner.h"
+
+#include <unordered_set>
+
+namespace pl0::ast {
+
+Inliner::Inliner(Block *program) {
+  VisitBlock(program);
+  for (auto &[procedure, info] : procedures_) {
+    if (procedure != nullptr) { info.recursive = Reaches(procedure, procedure); }
+  }
+}
+
+bool Inliner::Reaches(Procedure *from, Procedure *to) const {
+  std::unordered_set<Procedure *> seen;
+  std::vector<Procedure *> worklist{from};
+  while (!worklist.empty()) {
+    auto iter = procedures_.find(worklist.back());
+    worklist.pop_back();
+    if (iter == procedures_.end()) { continue; }
+    for (const auto &call : iter->second.calls) {
+      if (call.callee == to) { return true; }
+      if (seen.insert(call.callee).second) { worklist.push_back(call.callee); }
+    }
+  }
+  return false;
+}
+
+int Inliner::ExpandedSize(Procedure *procedure) {
+  auto &info = procedures_[procedure];
+  if (info.expanded_size < 0) {
+    int size = info.size;
+    for (const auto &call : info.calls) {
+      if (Expansion(call.callee, call.loop_depth) != nullptr) {
+        size += ExpandedSize(call.callee) - 1;
+      }
+    }
+    info.expanded_size = size;
+  }
+  return info.expanded_size;
+}
+
+Block *Inliner::Expansion(Procedure *callee, int loop_depth) {
+  auto iter = procedures_.find(callee);
+  if (callee == nullptr || iter == procedures_.end()) { return nullptr; }
+  const auto &info = iter->second;
+  if (info.recursive || info.returns
+      || !info.body->sub_procedures().empty()) {
+    return nullptr;
+  }
+  const int size = ExpandedSize(callee);
+  const bool hot = loop_depth > 0 || info.call_sites == 1;
+  if (size <= kMaxSize || (hot && size <= kMaxHotSize)) { return info.body; }
+  return nullptr;
+}
+
+void Inliner::VisitVariableDeclaration(VariableDeclaration * /*node*/) {}
+
+void Inliner::VisitConstantDeclaration(ConstantDeclaration * /*node*/) {}
+
+void Inliner::VisitProcedureDeclaration(ProcedureDeclaration *node) {
+  auto *enclosing = current_;
+  const int loop_depth = loop_depth_;
+  current_ = node->symbol();
+  loop_depth_ = 0;
+  procedures_[current_].body = node->main_block();
+  VisitBlock(node->main_block());
+  current_ = enclosing;
+  loop_depth_ = loop_depth;
+}
+
+void Inliner::VisitBlock(Block *node) {
+  auto *enclosing = scope_;
+  scope_ = node->belonging_scope();
+  Visit(node->body());
+  for (auto *procedure : node->sub_procedures()) {
+    VisitProcedureDeclaration(procedure);
+  }
+  scope_ = enclosing;
+}
+
+void Inliner::VisitStatementList(StatementList *node) {
+  for (auto *statement : node->statements()) { Visit(statement); }
+}
+
+void Inliner::VisitIfStatement(IfStatement *node) {
+  procedures_[current_].size++;
+  Visit(node->condition());
+  Visit(node->then_statement());
+  if (node->has_else_statement()) { Visit(node->else_statement()); }
+}
+
+void Inliner::VisitWhileStatement(WhileStatement *node) {
+  procedures_[current_].size++;
+  Visit(node->cond());
+  loop_depth_++;
+  Visit(node->body());
+  loop_depth_--;
+}
+
+void Inliner::VisitCallStatement(CallStatement *node) {
+  procedures_[current_].size++;
+  auto *sym = scope_->Resolve(node->callee());
+  // the compiler reports calls of anything else
+  if (sym == nullptr || !sym->IsProcedure()) { return; }
+  auto *callee = dynamic_cast<Procedure *>(sym);
+  procedures_[current_].calls.push_back({callee, loop_depth_});
+  procedures_[callee].call_sites++;
+}
+
+void Inliner::VisitReadStatement(ReadStatement *node) {
+  procedures_[current_].size += static_cast<int>(node->targets().size()) * 2;
+}
+
+void Inliner::VisitWriteStatement(WriteStatement *node) {
+  for (auto *expr : node->expressions()) {
+    procedures_[current_].size++;
+    Visit(expr);
+  }
+}
+
+void Inliner::VisitAssignStatement(AssignStatement *node) {
+  procedures_[current_].size++;
+  Visit(node->expr());
+}
+
+void Inliner::VisitReturnStatement(ReturnStatement * /*node*/) {
+  procedures_[current_].returns = true;
+}
+
+void Inliner::VisitBinaryOperation(BinaryOperation *node) {
+  procedures_[current_].size++;
+  Visit(node->left());
+  Visit(node->right());
+}
+
+void Inliner::VisitUnaryOperation(UnaryOperation *node) {
+  procedures_[current_].size++;
+  Visit(node->expr());
+}
+
+void Inliner::VisitLiteral(Literal * /*node*/) {
+  procedures_[current_].size++;
+}
+
+void Inliner::VisitVariableProxy(VariableProxy * /*node*/) {
+  procedures_[current_].size++;
+}
+
+} // namespace pl0::ast
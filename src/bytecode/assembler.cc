@@ -37,6 +37,11 @@ Backpatcher assembler::Call(int caller_level) {
     return Backpatcher { code_, GetLastAddress() };
 }
 
+Backpatcher assembler::TailCall(int caller_level) {
+    Emit(opcode::TCL, caller_level, IGNORE);
+    return Backpatcher { code_, GetLastAddress() };
+}
+
 void assembler::Branch(int target) {
     Emit(opcode::JMP, IGNORE, target);
 }
@@ -55,28 +60,33 @@ Backpatcher assembler::BranchIfFalse() {
     return Backpatcher { code_, GetLastAddress() };
 }
 
-void assembler::Enter(int scope_var_count) {
+Backpatcher assembler::Enter(int scope_var_count) {
     Emit(opcode::INT, IGNORE, scope_var_count);
+    return Backpatcher { code_, GetLastAddress() };
 }
 
 void assembler::leave() {
-    Emit(opcode::OPR, IGNORE, *opt::RET);
+    Emit(opcode::RET, IGNORE, IGNORE);
 }
 
 void assembler::Read() {
-    Emit(opcode::OPR, IGNORE, *opt::READ);
+    Emit(opcode::READ, IGNORE, IGNORE);
 }
 
 void assembler::Write() {
-    Emit(opcode::OPR, IGNORE, *opt::WRITE);
+    Emit(opcode::WRITE, IGNORE, IGNORE);
+}
+
+void assembler::Divisible() {
+    Emit(opcode::DVD, IGNORE, IGNORE);
 }
 
 void assembler::Operation(Token tk) {
-    auto iter = token2opt.find(tk);
-    if (iter == token2opt.end()) {
+    auto iter = token2opcode.find(tk);
+    if (iter == token2opcode.end()) {
         throw GeneralError("token ", *tk, " cannot be used as operator");
     }
-    Emit(opcode::OPR, IGNORE, *iter->second);
+    Emit(iter->second, IGNORE, IGNORE);
 }
 
 const bytecode &assembler::code() {
@@ -0,0 +1,207 @@
+#include "bytecode/cache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "bytecode/image.h"
+
+namespace fs = std::filesystem;
+
+namespace pl0 {
+
+namespace {
+
+constexpr const char *kImageExtension = ".pl0b";
+constexpr const char *kSnapshotExtension = ".pl0s";
+constexpr const char *kStatisticsFile = "statistics";
+
+// 64-bit FNV-1a
+uint64_t Hash(uint64_t hash, const std::string &data) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+// The version, and where it can be found the executable itself, so that a
+// rebuilt compiler never picks up entries of the previous one.
+std::string CompilerIdentity() {
+  std::string identity = PL0_VERSION;
+#if defined(__linux__)
+  std::error_code error;
+  const auto modified = fs::last_write_time("/proc/self/exe", error);
+  const auto size = fs::file_size("/proc/self/exe", error);
+  if (!error) {
+    identity += Concat('/', modified.time_since_epoch().count(), '/', size);
+  }
+#endif
+  return identity;
+}
+
+// A name next to path no other run picks, to be renamed over it.
+fs::path TemporaryPath(const fs::path &path) {
+  static thread_local std::mt19937_64 random{std::random_device{}()};
+  auto name = path.filename().string() + ".tmp" + std::to_string(random());
+  return path.parent_path() / name;
+}
+
+} // namespace
+
+CompilationCache::CompilationCache(std::string directory, uint64_t capacity)
+    : directory_(std::move(directory)), capacity_(capacity) {
+  std::error_code error;
+  fs::create_directories(directory_, error);
+}
+
+std::string CompilationCache::DefaultDirectory() {
+  if (const char *dir = std::getenv("PL0_CACHE_DIR"); dir && *dir) {
+    return dir;
+  }
+  if (const char *dir = std::getenv("XDG_CACHE_HOME"); dir && *dir) {
+    return (fs::path(dir) / "pl0").string();
+  }
+  if (const char *home = std::getenv("HOME"); home && *home) {
+    return (fs::path(home) / ".cache" / "pl0").string();
+  }
+  return (fs::temp_directory_path() / "pl0-cache").string();
+}
+
+std::string CompilationCache::Key(
+    const std::string &source, const std::string &flags) {
+  const std::string version = Concat(
+      CompilerIdentity(), '/', Image::kVersion, '/', std::size(opcode_name),
+      '/', flags, '/');
+  uint64_t hash = Hash(0xcbf29ce484222325, version);
+  hash = Hash(hash, source);
+  std::string key(16, '0');
+  for (int i = 15; i >= 0; i--, hash >>= 4) {
+    key[i] = "0123456789abcdef"[hash & 0xf];
+  }
+  return key;
+}
+
+std::string CompilationCache::PathOf(
+    const std::string &key, const char *extension) const {
+  return (fs::path(directory_) / (key + extension)).string();
+}
+
+std::optional<CompilationCache::Entry> CompilationCache::Find(
+    const std::string &key) {
+  for (bool folded : {true, false}) {
+    const auto path =
+        PathOf(key, folded ? kSnapshotExtension : kImageExtension);
+    std::error_code error;
+    if (!fs::exists(path, error)) { continue; }
+    try {
+      Entry entry;
+      if (folded) {
+        entry.prefix = LoadSnapshot(path);
+        entry.code = entry.prefix->code;
+      } else {
+        entry.code = LoadImage(path).code;
+      }
+      fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+      Record(&Statistics::hits);
+      return entry;
+    } catch (GeneralError &) {
+      // damaged, compile again and replace it
+      fs::remove(path, error);
+    }
+  }
+  Record(&Statistics::misses);
+  return std::nullopt;
+}
+
+void CompilationCache::Store(
+    const std::string &key, const bytecode &code, const Snapshot *prefix) {
+  const fs::path path =
+      PathOf(key, prefix != nullptr ? kSnapshotExtension : kImageExtension);
+  const auto temporary = TemporaryPath(path);
+  std::error_code error;
+  try {
+    if (prefix != nullptr) {
+      WriteSnapshot(*prefix, temporary.string());
+    } else {
+      WriteImage(code, temporary.string());
+    }
+  } catch (GeneralError &) {
+    fs::remove(temporary, error);
+    return;
+  }
+  fs::rename(temporary, path, error);
+  if (error) {
+    fs::remove(temporary, error);
+    return;
+  }
+  Evict();
+}
+
+void CompilationCache::Evict() {
+  struct Entry {
+    fs::path path;
+    uint64_t size;
+    fs::file_time_type used;
+  };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  std::error_code error;
+  // stops at an entry the directory cannot be read past
+  for (fs::directory_iterator file{directory_, error}, end;
+       !error && file != end; file.increment(error)) {
+    const auto extension = file->path().extension();
+    if (extension != kImageExtension && extension != kSnapshotExtension) {
+      continue;
+    }
+    std::error_code stat_error;
+    Entry entry{
+        file->path(), file->file_size(stat_error),
+        file->last_write_time(stat_error)};
+    if (stat_error) { continue; }
+    total += entry.size;
+    entries.push_back(std::move(entry));
+  }
+  if (total <= capacity_) { return; }
+
+  std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+    return a.used < b.used;
+  });
+  int64_t evicted = 0;
+  for (const auto &entry : entries) {
+    if (total <= capacity_) { break; }
+    if (fs::remove(entry.path, error)) {
+      total -= entry.size;
+      evicted++;
+    }
+  }
+  Record(&Statistics::evictions, evicted);
+}
+
+CompilationCache::Statistics CompilationCache::statistics() const {
+  Statistics stats;
+  std::ifstream fin(fs::path(directory_) / kStatisticsFile);
+  fin >> stats.hits >> stats.misses >> stats.evictions;
+  return stats;
+}
+
+void CompilationCache::Record(int64_t Statistics::*counter, int64_t count) {
+  auto stats = statistics();
+  stats.*counter += count;
+  const auto path = fs::path(directory_) / kStatisticsFile;
+  const auto temporary = TemporaryPath(path);
+  std::error_code error;
+  {
+    std::ofstream fout(temporary);
+    fout << stats.hits << ' ' << stats.misses << ' ' << stats.evictions
+         << '\n';
+    if (fout.fail()) { error = std::make_error_code(std::errc::io_error); }
+  }
+  if (!error) { fs::rename(temporary, path, error); }
+  if (error) { fs::remove(temporary, error); }
+}
+
+} // namespace pl0
@@ -1,7 +1,23 @@
 #include "bytecode/compiler.h"
 
+#include <algorithm>
+#include <optional>
+
 namespace pl0::code {
 
+namespace {
+
+// the procedures declared in node, each one followed by its own
+void Declarations(
+    ast::Block *node, std::vector<ast::ProcedureDeclaration *> &result) {
+  for (auto *method : node->sub_procedures()) {
+    result.push_back(method);
+    Declarations(method->main_block(), result);
+  }
+}
+
+} // namespace
+
 void Compiler::VisitVariableDeclaration(ast::VariableDeclaration *node) {
 }
 
@@ -14,14 +30,44 @@ void Compiler::VisitProcedureDeclaration(ast::ProcedureDeclaration *node) {
 }
 
 void Compiler::VisitBlock(ast::Block *node) {
-  top_scope_ = node->belonging_scope();
-  assembler_.Enter(top_scope_->variable_count() + 3);
+  top_scope_ = lexical_scope_ = node->belonging_scope();
+  frame_size_ = frame_peak_ = top_scope_->variable_count();
+  auto frame = assembler_.Enter(frame_size_ + kFrameBookkeeping);
+  tail_ = true;
   Visit(node->body());
+  tail_ = false;
   assembler_.leave();
-  for (auto *method : node->sub_procedures()) {
-    VisitProcedureDeclaration(method);
+  frame.set_address(frame_peak_ + kFrameBookkeeping);
+  top_scope_ = lexical_scope_ = top_scope_->enclosing_scope();
+}
+
+// The body of callee in the current frame, its locals moved above the ones
+// of the frame and cleared first as INT would.
+void Compiler::Expand(ast::Block *callee) {
+  auto *scope = callee->belonging_scope();
+  const int base = frame_size_;
+  frame_size_ += scope->variable_count();
+  frame_peak_ = std::max(frame_peak_, frame_size_);
+  for (int i = 0; i < scope->variable_count(); i++) {
+    assembler_.Load(0);
+    assembler_.Store(0, base + i);
+  }
+  auto *var_declaration = callee->var_declaration();
+  if (var_declaration != nullptr) {
+    for (auto *var : var_declaration->variables()) {
+      moved_[var] = base + var->index();
+    }
+  }
+
+  auto *lexical_scope = lexical_scope_;
+  lexical_scope_ = scope;
+  Visit(callee->body());
+  lexical_scope_ = lexical_scope;
+
+  if (var_declaration != nullptr) {
+    for (auto *var : var_declaration->variables()) { moved_.erase(var); }
   }
-  top_scope_ = top_scope_->enclosing_scope();
+  frame_size_ = base;
 }
 
 void Compiler::VisitUnaryOperation(ast::UnaryOperation *node) {
@@ -47,6 +93,10 @@ void Compiler::VisitLvalue(ast::VariableProxy *node) {
   auto *sym = node->target();
   if (sym->IsVariable()) {
     auto *var = dynamic_cast<Variable *>(sym);
+    if (auto iter = moved_.find(var); iter != moved_.end()) {
+      assembler_.Store(0, iter->second);
+      return;
+    }
     assembler_.Store(top_scope_->level() - var->level(), var->index());
   } else if (sym->IsConstant()) {
     throw GeneralError("constant " + sym->name() + " is not assignable");
@@ -59,6 +109,10 @@ void Compiler::VisitRvalue(ast::VariableProxy *node) {
   auto *sym = node->target();
   if (sym->IsVariable()) {
     auto *var = dynamic_cast<Variable *>(sym);
+    if (auto iter = moved_.find(var); iter != moved_.end()) {
+      assembler_.Load(0, iter->second);
+      return;
+    }
     assembler_.Load(top_scope_->level() - var->level(), var->index());
   } else if (sym->IsConstant()) {
     auto *var = dynamic_cast<Constant *>(sym);
@@ -75,7 +129,7 @@ void Compiler::VisitAssignStatement(ast::AssignStatement *node) {
 }
 
 void Compiler::VisitCallStatement(ast::CallStatement *node) {
-  auto *sym = top_scope_->Resolve(node->callee());
+  auto *sym = lexical_scope_->Resolve(node->callee());
   if (sym == nullptr) {
     throw GeneralError(
         "no procedure named \"" + node->callee() + "\" to be called");
@@ -84,7 +138,18 @@ void Compiler::VisitCallStatement(ast::CallStatement *node) {
     throw GeneralError(node->callee() + " is not a procedure");
   }
   auto *method = dynamic_cast<Procedure *>(sym);
-  patch_list_[method].push_back(assembler_.Call(top_scope_->level()));
+  if (inliner_ != nullptr) {
+    if (auto *body = inliner_->Expansion(method, loop_depth_)) {
+      Expand(body);
+      return;
+    }
+  }
+  // a procedure declared right here needs the current frame as its static
+  // link, every other one can take it over
+  const bool tail = tail_ && top_scope_->level() > method->level();
+  patch_list_[method].push_back(
+      tail ? assembler_.TailCall(top_scope_->level())
+           : assembler_.Call(top_scope_->level()));
 }
 
 void Compiler::VisitWriteStatement(ast::WriteStatement *node) {
@@ -96,11 +161,21 @@ void Compiler::VisitWriteStatement(ast::WriteStatement *node) {
 
 void Compiler::VisitWhileStatement(ast::WhileStatement *node) {
   auto beginning = assembler_.GetNextAddress();
-  Visit(node->cond());
-  auto goto_end = assembler_.BranchIfFalse();
+  // a condition folded to true needs no test
+  auto *literal = dynamic_cast<ast::Literal *>(node->cond());
+  std::optional<Backpatcher> goto_end;
+  if (literal == nullptr || literal->value() == 0) {
+    Visit(node->cond());
+    goto_end = assembler_.BranchIfFalse();
+  }
+  const bool tail = tail_;
+  tail_ = false;
+  loop_depth_++;
   Visit(node->body());
+  loop_depth_--;
+  tail_ = tail;
   assembler_.Branch(beginning);
-  goto_end.set_address(assembler_.GetNextAddress());
+  if (goto_end) { goto_end->set_address(assembler_.GetNextAddress()); }
 }
 
 void Compiler::VisitReturnStatement(ast::ReturnStatement * /*node*/) {
@@ -131,11 +206,44 @@ void Compiler::VisitIfStatement(ast::IfStatement *node) {
 }
 
 void Compiler::VisitStatementList(ast::StatementList *node) {
-  for (auto *stmt : node->statements()) { Visit(stmt); }
+  const bool tail = tail_;
+  const auto &statements = node->statements();
+  for (size_t i = 0; i < statements.size(); i++) {
+    // nothing but a return may follow a statement in tail position
+    tail_ = i + 1 == statements.size()
+                ? tail
+                : statements[i + 1]->type()
+                      == ast::AstNodeType::kReturnStatement;
+    Visit(statements[i]);
+  }
+  tail_ = tail;
+}
+
+// Procedures follow the main program in the order they are declared. Lazily,
+// only those called are emitted, until no emitted code calls another one: a
+// procedure every call of which was expanded is left out with the ones only
+// it called.
+void Compiler::EmitProcedures(ast::Block *program) {
+  std::vector<ast::ProcedureDeclaration *> declarations;
+  Declarations(program, declarations);
+  for (bool emitted = true; emitted;) {
+    emitted = false;
+    for (auto *method : declarations) {
+      auto *sym = method->symbol();
+      if (entry_points_.count(sym) != 0
+          || (lazy_ && patch_list_.count(sym) == 0)) {
+        continue;
+      }
+      VisitProcedureDeclaration(method);
+      emitted = true;
+    }
+  }
 }
 
 void Compiler::Generate(ast::Block *program) {
+  if (inlining_) { inliner_ = std::make_unique<ast::Inliner>(program); }
   VisitBlock(program);
+  EmitProcedures(program);
   for (const auto &kv : patch_list_) {
     for (auto patch : kv.second) {
       patch.set_level(patch.get_level() - kv.first->level());
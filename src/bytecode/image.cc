@@ -0,0 +1,171 @@
+#include "bytecode/image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "bytecode/verifier.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PL0_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define PL0_MMAP 0
+#endif
+
+namespace pl0 {
+
+namespace {
+
+constexpr auto kOpcodeCount = static_cast<uint32_t>(std::size(opcode_name));
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t opcode_count;
+  uint32_t instruction_count;
+  uint32_t entry_count;
+};
+
+static_assert(sizeof(Instruction) == 3 * sizeof(int32_t));
+
+// A whole file, mapped read-only where possible and read into memory
+// otherwise.
+class MappedFile {
+  const char *data_{nullptr};
+  size_t size_{0};
+  std::vector<char> buffer_;
+
+ public:
+  explicit MappedFile(const std::string &path) {
+#if PL0_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) { throw GeneralError("cannot open image \"", path, '"'); }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw GeneralError("cannot read image \"", path, '"');
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void *memory = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (memory == MAP_FAILED) {
+        close(fd);
+        throw GeneralError("cannot map image \"", path, '"');
+      }
+      data_ = static_cast<const char *>(memory);
+    }
+    close(fd);
+#else
+    std::ifstream fin(path, std::ios::binary);
+    if (fin.fail()) { throw GeneralError("cannot open image \"", path, '"'); }
+    buffer_.assign(
+        std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+  }
+
+  ~MappedFile() {
+#if PL0_MMAP
+    if (size_ > 0) { munmap(const_cast<char *>(data_), size_); }
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  [[nodiscard]] const char *data() const { return data_; }
+  [[nodiscard]] size_t size() const { return size_; }
+};
+
+} // namespace
+
+std::vector<int> ProcedureEntries(const bytecode &code) {
+  std::vector<int> entries{0};
+  for (const auto &ins : code) {
+    if (IsCall(ins.op)) { entries.push_back(ins.address); }
+  }
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+  return entries;
+}
+
+void WriteImage(const bytecode &code, const std::string &path) {
+  auto entries = ProcedureEntries(code);
+  Header header{
+      Image::kMagic, Image::kVersion, kOpcodeCount,
+      static_cast<uint32_t>(code.size()),
+      static_cast<uint32_t>(entries.size())};
+
+  std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+  fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  fout.write(
+      reinterpret_cast<const char *>(code.data()),
+      static_cast<std::streamsize>(code.size() * sizeof(Instruction)));
+  fout.write(
+      reinterpret_cast<const char *>(entries.data()),
+      static_cast<std::streamsize>(entries.size() * sizeof(int)));
+  fout.close();
+  if (fout.fail()) {
+    throw GeneralError("cannot write image \"", path, '"');
+  }
+}
+
+Image LoadImage(const std::string &path) {
+  MappedFile file{path};
+  auto invalid = [&](const std::string &reason) {
+    return GeneralError('"', path, "\" is not a valid image: ", reason);
+  };
+
+  Header header{};
+  if (file.size() < sizeof(header)) { throw invalid("truncated header"); }
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (header.magic != Image::kMagic) { throw invalid("bad magic"); }
+  if (header.version != Image::kVersion) {
+    throw invalid("unsupported version");
+  }
+  if (header.opcode_count != kOpcodeCount) {
+    throw invalid("written by a build with a different opcode set");
+  }
+  const size_t expected = sizeof(header)
+                          + size_t{header.instruction_count} * sizeof(Instruction)
+                          + size_t{header.entry_count} * sizeof(int);
+  if (file.size() != expected) { throw invalid("size does not match header"); }
+
+  Image image;
+  const char *data = file.data() + sizeof(header);
+  image.code.resize(header.instruction_count);
+  std::memcpy(
+      image.code.data(), data, image.code.size() * sizeof(Instruction));
+  data += image.code.size() * sizeof(Instruction);
+  image.entries.resize(header.entry_count);
+  std::memcpy(image.entries.data(), data, image.entries.size() * sizeof(int));
+
+  const int length = static_cast<int>(image.code.size());
+  if (!std::is_sorted(image.entries.begin(), image.entries.end())
+      || std::any_of(image.entries.begin(), image.entries.end(), [&](int pos) {
+           return pos < 0 || pos > length;
+         })) {
+    throw invalid("bad procedure entry table");
+  }
+  for (const auto &ins : image.code) {
+    if (IsCall(ins.op)
+        && !std::binary_search(
+            image.entries.begin(), image.entries.end(), ins.address)) {
+      throw invalid("call to an unknown procedure");
+    }
+  }
+  try {
+    VerifyBytecode(image.code);
+  } catch (const GeneralError &error) {
+    throw invalid(error.what());
+  }
+  return image;
+}
+
+} // namespace pl0
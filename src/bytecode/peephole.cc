@@ -0,0 +1,132 @@
+#include "bytecode/peephole.h"
+
+#include <vector>
+
+namespace pl0 {
+
+namespace {
+
+bool IsJump(opcode op) { return op == opcode::JMP || op == opcode::JPC; }
+
+bool FallsThrough(opcode op) {
+  return op != opcode::JMP && op != opcode::RET && op != opcode::TCL;
+}
+
+// where a jump to target ends up after the JMPs found there, the target
+// itself if they go round in a loop
+int Destination(const bytecode &code, int target) {
+  const int length = static_cast<int>(code.size());
+  int pos = target;
+  for (int hops = 0; pos < length && code[pos].op == opcode::JMP; hops++) {
+    if (hops == length) { return target; }
+    pos = code[pos].address;
+  }
+  return pos;
+}
+
+bool ThreadJumps(bytecode &code) {
+  const int length = static_cast<int>(code.size());
+  bool changed = false;
+  for (auto &ins : code) {
+    if (!IsJump(ins.op)) { continue; }
+    const int target = Destination(code, ins.address);
+    if (target != ins.address) {
+      ins.address = target;
+      changed = true;
+    }
+    if (ins.op == opcode::JMP && target < length
+        && code[target].op == opcode::RET) {
+      ins = code[target];
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+std::vector<bool> Reachable(const bytecode &code) {
+  const int length = static_cast<int>(code.size());
+  std::vector<bool> reached(length, false);
+  std::vector<int> work{0};
+  while (!work.empty()) {
+    const int pos = work.back();
+    work.pop_back();
+    if (pos >= length || reached[pos]) { continue; }
+    reached[pos] = true;
+    const auto &ins = code[pos];
+    if (IsJump(ins.op) || IsCall(ins.op)) { work.push_back(ins.address); }
+    if (FallsThrough(ins.op)) { work.push_back(pos + 1); }
+  }
+  return reached;
+}
+
+// the start of the program and everything jumped to or called
+std::vector<bool> Targets(const bytecode &code, bool calls_only) {
+  std::vector<bool> target(code.size() + 1, false);
+  target[0] = true;
+  for (const auto &ins : code) {
+    if (IsCall(ins.op) || (!calls_only && IsJump(ins.op))) {
+      target[ins.address] = true;
+    }
+  }
+  return target;
+}
+
+bool Compact(bytecode &code) {
+  const int length = static_cast<int>(code.size());
+  const auto reached = Reachable(code);
+  const auto entries = Targets(code, true);
+  std::vector<bool> keep(length);
+  for (int pos = 0; pos < length; pos++) {
+    const auto &ins = code[pos];
+    keep[pos] =
+        reached[pos] && !(ins.op == opcode::JMP && ins.address == pos + 1)
+        && !(ins.op == opcode::INT && ins.address == kFrameBookkeeping
+             && entries[pos] && pos != 0);
+  }
+
+  // a deleted instruction passes what jumped to it on to the next one kept
+  std::vector<int> moved(length + 1);
+  int kept = 0;
+  for (int pos = 0; pos < length; pos++) {
+    moved[pos] = kept;
+    if (keep[pos]) { code[kept++] = code[pos]; }
+  }
+  moved[length] = kept;
+  if (kept == length) { return false; }
+  code.resize(kept);
+  for (auto &ins : code) {
+    if (IsJump(ins.op) || IsCall(ins.op)) { ins.address = moved[ins.address]; }
+  }
+  return true;
+}
+
+// the value stored is still on the stack, unless the LOD is jumped to; a
+// value just loaded is left to MOV, which fuses LOD y; STO x
+bool ReuseStored(bytecode &code) {
+  const auto target = Targets(code, false);
+  bool changed = false;
+  for (size_t pos = 1; pos + 1 < code.size(); pos++) {
+    const auto &store = code[pos];
+    const auto &load = code[pos + 1];
+    if (store.op == opcode::STO && load.op == opcode::LOD
+        && store.level == load.level && store.address == load.address
+        && !target[pos + 1] && code[pos - 1].op != opcode::LOD) {
+      code[pos + 1] = store;
+      code[pos] = {opcode::DUP, 0, 0};
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+} // namespace
+
+void OptimizePeepholes(bytecode &code) {
+  for (bool changed = true; changed;) {
+    changed = ThreadJumps(code);
+    changed |= Compact(code);
+    changed |= ReuseStored(code);
+  }
+}
+
+} // namespace pl0
@@ -0,0 +1,291 @@
+#include "bytecode/register_compiler.h"
+
+#include <algorithm>
+
+namespace pl0::code {
+
+namespace {
+
+// the branch taken when a comparison does not hold
+reg::opcode NegatedBranch(Token op) {
+  switch (op) {
+    case Token::LE:
+      return reg::opcode::JGE;
+    case Token::LEQ:
+      return reg::opcode::JGT;
+    case Token::GE:
+      return reg::opcode::JLE;
+    case Token::GEQ:
+      return reg::opcode::JLT;
+    case Token::EQ:
+      return reg::opcode::JNE;
+    case Token::NEQ:
+      return reg::opcode::JEQ;
+    default:
+      throw GeneralError("token ", *op, " is not a compare operator");
+  }
+}
+
+// the comparison with its operands swapped
+Token Mirror(Token op) {
+  switch (op) {
+    case Token::LE:
+      return Token::GE;
+    case Token::LEQ:
+      return Token::GEQ;
+    case Token::GE:
+      return Token::LE;
+    case Token::GEQ:
+      return Token::LEQ;
+    default:
+      return op;
+  }
+}
+
+reg::opcode Arithmetic(Token op, bool immediate) {
+  switch (op) {
+    case Token::ADD:
+      return immediate ? reg::opcode::ADDK : reg::opcode::ADD;
+    case Token::SUB:
+      return immediate ? reg::opcode::SUBK : reg::opcode::SUB;
+    case Token::MUL:
+      return immediate ? reg::opcode::MULK : reg::opcode::MUL;
+    case Token::DIV:
+      return immediate ? reg::opcode::DIVK : reg::opcode::DIV;
+    default:
+      throw GeneralError("token ", *op, " cannot be used in an expression");
+  }
+}
+
+// the K form of a branch directly follows the register form
+reg::opcode Immediate(reg::opcode op) {
+  return reg::opcode(static_cast<int>(op) + 1);
+}
+
+} // namespace
+
+int RegisterCompiler::Emit(reg::opcode op, int a, int b, int c) {
+  code_.push_back({op, a, b, c});
+  return GetNextAddress() - 1;
+}
+
+int RegisterCompiler::NewTemporary() {
+  register_count_ = std::max(register_count_, next_temporary_ + 1);
+  return next_temporary_++;
+}
+
+void RegisterCompiler::VisitStatement(ast::Statement *node) {
+  auto saved = next_temporary_;
+  Visit(node);
+  next_temporary_ = saved;
+}
+
+RegisterCompiler::Operand RegisterCompiler::Evaluate(
+    ast::Expression *node, int destination) {
+  destination_ = destination;
+  Visit(node);
+  return result_;
+}
+
+int RegisterCompiler::EvaluateToRegister(ast::Expression *node) {
+  auto operand = Evaluate(node);
+  if (!operand.constant) { return operand.value; }
+  auto tmp = NewTemporary();
+  Emit(reg::opcode::LOADK, tmp, operand.value);
+  return tmp;
+}
+
+int RegisterCompiler::BranchIfFalse(ast::Expression *cond) {
+  if (cond->type() == ast::AstNodeType::kUnaryOperation) {
+    auto *odd = dynamic_cast<ast::UnaryOperation *>(cond);
+    return Emit(reg::opcode::JEVEN, 0, EvaluateToRegister(odd->expr()));
+  }
+  if (cond->type() == ast::AstNodeType::kLiteral) {
+    // folded, the branch is taken when it is 0
+    return Emit(reg::opcode::JEQK, 0, EvaluateToRegister(cond), 0);
+  }
+  if (cond->type() != ast::AstNodeType::kBinaryOperation) {
+    throw GeneralError("expect a condition");
+  }
+  auto *node = dynamic_cast<ast::BinaryOperation *>(cond);
+  auto op = node->op();
+  auto lhs = Evaluate(node->left());
+  auto rhs = Evaluate(node->right());
+  if (lhs.constant && !rhs.constant) {
+    std::swap(lhs, rhs);
+    op = Mirror(op);
+  }
+  if (lhs.constant) {
+    auto tmp = NewTemporary();
+    Emit(reg::opcode::LOADK, tmp, lhs.value);
+    lhs = {false, tmp};
+  }
+  auto branch = NegatedBranch(op);
+  return Emit(rhs.constant ? Immediate(branch) : branch, 0, lhs.value, rhs.value);
+}
+
+void RegisterCompiler::VisitVariableDeclaration(
+    ast::VariableDeclaration * /*node*/) {}
+
+void RegisterCompiler::VisitConstantDeclaration(
+    ast::ConstantDeclaration * /*node*/) {}
+
+void RegisterCompiler::VisitProcedureDeclaration(
+    ast::ProcedureDeclaration *node) {
+  entry_points_[node->symbol()] = GetNextAddress();
+  VisitBlock(node->main_block());
+}
+
+void RegisterCompiler::VisitBlock(ast::Block *node) {
+  top_scope_ = node->belonging_scope();
+  next_temporary_ = register_count_ = top_scope_->variable_count();
+  auto enter = Emit(reg::opcode::ENTER);
+  VisitStatement(node->body());
+  Emit(reg::opcode::RET);
+  code_[enter].a = register_count_;
+  for (auto *method : node->sub_procedures()) {
+    VisitProcedureDeclaration(method);
+  }
+  top_scope_ = top_scope_->enclosing_scope();
+}
+
+void RegisterCompiler::VisitUnaryOperation(ast::UnaryOperation * /*node*/) {
+  throw GeneralError("odd can only be used as a condition");
+}
+
+void RegisterCompiler::VisitBinaryOperation(ast::BinaryOperation *node) {
+  auto destination = destination_;
+  auto lhs = Evaluate(node->left());
+  auto rhs = Evaluate(node->right());
+  if (lhs.constant) {
+    auto tmp = NewTemporary();
+    Emit(reg::opcode::LOADK, tmp, lhs.value);
+    lhs = {false, tmp};
+  }
+  auto target = destination == kNoRegister ? NewTemporary() : destination;
+  Emit(Arithmetic(node->op(), rhs.constant), target, lhs.value, rhs.value);
+  result_ = {false, target};
+}
+
+void RegisterCompiler::VisitLiteral(ast::Literal *node) {
+  result_ = {true, node->value()};
+}
+
+void RegisterCompiler::VisitVariableProxy(ast::VariableProxy *node) {
+  auto *sym = node->target();
+  if (sym->IsConstant()) {
+    result_ = {true, dynamic_cast<Constant *>(sym)->value()};
+  } else if (sym->IsVariable()) {
+    auto *var = dynamic_cast<Variable *>(sym);
+    auto distance = top_scope_->level() - var->level();
+    if (distance == 0) {
+      result_ = {false, var->index()};
+      return;
+    }
+    auto target =
+        destination_ == kNoRegister ? NewTemporary() : destination_;
+    Emit(reg::opcode::GETUP, target, distance, var->index());
+    result_ = {false, target};
+  } else {
+    throw GeneralError(
+        sym->name() + " is a procedure so that cannot be used in expression");
+  }
+}
+
+void RegisterCompiler::VisitAssignStatement(ast::AssignStatement *node) {
+  auto *sym = node->target()->target();
+  if (!sym->IsVariable()) {
+    throw GeneralError(sym->name() + " is not assignable");
+  }
+  auto *var = dynamic_cast<Variable *>(sym);
+  auto distance = top_scope_->level() - var->level();
+  if (distance != 0) {
+    Emit(
+        reg::opcode::SETUP, EvaluateToRegister(node->expr()), distance,
+        var->index());
+    return;
+  }
+  auto value = Evaluate(node->expr(), var->index());
+  if (value.constant) {
+    Emit(reg::opcode::LOADK, var->index(), value.value);
+  } else if (value.value != var->index()) {
+    Emit(reg::opcode::MOVE, var->index(), value.value);
+  }
+}
+
+void RegisterCompiler::VisitCallStatement(ast::CallStatement *node) {
+  auto *sym = top_scope_->Resolve(node->callee());
+  if (sym == nullptr) {
+    throw GeneralError(
+        "no procedure named \"" + node->callee() + "\" to be called");
+  }
+  if (!sym->IsProcedure()) {
+    throw GeneralError(node->callee() + " is not a procedure");
+  }
+  auto *method = dynamic_cast<Procedure *>(sym);
+  patch_list_.emplace_back(
+      method,
+      Emit(reg::opcode::CALL, top_scope_->level() - method->level()));
+}
+
+void RegisterCompiler::VisitWriteStatement(ast::WriteStatement *node) {
+  for (auto *expr : node->expressions()) {
+    Emit(reg::opcode::WRITE, EvaluateToRegister(expr));
+  }
+}
+
+void RegisterCompiler::VisitWhileStatement(ast::WhileStatement *node) {
+  auto beginning = GetNextAddress();
+  auto goto_end = BranchIfFalse(node->cond());
+  VisitStatement(node->body());
+  Emit(reg::opcode::JMP, beginning);
+  code_[goto_end].a = GetNextAddress();
+}
+
+void RegisterCompiler::VisitReturnStatement(ast::ReturnStatement * /*node*/) {
+  Emit(reg::opcode::RET);
+}
+
+void RegisterCompiler::VisitReadStatement(ast::ReadStatement *node) {
+  for (auto *proxy : node->targets()) {
+    auto *var = dynamic_cast<Variable *>(proxy->target());
+    auto distance = top_scope_->level() - var->level();
+    if (distance == 0) {
+      Emit(reg::opcode::READ, var->index());
+    } else {
+      auto tmp = NewTemporary();
+      Emit(reg::opcode::READ, tmp);
+      Emit(reg::opcode::SETUP, tmp, distance, var->index());
+    }
+  }
+}
+
+void RegisterCompiler::VisitIfStatement(ast::IfStatement *node) {
+  auto goto_else = BranchIfFalse(node->condition());
+  VisitStatement(node->then_statement());
+  if (node->has_else_statement()) {
+    auto goto_end = Emit(reg::opcode::JMP);
+    code_[goto_else].a = GetNextAddress();
+    VisitStatement(node->else_statement());
+    code_[goto_end].a = GetNextAddress();
+  } else {
+    code_[goto_else].a = GetNextAddress();
+  }
+}
+
+void RegisterCompiler::VisitStatementList(ast::StatementList *node) {
+  for (auto *stmt : node->statements()) { VisitStatement(stmt); }
+}
+
+void RegisterCompiler::Generate(ast::Block *program) {
+  VisitBlock(program);
+  for (const auto &patch : patch_list_) {
+    auto iter = entry_points_.find(patch.first);
+    if (iter == entry_points_.end()) {
+      throw GeneralError("unexpected error");
+    }
+    code_[patch.second].b = iter->second;
+  }
+}
+
+} // namespace pl0::code
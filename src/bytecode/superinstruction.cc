@@ -0,0 +1,182 @@
+#include "bytecode/superinstruction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <map>
+
+namespace pl0 {
+
+namespace {
+
+struct Pattern {
+  opcode fused;
+  std::vector<opcode> slots;
+  // first and last slot must address the same variable
+  bool same_variable = false;
+};
+
+const std::vector<Pattern> patterns = {
+    {opcode::INC, {opcode::LOD, opcode::LIT, opcode::ADD, opcode::STO}, true},
+    {opcode::DEC, {opcode::LOD, opcode::LIT, opcode::SUB, opcode::STO}, true},
+    {opcode::LOD2, {opcode::LOD, opcode::LOD}},
+    {opcode::LODLIT, {opcode::LOD, opcode::LIT}},
+    {opcode::MOV, {opcode::LOD, opcode::STO}},
+    {opcode::LADD, {opcode::LOD, opcode::ADD}},
+    {opcode::LSUB, {opcode::LOD, opcode::SUB}},
+    {opcode::LMUL, {opcode::LOD, opcode::MUL}},
+    {opcode::LDIV, {opcode::LOD, opcode::DIV}},
+    {opcode::JGE, {opcode::LT, opcode::JPC}},
+    {opcode::JGT, {opcode::LE, opcode::JPC}},
+    {opcode::JLE, {opcode::GT, opcode::JPC}},
+    {opcode::JLT, {opcode::GE, opcode::JPC}},
+    {opcode::JNE, {opcode::EQ, opcode::JPC}},
+    {opcode::JEQ, {opcode::NE, opcode::JPC}},
+    {opcode::DUPSTO, {opcode::DUP, opcode::STO}},
+};
+
+// slots before first are not compared
+bool Matches(
+    const Pattern &pattern, const bytecode &code, size_t pos,
+    size_t first = 0) {
+  if (pos + pattern.slots.size() > code.size()) { return false; }
+  for (size_t i = first; i < pattern.slots.size(); i++) {
+    if (code[pos + i].op != pattern.slots[i]) { return false; }
+  }
+  if (pattern.same_variable) {
+    const auto &first = code[pos];
+    const auto &last = code[pos + pattern.slots.size() - 1];
+    return first.level == last.level && first.address == last.address;
+  }
+  return true;
+}
+
+} // namespace
+
+opcode Unfused(opcode op) {
+  for (const auto &pattern : patterns) {
+    if (pattern.fused == op) { return pattern.slots[0]; }
+  }
+  return op;
+}
+
+bool IsWellFused(const bytecode &code, size_t pos) {
+  for (const auto &pattern : patterns) {
+    if (pattern.fused == code[pos].op) {
+      return Matches(pattern, code, pos, 1);
+    }
+  }
+  return true;
+}
+
+std::vector<double> EstimateFrequencies(const bytecode &code) {
+  constexpr double kLoopFactor = 10;
+  constexpr double kMaxWeight = 1e12;
+  const int length = static_cast<int>(code.size());
+
+  // every backward jump closes a loop
+  std::vector<int> depth(length + 1, 0);
+  for (int i = 0; i < length; i++) {
+    if (code[i].op == opcode::JMP && code[i].address <= i) {
+      depth[code[i].address]++;
+      depth[i + 1]--;
+    }
+  }
+  for (int i = 1; i < length; i++) { depth[i] += depth[i - 1]; }
+
+  // procedures are laid out contiguously starting at their entry points
+  std::vector<int> entries{0};
+  for (const auto &ins : code) {
+    if (IsCall(ins.op)) { entries.push_back(ins.address); }
+  }
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+  auto owner = [&](int pos) {
+    return static_cast<int>(
+        std::upper_bound(entries.begin(), entries.end(), pos) - entries.begin()
+        - 1);
+  };
+
+  // a procedure is as hot as its call sites, iterate to propagate through
+  // the call graph; recursion saturates at kMaxWeight
+  std::vector<double> weight(entries.size(), 0);
+  weight[0] = 1;
+  for (size_t round = 0; round < entries.size(); round++) {
+    std::vector<double> next(entries.size(), 0);
+    next[0] = 1;
+    for (int i = 0; i < length; i++) {
+      if (!IsCall(code[i].op)) { continue; }
+      auto &callee = next[owner(code[i].address)];
+      callee += weight[owner(i)] * std::pow(kLoopFactor, depth[i]);
+      callee = std::min(callee, kMaxWeight);
+    }
+    weight = std::move(next);
+  }
+
+  std::vector<double> frequencies(length);
+  for (int i = 0; i < length; i++) {
+    frequencies[i] = weight[owner(i)] * std::pow(kLoopFactor, depth[i]);
+  }
+  return frequencies;
+}
+
+void FuseSuperinstructions(bytecode &code) {
+  const auto frequencies = EstimateFrequencies(code);
+  const size_t length = code.size();
+
+  // Choose non-overlapping sequences maximizing the estimated number of
+  // dispatches saved: saved[i] is the best result for the suffix from i.
+  std::vector<double> saved(length + 1, 0);
+  std::vector<const Pattern *> choice(length + 1, nullptr);
+  for (size_t i = length; i-- > 0;) {
+    saved[i] = saved[i + 1];
+    for (const auto &pattern : patterns) {
+      if (!Matches(pattern, code, i)) { continue; }
+      const size_t size = pattern.slots.size();
+      double gain = frequencies[i] * static_cast<double>(size - 1)
+                    + saved[i + size];
+      if (gain > saved[i]) {
+        saved[i] = gain;
+        choice[i] = &pattern;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < length;) {
+    if (choice[i] == nullptr) {
+      i++;
+      continue;
+    }
+    code[i].op = choice[i]->fused;
+    i += choice[i]->slots.size();
+  }
+}
+
+void PrintNgrams(const bytecode &code, std::ostream &out, int top) {
+  const auto frequencies = EstimateFrequencies(code);
+  out << "Weighted opcode n-grams:\n";
+  for (size_t n = 2; n <= 4; n++) {
+    std::map<std::string, double> counts;
+    for (size_t i = 0; i + n <= code.size(); i++) {
+      std::string gram;
+      for (size_t j = i; j < i + n; j++) {
+        gram += (j == i ? "" : " ") + std::string(*code[j].op);
+      }
+      counts[gram] += frequencies[i];
+    }
+    std::vector<std::pair<std::string, double>> sorted(
+        counts.begin(), counts.end());
+    std::stable_sort(
+        sorted.begin(), sorted.end(),
+        [](const auto &lhs, const auto &rhs) {
+          return lhs.second > rhs.second;
+        });
+    for (int i = 0; i < top && i < static_cast<int>(sorted.size()); i++) {
+      out << n << '\t' << std::setprecision(6) << sorted[i].second << '\t'
+          << sorted[i].first << '\n';
+    }
+  }
+  out << '\n';
+}
+
+} // namespace pl0
@@ -0,0 +1,338 @@
+#include "bytecode/verifier.h"
+
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "bytecode/image.h"
+#include "bytecode/superinstruction.h"
+#include "util.h"
+#include "vm.h"
+
+namespace pl0 {
+
+namespace {
+
+constexpr auto kOpcodeCount = static_cast<uint32_t>(std::size(opcode_name));
+// native code addresses a frame with a 32-bit byte offset, which leaves room
+// for the header and the operand reserve on top
+constexpr int kMaxLocals = INT_MAX / 8;
+
+bool IsJump(opcode op) { return op == opcode::JMP || op == opcode::JPC; }
+
+bool FallsThrough(opcode op) {
+  return op != opcode::JMP && op != opcode::RET && op != opcode::TCL;
+}
+
+bool IsVariable(opcode op) { return op == opcode::LOD || op == opcode::STO; }
+
+// operands an instruction pops and pushes
+struct Effect {
+  int pops;
+  int pushes;
+};
+
+Effect EffectOf(opcode op) {
+  switch (op) {
+    case opcode::LIT:
+    case opcode::LOD:
+    case opcode::READ:
+      return {0, 1};
+    case opcode::DUP:
+      return {1, 2};
+    case opcode::ODD:
+      return {1, 1};
+    case opcode::STO:
+    case opcode::JPC:
+    case opcode::WRITE:
+      return {1, 0};
+    case opcode::ADD:
+    case opcode::SUB:
+    case opcode::MUL:
+    case opcode::DIV:
+    case opcode::DVD:
+    case opcode::LT:
+    case opcode::LE:
+    case opcode::GT:
+    case opcode::GE:
+    case opcode::EQ:
+    case opcode::NE:
+      return {2, 1};
+    case opcode::CAL:
+    case opcode::TCL:
+    case opcode::INT:
+    case opcode::JMP:
+    case opcode::RET:
+      return {0, 0};
+#define T(name) case opcode::name:
+      SUPERINSTRUCTION_LIST(T)
+#undef T
+      break;
+  }
+  // only asked about Unfused opcodes
+  return {0, 0};
+}
+
+class Verifier {
+  const bytecode &code_;
+  const int length_;
+  std::vector<int> entries_;
+  // per procedure: its lexical level, -1 if no call reaches it, the locals
+  // its INT reserves and the procedures whose frame may be one level out
+  std::vector<int> levels_;
+  std::vector<int> locals_;
+  std::vector<std::set<int>> parents_;
+  std::map<std::pair<int, int>, int> limits_;
+  int max_depth_{0};
+
+ public:
+  explicit Verifier(const bytecode &code)
+      : code_(code), length_(static_cast<int>(code.size())) {}
+
+  void Run() {
+    Structure();
+    FindParents();
+    max_depth_ = MaxOperandDepth(code_);
+    for (size_t p = 0; p < entries_.size(); p++) {
+      if (levels_[p] < 0) { continue; }
+      CheckVariables(static_cast<int>(p));
+      CheckOperandStack(static_cast<int>(p));
+    }
+  }
+
+  // the checks the layout of the procedures depends on
+  void Structure() {
+    CheckInstructions();
+    CheckControlFlow();
+    CheckFrames();
+    AssignLevels();
+  }
+
+  [[nodiscard]] ProcedureLayout Layout() const {
+    ProcedureLayout layout;
+    layout.levels.resize(length_);
+    layout.locals.resize(length_);
+    for (int pos = 0; pos < length_; pos++) {
+      layout.levels[pos] = levels_[Owner(pos)];
+      layout.locals[pos] = locals_[Owner(pos)];
+    }
+    return layout;
+  }
+
+ private:
+  [[nodiscard]] int Owner(int pos) const {
+    return static_cast<int>(
+        std::upper_bound(entries_.begin(), entries_.end(), pos)
+        - entries_.begin() - 1);
+  }
+
+  [[nodiscard]] int End(int p) const {
+    return p + 1 < static_cast<int>(entries_.size()) ? entries_[p + 1]
+                                                     : length_;
+  }
+
+  void CheckInstructions() {
+    for (int pos = 0; pos < length_; pos++) {
+      const auto &ins = code_[pos];
+      if (static_cast<uint32_t>(ins.op) >= kOpcodeCount) {
+        throw GeneralError("unknown opcode");
+      }
+      if (!IsWellFused(code_, pos)) {
+        throw GeneralError("superinstruction without its fused sequence");
+      }
+      const auto op = Unfused(ins.op);
+      if (IsCall(op) && (ins.address < 0 || ins.address >= length_)) {
+        throw GeneralError("call outside of the code");
+      }
+      if (IsJump(op) && (ins.address < 0 || ins.address > length_)) {
+        throw GeneralError("jump outside of the code");
+      }
+    }
+  }
+
+  void CheckControlFlow() {
+    if (length_ == 0 || code_[0].op != opcode::INT) {
+      throw GeneralError("main program without INT");
+    }
+    entries_ = ProcedureEntries(code_);
+    for (int pos = 0; pos < length_; pos++) {
+      const auto &ins = code_[pos];
+      const auto op = Unfused(ins.op);
+      const int p = Owner(pos);
+      if (IsJump(op) && ins.address != length_ && Owner(ins.address) != p) {
+        throw GeneralError("jump into another procedure");
+      }
+      if (IsJump(op) && ins.address != length_
+          && code_[ins.address].op == opcode::INT) {
+        throw GeneralError("jump to an INT");
+      }
+      if (FallsThrough(op) && pos + 1 == End(p) && End(p) != length_) {
+        throw GeneralError("procedure runs into the next one");
+      }
+    }
+  }
+
+  void CheckFrames() {
+    locals_.assign(entries_.size(), 0);
+    for (int pos = 0; pos < length_; pos++) {
+      const auto &ins = code_[pos];
+      if (ins.op != opcode::INT) { continue; }
+      const int p = Owner(pos);
+      if (entries_[p] != pos) {
+        throw GeneralError("INT inside of a procedure");
+      }
+      if (ins.address < kFrameBookkeeping
+          || ins.address - kFrameBookkeeping > kMaxLocals) {
+        throw GeneralError("bad frame size");
+      }
+      locals_[p] = ins.address - kFrameBookkeeping;
+    }
+  }
+
+  // the level of the main program is 0, a call at level distance d from a
+  // procedure at level l enters l - d + 1
+  void AssignLevels() {
+    levels_.assign(entries_.size(), -1);
+    levels_[0] = 0;
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (int pos = 0; pos < length_; pos++) {
+        const auto &ins = code_[pos];
+        const int level = levels_[Owner(pos)];
+        if (!IsCall(ins.op) || level < 0) { continue; }
+        if (ins.level < (ins.op == opcode::TCL ? 1 : 0)) {
+          throw GeneralError("call into a frame that is left");
+        }
+        if (ins.level > level) {
+          throw GeneralError("call beyond the main program");
+        }
+        auto &callee = levels_[Owner(ins.address)];
+        if (callee < 0) {
+          callee = level - ins.level + 1;
+          changed = true;
+        } else if (callee != level - ins.level + 1) {
+          throw GeneralError("procedure called at different levels");
+        }
+      }
+    }
+
+    const int display_size = DisplaySize(code_, [](const Instruction &ins) {
+      return IsCall(ins.op) ? ins.address : -1;
+    });
+    if (*std::max_element(levels_.begin(), levels_.end()) >= display_size) {
+      throw GeneralError("procedure level beyond the display");
+    }
+  }
+
+  // the procedures whose frame the display may hold distance levels out of
+  // one of from
+  [[nodiscard]] std::set<int> Outer(std::set<int> from, int distance) const {
+    for (int i = 0; i < distance; i++) {
+      std::set<int> next;
+      for (int p : from) {
+        next.insert(parents_[p].begin(), parents_[p].end());
+      }
+      from = std::move(next);
+    }
+    return from;
+  }
+
+  // a call at level distance d leaves the callee the frame d levels out of
+  // the caller one level out of itself
+  void FindParents() {
+    parents_.assign(entries_.size(), {});
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (int pos = 0; pos < length_; pos++) {
+        const auto &ins = code_[pos];
+        const int caller = Owner(pos);
+        if (!IsCall(ins.op) || levels_[caller] < 0) { continue; }
+        auto &parents = parents_[Owner(ins.address)];
+        for (int p : Outer({caller}, ins.level)) {
+          changed |= parents.insert(p).second;
+        }
+      }
+    }
+  }
+
+  // locals every frame distance levels out of procedure p has
+  int Limit(int p, int distance) {
+    auto [it, inserted] = limits_.emplace(std::make_pair(p, distance), 0);
+    if (inserted) {
+      int limit = kMaxLocals;
+      for (int q : Outer({p}, distance)) {
+        limit = std::min(limit, locals_[q]);
+      }
+      it->second = limit;
+    }
+    return it->second;
+  }
+
+  void CheckVariables(int p) {
+    for (int pos = entries_[p]; pos < End(p); pos++) {
+      // a fused sequence keeps the operands of its slots
+      const auto &ins = code_[pos];
+      if (!IsVariable(Unfused(ins.op))) { continue; }
+      if (ins.level < 0 || ins.level > levels_[p]) {
+        throw GeneralError("variable beyond the main program");
+      }
+      if (ins.address < 0 || ins.address >= Limit(p, ins.level)) {
+        throw GeneralError("variable outside of its frame");
+      }
+    }
+  }
+
+  void CheckOperandStack(int p) {
+    const int entry = entries_[p];
+    const int end = End(p);
+    std::vector<int> depth(end - entry, -1);
+    std::vector<int> work;
+    auto flow = [&](int to, int height) {
+      if (to == length_) { return; }
+      auto &known = depth[to - entry];
+      if (known < 0) {
+        known = height;
+        work.push_back(to);
+      } else if (known != height) {
+        throw GeneralError("operand stack height differs where control meets");
+      }
+    };
+
+    flow(entry, 0);
+    while (!work.empty()) {
+      const int pos = work.back();
+      work.pop_back();
+      const auto &ins = code_[pos];
+      const auto op = Unfused(ins.op);
+      const auto effect = EffectOf(op);
+      const int height = depth[pos - entry];
+      if (height < effect.pops) {
+        throw GeneralError("operand stack underflow");
+      }
+      const int next = height - effect.pops + effect.pushes;
+      if (next > max_depth_) {
+        throw GeneralError("operand stack beyond its reserve");
+      }
+      if (IsJump(op)) { flow(ins.address, next); }
+      if (FallsThrough(op)) { flow(pos + 1, next); }
+    }
+  }
+};
+
+} // namespace
+
+void VerifyBytecode(const bytecode &code) {
+  Verifier(code).Run();
+}
+
+ProcedureLayout LayOutProcedures(const bytecode &code) {
+  Verifier verifier{code};
+  verifier.Structure();
+  return verifier.Layout();
+}
+
+} // namespace pl0
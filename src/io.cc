@@ -0,0 +1,170 @@
+#include "io.h"
+
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <iostream>
+
+#if PL0_BUFFERED_IO
+#include <unistd.h>
+#endif
+
+namespace pl0 {
+
+namespace {
+
+// The longest line WRITE produces is "-2147483648\n".
+constexpr int kMaxLine = 12;
+
+/**
+ * Parse an integer the way std::cin >> int does. peek returns the next byte
+ * or -1 at the end of the input, advance consumes it. A malformed integer
+ * sets failed, which makes every later call return 0.
+ */
+template<typename Peek, typename Advance>
+int ParseInteger(Peek peek, Advance advance, bool &failed) {
+  if (failed) { return 0; }
+
+  int c = peek();
+  while (c == ' ' || (c >= '\t' && c <= '\r')) {
+    advance();
+    c = peek();
+  }
+  const bool negative = c == '-';
+  if (c == '-' || c == '+') {
+    advance();
+    c = peek();
+  }
+  if (c < '0' || c > '9') {
+    failed = true;
+    return 0;
+  }
+
+  // accumulate the magnitude negated, INT_MIN has no positive counterpart
+  const int limit = negative ? INT_MIN : -INT_MAX;
+  int value = 0;
+  bool overflow = false;
+  do {
+    const int digit = c - '0';
+    if (value < (limit + digit) / 10) {
+      overflow = true;
+    } else {
+      value = value * 10 - digit;
+    }
+    advance();
+    c = peek();
+  } while (c >= '0' && c <= '9');
+
+  if (overflow) {
+    failed = true;
+    return negative ? INT_MIN : INT_MAX;
+  }
+  return negative ? value : -value;
+}
+
+// Write the line of value to out, which has room for kMaxLine bytes.
+char *FormatLine(char *out, int value) {
+  out = std::to_chars(out, out + kMaxLine - 1, value).ptr;
+  *out++ = '\n';
+  return out;
+}
+
+} // namespace
+
+int StreamIo::Read() {
+  int tmp = 0;
+  std::cin >> tmp;
+  return tmp;
+}
+
+void StreamIo::Write(int value) {
+  std::cout << value << '\n';
+}
+
+void StreamIo::Flush() {
+  std::cout.flush();
+}
+
+#if PL0_BUFFERED_IO
+
+BufferedIo::BufferedIo(int input_fd, int output_fd)
+    : input_fd_(input_fd),
+      output_fd_(output_fd),
+      input_(new char[kBufferSize]),
+      output_(new char[kBufferSize]),
+      interactive_(isatty(input_fd) != 0) {}
+
+BufferedIo::~BufferedIo() {
+  Flush();
+}
+
+int BufferedIo::Peek() {
+  if (input_begin_ == input_end_) {
+    ssize_t count;
+    do {
+      count = read(input_fd_, input_.get(), kBufferSize);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) { return -1; }
+    input_begin_ = 0;
+    input_end_ = static_cast<int>(count);
+  }
+  return static_cast<unsigned char>(input_[input_begin_]);
+}
+
+int BufferedIo::Read() {
+  if (interactive_) { Flush(); }
+  return ParseInteger(
+      [this] { return Peek(); }, [this] { input_begin_++; }, failed_);
+}
+
+void BufferedIo::Write(int value) {
+  if (kBufferSize - output_size_ < kMaxLine) { Flush(); }
+  char *end = FormatLine(output_.get() + output_size_, value);
+  output_size_ = static_cast<int>(end - output_.get());
+}
+
+void BufferedIo::Flush() {
+  const char *data = output_.get();
+  while (output_size_ > 0) {
+    const ssize_t count = write(output_fd_, data, output_size_);
+    if (count < 0 && errno == EINTR) { continue; }
+    // like a stream in a bad state, output that cannot be written is dropped
+    if (count <= 0) { break; }
+    data += count;
+    output_size_ -= static_cast<int>(count);
+  }
+  output_size_ = 0;
+}
+
+#endif
+
+int MemoryIo::Read() {
+  return ParseInteger(
+      [this] {
+        return position_ < input_.size()
+                   ? static_cast<unsigned char>(input_[position_])
+                   : -1;
+      },
+      [this] { position_++; }, failed_);
+}
+
+void MemoryIo::Write(int value) {
+  char line[kMaxLine];
+  output_.append(line, FormatLine(line, value));
+}
+
+std::unique_ptr<Io> MakeIo(IoMode mode) {
+#if PL0_BUFFERED_IO
+  if (mode == IoMode::kBuffered) { return std::make_unique<BufferedIo>(); }
+#else
+  (void)mode;
+#endif
+  return std::make_unique<StreamIo>();
+}
+
+Io &StandardIo() {
+  static StreamIo io;
+  return io;
+}
+
+} // namespace pl0
@@ -0,0 +1,493 @@
+#include "ir/builder.h"
+
+#include <algorithm>
+#include <deque>
+
+namespace pl0::ir {
+
+namespace {
+
+// the procedures declared in node, each one followed by its own
+void Declarations(
+    ast::Block *node, std::vector<ast::ProcedureDeclaration *> &result) {
+  for (auto *method : node->sub_procedures()) {
+    result.push_back(method);
+    Declarations(method->main_block(), result);
+  }
+}
+
+// Walks the code of the functions the way Builder builds them, expanding the
+// same calls, to find the procedures called and the variables some function
+// reaches in a frame other than its own.
+class Reach : public ast::AstVisitor<Reach> {
+ public:
+  explicit Reach(ast::Inliner *inliner) : inliner_(inliner) {}
+
+  void Scan(ast::Block *function) {
+    level_ = function->belonging_scope()->level();
+    scope_ = function->belonging_scope();
+    loop_depth_ = 0;
+    Visit(function->body());
+  }
+
+  // each one once, in the order they are found
+  std::deque<Procedure *> &called() { return called_; }
+  [[nodiscard]] bool IsCalled(Procedure *procedure) const {
+    return seen_.count(procedure) != 0;
+  }
+  std::unordered_set<Variable *> &escaping() { return escaping_; }
+
+  DECLARE_VISIT_METHODS
+
+ private:
+  DEFINE_AST_VISITOR_SUBCLASS_MEMBERS
+
+  void Use(ast::VariableProxy *node) {
+    auto *sym = node->target();
+    if (!sym->IsVariable()) { return; }
+    auto *var = dynamic_cast<Variable *>(sym);
+    if (var->level() < level_ && moved_.count(var) == 0) {
+      escaping_.insert(var);
+    }
+  }
+
+  ast::Inliner *inliner_;
+  int level_{0};
+  Scope *scope_{nullptr};
+  int loop_depth_{0};
+  std::deque<Procedure *> called_;
+  std::unordered_set<Procedure *> seen_;
+  std::unordered_set<Variable *> escaping_;
+  // locals of the procedures expanded somewhere
+  std::unordered_set<Variable *> moved_;
+};
+
+void Reach::VisitVariableDeclaration(ast::VariableDeclaration * /*node*/) {}
+
+void Reach::VisitConstantDeclaration(ast::ConstantDeclaration * /*node*/) {}
+
+void Reach::VisitProcedureDeclaration(ast::ProcedureDeclaration * /*node*/) {}
+
+void Reach::VisitBlock(ast::Block *node) {
+  auto *enclosing = scope_;
+  scope_ = node->belonging_scope();
+  Visit(node->body());
+  scope_ = enclosing;
+}
+
+void Reach::VisitStatementList(ast::StatementList *node) {
+  for (auto *statement : node->statements()) { Visit(statement); }
+}
+
+void Reach::VisitIfStatement(ast::IfStatement *node) {
+  Visit(node->condition());
+  Visit(node->then_statement());
+  if (node->has_else_statement()) { Visit(node->else_statement()); }
+}
+
+void Reach::VisitWhileStatement(ast::WhileStatement *node) {
+  Visit(node->cond());
+  loop_depth_++;
+  Visit(node->body());
+  loop_depth_--;
+}
+
+void Reach::VisitCallStatement(ast::CallStatement *node) {
+  auto *sym = scope_->Resolve(node->callee());
+  // Builder reports calls of anything else
+  if (sym == nullptr || !sym->IsProcedure()) { return; }
+  auto *callee = dynamic_cast<Procedure *>(sym);
+  if (inliner_ != nullptr) {
+    if (auto *body = inliner_->Expansion(callee, loop_depth_)) {
+      // its locals move into the frame it is expanded into
+      if (auto *var_declaration = body->var_declaration()) {
+        for (auto *var : var_declaration->variables()) { moved_.insert(var); }
+      }
+      VisitBlock(body);
+      return;
+    }
+  }
+  if (seen_.insert(callee).second) { called_.push_back(callee); }
+}
+
+void Reach::VisitReadStatement(ast::ReadStatement *node) {
+  for (auto *target : node->targets()) { Use(target); }
+}
+
+void Reach::VisitWriteStatement(ast::WriteStatement *node) {
+  for (auto *expr : node->expressions()) { Visit(expr); }
+}
+
+void Reach::VisitAssignStatement(ast::AssignStatement *node) {
+  Use(node->target());
+  Visit(node->expr());
+}
+
+void Reach::VisitReturnStatement(ast::ReturnStatement * /*node*/) {}
+
+void Reach::VisitBinaryOperation(ast::BinaryOperation *node) {
+  Visit(node->left());
+  Visit(node->right());
+}
+
+void Reach::VisitUnaryOperation(ast::UnaryOperation *node) {
+  Visit(node->expr());
+}
+
+void Reach::VisitLiteral(ast::Literal * /*node*/) {}
+
+void Reach::VisitVariableProxy(ast::VariableProxy *node) { Use(node); }
+
+} // namespace
+
+std::unique_ptr<Module> Builder::Build(ast::Block *program) {
+  if (inlining_) { inliner_ = std::make_unique<ast::Inliner>(program); }
+  std::vector<ast::ProcedureDeclaration *> declarations;
+  Declarations(program, declarations);
+  std::unordered_map<Procedure *, ast::Block *> bodies;
+  for (auto *method : declarations) {
+    bodies[method->symbol()] = method->main_block();
+  }
+
+  Reach reach{inliner_.get()};
+  reach.Scan(program);
+  if (!lazy_) {
+    for (auto *method : declarations) { reach.Scan(method->main_block()); }
+  }
+  auto &called = reach.called();
+  while (!called.empty()) {
+    reach.Scan(bodies[called.front()]);
+    called.pop_front();
+  }
+  escaping_ = std::move(reach.escaping());
+
+  module_ = std::make_unique<Module>();
+  BuildFunction(nullptr, program);
+  for (auto *method : declarations) {
+    if (!lazy_ || reach.IsCalled(method->symbol())) {
+      BuildFunction(method->symbol(), method->main_block());
+    }
+  }
+  return std::move(module_);
+}
+
+void Builder::BuildFunction(Procedure *symbol, ast::Block *block) {
+  function_ = module_->NewFunction(symbol, block->belonging_scope());
+  lexical_scope_ = block->belonging_scope();
+  loop_depth_ = 0;
+  definitions_.clear();
+  sealed_.clear();
+  incomplete_phis_.clear();
+
+  block_ = function_->NewBlock();
+  Seal(block_);
+  // the frame starts out cleared
+  if (auto *var_declaration = block->var_declaration()) {
+    auto *zero = Const(0);
+    for (auto *var : var_declaration->variables()) {
+      if (escaping_.count(var) == 0) {
+        WriteVariable(var, block_, zero);
+      } else {
+        function_->Reserve(var->index());
+      }
+    }
+  }
+  Visit(block->body());
+  Append(Opcode::kReturn);
+}
+
+// The body of callee in the current function, its locals cleared first as
+// the frame of a call would be. No other function sees them, the callee
+// declaring no procedures.
+void Builder::Expand(ast::Block *callee) {
+  if (auto *var_declaration = callee->var_declaration()) {
+    auto *zero = Const(0);
+    for (auto *var : var_declaration->variables()) {
+      WriteVariable(var, block_, zero);
+    }
+  }
+  auto *lexical_scope = lexical_scope_;
+  lexical_scope_ = callee->belonging_scope();
+  Visit(callee->body());
+  lexical_scope_ = lexical_scope;
+}
+
+Procedure *Builder::ResolveCallee(ast::CallStatement *node) {
+  auto *sym = lexical_scope_->Resolve(node->callee());
+  if (sym == nullptr) {
+    throw GeneralError(
+        "no procedure named \"" + node->callee() + "\" to be called");
+  }
+  if (!sym->IsProcedure()) {
+    throw GeneralError(node->callee() + " is not a procedure");
+  }
+  return dynamic_cast<Procedure *>(sym);
+}
+
+void Builder::Enter(BasicBlock *block) {
+  function_->MoveToEnd(block);
+  block_ = block;
+}
+
+Instruction *Builder::Evaluate(ast::Expression *node) {
+  Visit(node);
+  return value_;
+}
+
+void Builder::Assign(ast::VariableProxy *target, Instruction *value) {
+  auto *sym = target->target();
+  if (sym->IsVariable()) {
+    auto *var = dynamic_cast<Variable *>(sym);
+    if (escaping_.count(var) == 0) {
+      WriteVariable(var, block_, value);
+    } else {
+      Append(Opcode::kStore, {value})->set_variable(var);
+    }
+  } else if (sym->IsConstant()) {
+    throw GeneralError("constant " + sym->name() + " is not assignable");
+  } else {
+    throw GeneralError("procedure " + sym->name() + " is not assignable");
+  }
+}
+
+Instruction *Builder::Append(Opcode op, std::vector<Instruction *> operands) {
+  auto *instruction = function_->New(op, std::move(operands));
+  block_->Append(instruction);
+  return instruction;
+}
+
+Instruction *Builder::Const(int value) {
+  auto *constant = Append(Opcode::kConst);
+  constant->set_value(value);
+  return constant;
+}
+
+void Builder::Jump(BasicBlock *target) {
+  Append(Opcode::kJump)->set_targets({target});
+  target->AddPredecessor(block_);
+}
+
+void Builder::Branch(
+    Instruction *cond, BasicBlock *on_true, BasicBlock *on_false) {
+  Append(Opcode::kBranch, {cond})->set_targets({on_true, on_false});
+  on_true->AddPredecessor(block_);
+  on_false->AddPredecessor(block_);
+}
+
+void Builder::StartUnreachable() {
+  block_ = function_->NewBlock();
+  Seal(block_);
+}
+
+void Builder::WriteVariable(
+    Variable *var, BasicBlock *block, Instruction *value) {
+  definitions_[block][var] = value;
+}
+
+Instruction *Builder::ReadVariable(Variable *var, BasicBlock *block) {
+  auto &definitions = definitions_[block];
+  if (auto iter = definitions.find(var); iter != definitions.end()) {
+    return iter->second;
+  }
+  return ReadVariableRecursive(var, block);
+}
+
+Instruction *Builder::ReadVariableRecursive(Variable *var, BasicBlock *block) {
+  Instruction *value = nullptr;
+  if (sealed_.count(block) == 0) {
+    // operands follow once all predecessors are known
+    value = function_->New(Opcode::kPhi);
+    block->Append(value);
+    incomplete_phis_[block].emplace_back(var, value);
+  } else if (block->predecessors().size() == 1) {
+    value = ReadVariable(var, block->predecessors().front());
+  } else if (block->predecessors().empty()) {
+    // only in code following a return, whatever value does
+    value = function_->New(Opcode::kConst);
+    block->Insert(block->phi_count(), value);
+  } else {
+    // a phi breaks cycles through loops
+    value = function_->New(Opcode::kPhi);
+    block->Append(value);
+    WriteVariable(var, block, value);
+    value = AddPhiOperands(var, value);
+  }
+  WriteVariable(var, block, value);
+  return value;
+}
+
+Instruction *Builder::AddPhiOperands(Variable *var, Instruction *phi) {
+  for (auto *pred : phi->block()->predecessors()) {
+    phi->AddOperand(ReadVariable(var, pred));
+  }
+  return TryRemoveTrivialPhi(phi);
+}
+
+// A phi whose operands are itself and one other value is that value.
+Instruction *Builder::TryRemoveTrivialPhi(Instruction *phi) {
+  Instruction *same = nullptr;
+  for (auto *operand : phi->operands()) {
+    if (operand == same || operand == phi) { continue; }
+    if (same != nullptr) { return phi; }
+    same = operand;
+  }
+  auto *block = phi->block();
+  if (same == nullptr) {
+    // unreachable, or only reached from itself
+    same = function_->New(Opcode::kConst);
+    block->Insert(block->phi_count(), same);
+  }
+
+  std::vector<Instruction *> users;
+  for (auto *other : function_->blocks()) {
+    for (auto *instruction : other->instructions()) {
+      if (instruction == phi || instruction->op() != Opcode::kPhi) { continue; }
+      const auto &operands = instruction->operands();
+      if (std::find(operands.begin(), operands.end(), phi) != operands.end()) {
+        users.push_back(instruction);
+      }
+    }
+  }
+  block->Remove(phi);
+  function_->ReplaceAllUses(phi, same);
+  for (auto &definitions : definitions_) {
+    for (auto &definition : definitions.second) {
+      if (definition.second == phi) { definition.second = same; }
+    }
+  }
+  for (auto *user : users) {
+    if (user->block() != nullptr) { TryRemoveTrivialPhi(user); }
+  }
+  return same;
+}
+
+void Builder::Seal(BasicBlock *block) {
+  for (auto [var, phi] : incomplete_phis_[block]) { AddPhiOperands(var, phi); }
+  incomplete_phis_.erase(block);
+  sealed_.insert(block);
+}
+
+void Builder::VisitVariableDeclaration(ast::VariableDeclaration * /*node*/) {}
+
+void Builder::VisitConstantDeclaration(ast::ConstantDeclaration * /*node*/) {}
+
+void Builder::VisitProcedureDeclaration(ast::ProcedureDeclaration * /*node*/) {
+}
+
+void Builder::VisitBlock(ast::Block *node) { Visit(node->body()); }
+
+void Builder::VisitStatementList(ast::StatementList *node) {
+  for (auto *statement : node->statements()) { Visit(statement); }
+}
+
+void Builder::VisitIfStatement(ast::IfStatement *node) {
+  auto *cond = Evaluate(node->condition());
+  auto *then_block = function_->NewBlock();
+  auto *else_block =
+      node->has_else_statement() ? function_->NewBlock() : nullptr;
+  auto *end = function_->NewBlock();
+  Branch(cond, then_block, else_block != nullptr ? else_block : end);
+  Seal(then_block);
+  Enter(then_block);
+  Visit(node->then_statement());
+  Jump(end);
+  if (else_block != nullptr) {
+    Seal(else_block);
+    Enter(else_block);
+    Visit(node->else_statement());
+    Jump(end);
+  }
+  Seal(end);
+  Enter(end);
+}
+
+void Builder::VisitWhileStatement(ast::WhileStatement *node) {
+  auto *header = function_->NewBlock();
+  auto *body = function_->NewBlock();
+  auto *exit = function_->NewBlock();
+  Jump(header);
+  // the back edge is not known yet
+  Enter(header);
+  // a condition folded to true needs no test
+  auto *literal = dynamic_cast<ast::Literal *>(node->cond());
+  if (literal == nullptr || literal->value() == 0) {
+    Branch(Evaluate(node->cond()), body, exit);
+  } else {
+    Jump(body);
+  }
+  Seal(body);
+  Enter(body);
+  loop_depth_++;
+  Visit(node->body());
+  loop_depth_--;
+  Jump(header);
+  Seal(header);
+  Seal(exit);
+  Enter(exit);
+}
+
+void Builder::VisitCallStatement(ast::CallStatement *node) {
+  auto *method = ResolveCallee(node);
+  if (inliner_ != nullptr) {
+    if (auto *body = inliner_->Expansion(method, loop_depth_)) {
+      Expand(body);
+      return;
+    }
+  }
+  Append(Opcode::kCall)->set_callee(method);
+}
+
+void Builder::VisitReadStatement(ast::ReadStatement *node) {
+  for (auto *target : node->targets()) {
+    Assign(target, Append(Opcode::kRead));
+  }
+}
+
+void Builder::VisitWriteStatement(ast::WriteStatement *node) {
+  for (auto *expr : node->expressions()) {
+    Append(Opcode::kWrite, {Evaluate(expr)});
+  }
+}
+
+void Builder::VisitAssignStatement(ast::AssignStatement *node) {
+  Assign(node->target(), Evaluate(node->expr()));
+}
+
+void Builder::VisitReturnStatement(ast::ReturnStatement * /*node*/) {
+  Append(Opcode::kReturn);
+  StartUnreachable();
+}
+
+void Builder::VisitBinaryOperation(ast::BinaryOperation *node) {
+  auto *left = Evaluate(node->left());
+  auto *right = Evaluate(node->right());
+  value_ = Append(BinaryOf(node->op()), {left, right});
+}
+
+void Builder::VisitUnaryOperation(ast::UnaryOperation *node) {
+  value_ = Append(Opcode::kOdd, {Evaluate(node->expr())});
+}
+
+void Builder::VisitLiteral(ast::Literal *node) {
+  value_ = Const(node->value());
+}
+
+void Builder::VisitVariableProxy(ast::VariableProxy *node) {
+  auto *sym = node->target();
+  if (sym->IsVariable()) {
+    auto *var = dynamic_cast<Variable *>(sym);
+    if (escaping_.count(var) == 0) {
+      value_ = ReadVariable(var, block_);
+    } else {
+      value_ = Append(Opcode::kLoad);
+      value_->set_variable(var);
+    }
+  } else if (sym->IsConstant()) {
+    value_ = Const(dynamic_cast<pl0::Constant *>(sym)->value());
+  } else {
+    throw GeneralError(
+        sym->name() + " is a procedure so that cannot be used in expression");
+  }
+}
+
+} // namespace pl0::ir
@@ -0,0 +1,434 @@
+#include "ir/closed_form.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "ir/loops.h"
+#include "util.h"
+
+namespace pl0::ir {
+
+namespace {
+
+struct ById {
+  bool operator()(const Instruction *a, const Instruction *b) const {
+    return (a != nullptr ? a->id() : -1) < (b != nullptr ? b->id() : -1);
+  }
+};
+
+// a sum of values defined before the loop times constants, the constant term
+// under nullptr; coefficients wrap like the arithmetic they stand for, and
+// are ordered by id so that the code made from them is always the same
+using Term = std::map<Instruction *, uint32_t, ById>;
+
+void Accumulate(Term &sum, const Term &term, uint32_t factor) {
+  for (const auto &[value, coefficient] : term) {
+    auto &entry = sum[value];
+    entry += coefficient * factor;
+    if (entry == 0) { sum.erase(value); }
+  }
+}
+
+bool IsConstant(const Term &term) {
+  return term.empty() || (term.size() == 1 && term.begin()->first == nullptr);
+}
+
+// of a constant term
+uint32_t ValueOf(const Term &term) {
+  return term.empty() ? 0 : term.begin()->second;
+}
+
+Term TermOf(Instruction *value) {
+  if (!value->IsConstant()) { return {{value, 1}}; }
+  if (value->value() == 0) { return {}; }
+  return {{nullptr, static_cast<uint32_t>(value->value())}};
+}
+
+// a value on iteration t of the loop, counting from 0: base + slope * t,
+// plus self times the value the phi being summarized has on it
+struct Affine {
+  Term base;
+  Term slope;
+  uint32_t self{0};
+
+  [[nodiscard]] bool IsConstant() const {
+    return slope.empty() && self == 0 && ir::IsConstant(base);
+  }
+};
+
+// a + factor * b
+Affine Combine(const Affine &a, const Affine &b, uint32_t factor) {
+  Affine sum = a;
+  Accumulate(sum.base, b.base, factor);
+  Accumulate(sum.slope, b.slope, factor);
+  sum.self += b.self * factor;
+  return sum;
+}
+
+class Evaluator {
+ public:
+  explicit Evaluator(const Loop &loop) : loop_(loop) {}
+
+  // nothing if value is not affine in the iteration and self
+  [[nodiscard]] std::optional<Affine> Evaluate(Instruction *value,
+                                               Instruction *self) const {
+    Affine result;
+    if (value == self) {
+      result.self = 1;
+      return result;
+    }
+    if (value->IsConstant() || !loop_.Contains(value->block())) {
+      result.base = TermOf(value);
+      return result;
+    }
+    auto iter = inductions.find(value);
+    if (iter != inductions.end()) { return iter->second; }
+
+    const auto op = value->op();
+    if (op != Opcode::kAdd && op != Opcode::kSub && op != Opcode::kMul) {
+      return std::nullopt;
+    }
+    auto a = Evaluate(value->operand(0), self);
+    auto b = Evaluate(value->operand(1), self);
+    if (!a || !b) { return std::nullopt; }
+    if (op == Opcode::kAdd) { return Combine(*a, *b, 1); }
+    if (op == Opcode::kSub) { return Combine(*a, *b, UINT32_MAX); }
+    if (b->IsConstant()) { return Combine({}, *a, ValueOf(b->base)); }
+    if (a->IsConstant()) { return Combine({}, *b, ValueOf(a->base)); }
+    return std::nullopt;
+  }
+
+  // the value of each on iteration t
+  std::unordered_map<Instruction *, Affine> inductions;
+
+ private:
+  const Loop &loop_;
+};
+
+int Fold(Opcode op, int a, int b) {
+  switch (op) {
+    case Opcode::kAdd:
+      return Wrap(int64_t{a} + b);
+    case Opcode::kSub:
+      return Wrap(int64_t{a} - b);
+    case Opcode::kMul:
+      return Wrap(int64_t{a} * b);
+    case Opcode::kDiv:
+      return a / b;
+    case Opcode::kLt:
+      return a < b;
+    case Opcode::kLe:
+      return a <= b;
+    case Opcode::kGt:
+      return a > b;
+    case Opcode::kGe:
+      return a >= b;
+    default:
+      throw GeneralError("cannot fold ", *op);
+  }
+}
+
+// appends to a block what it is asked for, folding what it can
+class Emitter {
+ public:
+  Emitter(Function &function, BasicBlock *block)
+      : function_(function), block_(block) {}
+
+  Instruction *Constant(int64_t value) {
+    auto *constant = Append(Opcode::kConst, {});
+    constant->set_value(static_cast<int>(value));
+    return constant;
+  }
+  // a copy of a constant, which may be defined in the loop
+  Instruction *Use(Instruction *value) {
+    return value->IsConstant() ? Constant(value->value()) : value;
+  }
+
+  Instruction *Append(Opcode op, std::vector<Instruction *> operands) {
+    auto *instruction = function_.New(op, std::move(operands));
+    block_->Append(instruction);
+    return instruction;
+  }
+
+  // divisions by constants other than 0 and -1 only
+  Instruction *Binary(Opcode op, Instruction *a, Instruction *b) {
+    if (a->IsConstant() && b->IsConstant()) {
+      return Constant(Fold(op, a->value(), b->value()));
+    }
+    const bool one = b->IsConstant() && b->value() == 1;
+    const bool zero = b->IsConstant() && b->value() == 0;
+    switch (op) {
+      case Opcode::kAdd:
+        if (a->IsConstant() && a->value() == 0) { return b; }
+        [[fallthrough]];
+      case Opcode::kSub:
+        if (zero) { return a; }
+        break;
+      case Opcode::kMul:
+        if (a->IsConstant()) { std::swap(a, b); }
+        if (b->IsConstant() && b->value() == 0) { return b; }
+        if (b->IsConstant() && b->value() == 1) { return a; }
+        break;
+      case Opcode::kDiv:
+        if (one) { return a; }
+        break;
+      case Opcode::kLe:
+        if (b->IsConstant() && b->value() == INT_MAX) { return Constant(1); }
+        break;
+      case Opcode::kGe:
+        if (b->IsConstant() && b->value() == INT_MIN) { return Constant(1); }
+        break;
+      default:
+        break;
+    }
+    return Append(op, {a, b});
+  }
+
+  Instruction *Odd(Instruction *a) {
+    if (a->IsConstant()) { return Constant(a->value() & 1); }
+    return Append(Opcode::kOdd, {a});
+  }
+
+  // of two truth values, not 0 if either is
+  Instruction *Or(Instruction *a, Instruction *b) {
+    for (auto *known : {a, b}) {
+      if (known->IsConstant()) {
+        return known->value() != 0 ? known : (known == a ? b : a);
+      }
+    }
+    return Append(Opcode::kAdd, {a, b});
+  }
+
+  Instruction *Sum(const Term &term) {
+    Instruction *sum = nullptr;
+    for (const auto &[value, coefficient] : term) {
+      auto *factor = Constant(static_cast<int>(coefficient));
+      auto *part =
+          value == nullptr ? factor : Binary(Opcode::kMul, value, factor);
+      sum = sum == nullptr ? part : Binary(Opcode::kAdd, sum, part);
+    }
+    return sum != nullptr ? sum : Constant(0);
+  }
+
+ private:
+  Function &function_;
+  BasicBlock *block_;
+};
+
+// whether the function changed
+bool Summarize(Function &function, const Dominators &dominators,
+               const Loop &loop) {
+  auto counted = AsCounted(loop, dominators);
+  if (!counted) { return false; }
+  auto *header = loop.header;
+  const size_t entry = counted->entry;
+  const size_t back = counted->back;
+
+  // to no effect
+  for (auto *block : loop.blocks) {
+    for (auto *instruction : block->instructions()) {
+      if ((instruction->HasSideEffects() && !instruction->IsTerminator())
+          || instruction->MayTrap()) {
+        return false;
+      }
+    }
+  }
+
+  // the phis of the header used after the loop, and nothing else
+  std::vector<Instruction *> results;
+  for (auto *block : function.blocks()) {
+    if (loop.Contains(block)) { continue; }
+    for (auto *instruction : block->instructions()) {
+      for (auto *operand : instruction->operands()) {
+        // constants are pushed wherever they are used
+        if (operand->IsConstant() || !loop.Contains(operand->block())) {
+          continue;
+        }
+        if (operand->block() != header || operand->op() != Opcode::kPhi) {
+          return false;
+        }
+        if (std::find(results.begin(), results.end(), operand)
+            == results.end()) {
+          results.push_back(operand);
+        }
+      }
+    }
+  }
+
+  // induction variables first, the others may be stepped by them
+  Evaluator evaluator(loop);
+  const auto &instructions = header->instructions();
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t p = 0; p < header->phi_count(); p++) {
+      auto *phi = instructions[p];
+      if (evaluator.inductions.count(phi) != 0) { continue; }
+      auto next = evaluator.Evaluate(phi->operand(back), phi);
+      if (!next || next->self != 1 || !next->slope.empty()) { continue; }
+      Affine value;
+      value.base = TermOf(phi->operand(entry));
+      value.slope = next->base;
+      evaluator.inductions[phi] = value;
+      changed = true;
+    }
+  }
+
+  // what each result gains on iteration t
+  std::vector<Affine> gains;
+  bool quadratic = false;
+  for (auto *phi : results) {
+    auto next = evaluator.Evaluate(phi->operand(back), phi);
+    if (!next || next->self != 1) { return false; }
+    next->self = 0;
+    quadratic = quadratic || !next->slope.empty();
+    gains.push_back(*next);
+  }
+
+  auto *counter = counted->counter;
+  const int step = counted->step;
+  const bool up = step > 0;
+  const bool until = counted->op == Opcode::kNe;
+  const bool inclusive =
+      counted->op == Opcode::kLe || counted->op == Opcode::kGe;
+  const int64_t stride = up ? int64_t{step} : -int64_t{step};
+
+  auto *preheader = Preheader(function, loop);
+  Emitter before(function, preheader);
+  auto *start = before.Use(counter->operand(entry));
+  auto *limit = before.Use(counted->bound);
+  Instruction *guard;
+  if (until) {
+    // from the wrong side it would go all the way around
+    guard = before.Binary(up ? Opcode::kLe : Opcode::kGe, start, limit);
+  } else {
+    // it is stepped once more after the last value before the limit
+    const int64_t last = up ? INT_MAX - stride + (inclusive ? 0 : 1)
+                            : INT_MIN + stride - (inclusive ? 0 : 1);
+    guard = before.Binary(
+        up ? Opcode::kLe : Opcode::kGe, limit, before.Constant(last));
+    if (inclusive) {
+      limit = before.Binary(
+          up ? Opcode::kAdd : Opcode::kSub, limit, before.Constant(1));
+    }
+  }
+  // the distance fits as long as both are on the same side of 0
+  auto *zero = before.Constant(0);
+  auto *fits = up ? before.Or(before.Binary(Opcode::kGe, start, zero),
+                              before.Binary(Opcode::kLt, limit, zero))
+                  : before.Or(before.Binary(Opcode::kLt, start, zero),
+                              before.Binary(Opcode::kGe, limit, zero));
+  guard = before.Binary(Opcode::kMul, guard, fits);
+  if (guard->IsConstant() && guard->value() == 0) { return true; }
+
+  auto *exit = counted->exit;
+  auto *closed = function.NewBlockBefore(exit);
+  auto *join = function.NewBlockBefore(exit);
+  Emitter after(function, closed);
+  Instruction *count = after.Binary(
+      Opcode::kSub, up ? limit : start, up ? start : limit);
+  if (!until) {
+    // as many as there are multiples of the stride short of the distance,
+    // none if the loop is not entered
+    if (stride != 1) {
+      count = after.Binary(
+          Opcode::kAdd,
+          after.Binary(Opcode::kDiv,
+                       after.Binary(Opcode::kSub, count, after.Constant(1)),
+                       after.Constant(stride)),
+          after.Constant(1));
+    }
+    auto *entered = after.Binary(
+        up ? Opcode::kLt : Opcode::kGt, start, limit);
+    count = after.Binary(Opcode::kMul, entered, count);
+  }
+  Instruction *pairs = nullptr;
+  if (quadratic) {
+    // the sum of 0 to count - 1, halving the even factor first, whichever
+    // it is: count / 2 * (count - 1 + count % 2)
+    auto *one = after.Constant(1);
+    auto *odd = after.Odd(count);
+    pairs = after.Binary(
+        Opcode::kMul, after.Binary(Opcode::kDiv, count, after.Constant(2)),
+        after.Binary(
+            Opcode::kAdd, after.Binary(Opcode::kSub, count, one), odd));
+  }
+  std::unordered_map<Instruction *, Instruction *> merged;
+  for (size_t r = 0; r < results.size(); r++) {
+    auto *phi = results[r];
+    const auto &gain = gains[r];
+    auto *value = after.Binary(
+        Opcode::kAdd, after.Use(phi->operand(entry)),
+        after.Binary(Opcode::kMul, count, after.Sum(gain.base)));
+    if (!gain.slope.empty()) {
+      value = after.Binary(Opcode::kAdd, value,
+                           after.Binary(Opcode::kMul, pairs,
+                                        after.Sum(gain.slope)));
+    }
+    auto *join_phi = function.New(Opcode::kPhi, {phi, value});
+    join->Append(join_phi);
+    merged[phi] = join_phi;
+  }
+  auto *jump = function.New(Opcode::kJump);
+  jump->set_targets({join});
+  closed->Append(jump);
+  jump = function.New(Opcode::kJump);
+  jump->set_targets({exit});
+  join->Append(jump);
+
+  for (auto *block : function.blocks()) {
+    if (loop.Contains(block) || block == join) { continue; }
+    for (auto *instruction : block->instructions()) {
+      for (size_t i = 0; i < instruction->operands().size(); i++) {
+        auto found = merged.find(instruction->operand(i));
+        if (found != merged.end()) {
+          instruction->set_operand(i, found->second);
+        }
+      }
+    }
+  }
+  auto *branch = header->terminator();
+  branch->set_target(branch->targets()[0] == exit ? 0 : 1, join);
+  exit->ReplacePredecessor(header, join);
+  join->set_predecessors({header, closed});
+
+  auto *enter = preheader->terminator();
+  if (guard->IsConstant()) {
+    // the loop is left to SimplifyCfg
+    enter->set_target(0, closed);
+    header->RemovePredecessor(preheader);
+  } else {
+    auto *test = function.New(Opcode::kBranch, {guard});
+    test->set_targets({closed, header});
+    preheader->Remove(enter);
+    preheader->Append(test);
+  }
+  closed->AddPredecessor(preheader);
+  return true;
+}
+
+} // namespace
+
+bool ClosedForm::Run(Function &function) {
+  done_.clear();
+  bool changed = false;
+  for (bool again = true; again;) {
+    again = false;
+    const Dominators dominators(function);
+    for (const auto &loop : FindLoops(dominators)) {
+      if (done_.count(loop.header) != 0) { continue; }
+      if (Summarize(function, dominators, loop)) {
+        done_.insert(loop.header);
+        again = changed = true;
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+} // namespace pl0::ir
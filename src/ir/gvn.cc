@@ -0,0 +1,146 @@
+#include "ir/gvn.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace pl0::ir {
+
+namespace {
+
+bool IsCommutative(Opcode op) {
+  return op == Opcode::kAdd || op == Opcode::kMul || op == Opcode::kEq
+         || op == Opcode::kNe;
+}
+
+void KillCall(const ModRef &mod_ref, Procedure *callee,
+              std::unordered_map<Variable *, Instruction *> &memory) {
+  for (auto iter = memory.begin(); iter != memory.end();) {
+    if (mod_ref.Modifies(callee, iter->first)) {
+      iter = memory.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+} // namespace
+
+void GlobalValueNumbering::Initialize(Module &module) {
+  mod_ref_ = std::make_unique<ModRef>(module);
+}
+
+bool GlobalValueNumbering::Run(Function &function) {
+  dominators_ = std::make_unique<Dominators>(function);
+  children_.clear();
+  replaced_.clear();
+  for (auto *block : dominators_->order()) {
+    if (auto *idom = dominators_->ImmediateDominator(block)) {
+      children_[idom].push_back(block);
+    }
+  }
+  Visit(function.entry(), {}, {});
+  if (replaced_.empty()) { return false; }
+
+  // the phis of loop headers were visited before what comes along the
+  // back edges
+  for (auto *block : function.blocks()) {
+    for (auto *instruction : block->instructions()) {
+      for (size_t i = 0; i < instruction->operands().size(); i++) {
+        instruction->set_operand(i, Find(instruction->operand(i)));
+      }
+    }
+  }
+  return true;
+}
+
+void GlobalValueNumbering::Visit(BasicBlock *block, ValueTable values,
+                                 MemoryTable memory) {
+  if (block->predecessors().size() > 1) { Kill(block, memory); }
+  const auto instructions = block->instructions();
+  for (auto *instruction : instructions) {
+    for (size_t i = 0; i < instruction->operands().size(); i++) {
+      instruction->set_operand(i, Find(instruction->operand(i)));
+    }
+    const auto op = instruction->op();
+    Instruction *same = nullptr;
+    if (op == Opcode::kLoad) {
+      auto iter = memory.find(instruction->variable());
+      if (iter != memory.end()) {
+        same = iter->second;
+      } else {
+        memory[instruction->variable()] = instruction;
+      }
+    } else if (op == Opcode::kStore) {
+      memory[instruction->variable()] = instruction->operand(0);
+    } else if (op == Opcode::kCall) {
+      KillCall(*mod_ref_, instruction->callee(), memory);
+    } else if (IsBinary(op) || op == Opcode::kOdd
+               || op == Opcode::kDivisible) {
+      auto [iter, inserted] = values.emplace(KeyOf(instruction), instruction);
+      if (!inserted) { same = iter->second; }
+    }
+    if (same != nullptr) {
+      replaced_[instruction] = same;
+      block->Remove(instruction);
+    }
+  }
+  for (auto *child : children_[block]) { Visit(child, values, memory); }
+}
+
+// what may be stored on the paths from the immediate dominator of a join to
+// it, the join itself included when it heads a loop
+void GlobalValueNumbering::Kill(BasicBlock *block, MemoryTable &memory) const {
+  auto *idom = dominators_->ImmediateDominator(block);
+  std::unordered_set<BasicBlock *> region;
+  std::vector<BasicBlock *> worklist(block->predecessors().begin(),
+                                     block->predecessors().end());
+  while (!worklist.empty()) {
+    auto *pred = worklist.back();
+    worklist.pop_back();
+    if (pred == idom || !dominators_->IsReached(pred)
+        || !region.insert(pred).second) {
+      continue;
+    }
+    worklist.insert(worklist.end(), pred->predecessors().begin(),
+                    pred->predecessors().end());
+  }
+  for (auto *member : region) {
+    for (auto *instruction : member->instructions()) {
+      if (instruction->op() == Opcode::kStore) {
+        memory.erase(instruction->variable());
+      } else if (instruction->op() == Opcode::kCall) {
+        KillCall(*mod_ref_, instruction->callee(), memory);
+      }
+    }
+  }
+}
+
+Instruction *GlobalValueNumbering::Find(Instruction *value) const {
+  for (auto iter = replaced_.find(value); iter != replaced_.end();
+       iter = replaced_.find(value)) {
+    value = iter->second;
+  }
+  return value;
+}
+
+GlobalValueNumbering::Key GlobalValueNumbering::KeyOf(
+    Instruction *instruction) const {
+  auto op = instruction->op();
+  std::vector<int64_t> operands;
+  for (auto *operand : instruction->operands()) {
+    // below every id
+    operands.push_back(operand->IsConstant()
+                           ? operand->value() - (int64_t{1} << 33)
+                           : operand->id());
+  }
+  if (op == Opcode::kGt || op == Opcode::kGe) {
+    op = op == Opcode::kGt ? Opcode::kLt : Opcode::kLe;
+    std::swap(operands[0], operands[1]);
+  } else if (IsCommutative(op)) {
+    std::sort(operands.begin(), operands.end());
+  }
+  operands.insert(operands.begin(), static_cast<int64_t>(op));
+  return operands;
+}
+
+} // namespace pl0::ir
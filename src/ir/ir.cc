@@ -0,0 +1,252 @@
+#include "ir/ir.h"
+
+#include <algorithm>
+
+#include "util.h"
+
+namespace pl0::ir {
+
+bool IsBinary(Opcode op) {
+  switch (op) {
+#define V(name, token) case Opcode::k##name:
+    IR_BINARY_LIST(V)
+#undef V
+    return true;
+    default:
+      return false;
+  }
+}
+
+Token OperatorOf(Opcode op) {
+  switch (op) {
+#define V(name, token)    \
+  case Opcode::k##name: \
+    return Token::token;
+    IR_BINARY_LIST(V)
+#undef V
+    case Opcode::kOdd:
+      return Token::ODD;
+    default:
+      throw GeneralError(*op, " is no operator");
+  }
+}
+
+Opcode BinaryOf(Token tk) {
+  switch (tk) {
+#define V(name, token) \
+  case Token::token:   \
+    return Opcode::k##name;
+    IR_BINARY_LIST(V)
+#undef V
+    default:
+      throw GeneralError("token ", *tk, " cannot be used as operator");
+  }
+}
+
+bool Instruction::HasValue() const {
+  switch (op_) {
+    case Opcode::kStore:
+    case Opcode::kCall:
+    case Opcode::kWrite:
+    case Opcode::kJump:
+    case Opcode::kBranch:
+    case Opcode::kReturn:
+      return false;
+    default:
+      return true;
+  }
+}
+
+bool Instruction::HasSideEffects() const {
+  switch (op_) {
+    case Opcode::kStore:
+    case Opcode::kCall:
+    case Opcode::kRead:
+    case Opcode::kWrite:
+      return true;
+    default:
+      return IsTerminator();
+  }
+}
+
+bool Instruction::MayTrap() const {
+  if (op_ != Opcode::kDiv && op_ != Opcode::kDivisible) { return false; }
+  auto *divisor = operands_[1];
+  return !divisor->IsConstant() || divisor->value() == 0
+         || divisor->value() == -1;
+}
+
+void BasicBlock::Append(Instruction *instruction) {
+  if (instruction->op() == Opcode::kPhi) {
+    Insert(phi_count(), instruction);
+  } else if (terminator() != nullptr && !instruction->IsTerminator()) {
+    Insert(instructions_.size() - 1, instruction);
+  } else {
+    Insert(instructions_.size(), instruction);
+  }
+}
+
+void BasicBlock::Insert(size_t position, Instruction *instruction) {
+  instruction->set_block(this);
+  instructions_.insert(instructions_.begin() + position, instruction);
+}
+
+void BasicBlock::Remove(Instruction *instruction) {
+  auto iter =
+      std::find(instructions_.begin(), instructions_.end(), instruction);
+  if (iter != instructions_.end()) { instructions_.erase(iter); }
+  instruction->set_block(nullptr);
+}
+
+void BasicBlock::set_instructions(ListType instructions) {
+  instructions_ = std::move(instructions);
+  for (auto *instruction : instructions_) { instruction->set_block(this); }
+}
+
+Instruction *BasicBlock::terminator() const {
+  if (instructions_.empty() || !instructions_.back()->IsTerminator()) {
+    return nullptr;
+  }
+  return instructions_.back();
+}
+
+std::vector<BasicBlock *> BasicBlock::successors() const {
+  auto *last = terminator();
+  return last != nullptr ? last->targets() : std::vector<BasicBlock *>{};
+}
+
+size_t BasicBlock::phi_count() const {
+  size_t count = 0;
+  while (count < instructions_.size()
+         && instructions_[count]->op() == Opcode::kPhi) {
+    count++;
+  }
+  return count;
+}
+
+void BasicBlock::RemovePredecessor(BasicBlock *block) {
+  auto iter = std::find(predecessors_.begin(), predecessors_.end(), block);
+  if (iter == predecessors_.end()) { return; }
+  const auto index = static_cast<size_t>(iter - predecessors_.begin());
+  predecessors_.erase(iter);
+  for (size_t i = 0; i < phi_count(); i++) {
+    instructions_[i]->RemoveOperand(index);
+  }
+}
+
+void BasicBlock::ReplacePredecessor(BasicBlock *from, BasicBlock *to) {
+  std::replace(predecessors_.begin(), predecessors_.end(), from, to);
+}
+
+BasicBlock *Function::NewBlock() {
+  block_pool_.push_back(
+      std::make_unique<BasicBlock>(static_cast<int>(block_pool_.size())));
+  blocks_.push_back(block_pool_.back().get());
+  return blocks_.back();
+}
+
+BasicBlock *Function::NewBlockBefore(BasicBlock *position) {
+  auto *block = NewBlock();
+  blocks_.pop_back();
+  blocks_.insert(std::find(blocks_.begin(), blocks_.end(), position), block);
+  return block;
+}
+
+void Function::MoveToEnd(BasicBlock *block) {
+  blocks_.erase(std::find(blocks_.begin(), blocks_.end(), block));
+  blocks_.push_back(block);
+}
+
+Instruction *Function::New(Opcode op, std::vector<Instruction *> operands) {
+  instructions_.push_back(std::make_unique<Instruction>(
+      instruction_count(), op, std::move(operands)));
+  return instructions_.back().get();
+}
+
+void Function::ReplaceAllUses(Instruction *of, Instruction *with) {
+  for (auto *block : blocks_) {
+    for (auto *instruction : block->instructions()) {
+      const auto &operands = instruction->operands();
+      for (size_t i = 0; i < operands.size(); i++) {
+        if (operands[i] == of) { instruction->set_operand(i, with); }
+      }
+    }
+  }
+}
+
+BasicBlock *Function::SplitEdge(BasicBlock *pred, BasicBlock *succ) {
+  // so that it falls through
+  auto *middle = NewBlockBefore(succ);
+
+  auto *jump = New(Opcode::kJump);
+  jump->set_targets({succ});
+  middle->Append(jump);
+  middle->AddPredecessor(pred);
+  succ->ReplacePredecessor(pred, middle);
+  auto *branch = pred->terminator();
+  for (size_t i = 0; i < branch->targets().size(); i++) {
+    if (branch->targets()[i] == succ) {
+      branch->set_target(i, middle);
+      break;
+    }
+  }
+  return middle;
+}
+
+Function *Module::NewFunction(Procedure *symbol, Scope *scope) {
+  functions_.push_back(std::make_unique<Function>(symbol, scope));
+  return functions_.back().get();
+}
+
+namespace {
+
+void PrintOperand(const Instruction *operand, std::ostream &out) {
+  if (operand->IsConstant()) {
+    out << ' ' << operand->value();
+  } else {
+    out << " %" << operand->id();
+  }
+}
+
+} // namespace
+
+void Print(const Module &module, std::ostream &out) {
+  for (const auto &function : module.functions()) {
+    out << "function "
+        << (function->symbol() != nullptr ? function->symbol()->name()
+                                          : std::string("main"))
+        << " (level " << function->level() << ")\n";
+    for (auto *block : function->blocks()) {
+      out << "b" << block->id() << ":";
+      if (!block->predecessors().empty()) {
+        out << "\t\t; preds";
+        for (auto *pred : block->predecessors()) { out << " b" << pred->id(); }
+      }
+      out << '\n';
+      for (auto *instruction : block->instructions()) {
+        // constants are printed where they are used
+        if (instruction->IsConstant()) { continue; }
+        out << '\t';
+        if (instruction->HasValue()) {
+          out << '%' << instruction->id() << " = ";
+        }
+        out << *instruction->op();
+        if (instruction->variable() != nullptr) {
+          out << ' ' << instruction->variable()->name();
+        }
+        if (instruction->callee() != nullptr) {
+          out << ' ' << instruction->callee()->name();
+        }
+        for (auto *operand : instruction->operands()) {
+          PrintOperand(operand, out);
+        }
+        for (auto *target : instruction->targets()) {
+          out << " b" << target->id();
+        }
+        out << '\n';
+      }
+    }
+  }
+}
+
+} // namespace pl0::ir
@@ -0,0 +1,94 @@
+#include "ir/licm.h"
+
+#include <functional>
+
+namespace pl0::ir {
+
+void LoopInvariantCodeMotion::Initialize(Module &module) {
+  mod_ref_ = std::make_unique<ModRef>(module);
+}
+
+bool LoopInvariantCodeMotion::Run(Function &function) {
+  bool changed = false;
+  // a preheader made for an inner loop belongs to the loops around it, which
+  // are found again
+  for (bool again = true; again;) {
+    again = false;
+    for (const auto &loop : FindLoops(function)) {
+      if (Hoist(function, loop)) {
+        again = changed = true;
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+bool LoopInvariantCodeMotion::Hoist(Function &function, const Loop &loop) {
+  std::vector<Instruction *> clobbers;
+  for (auto *block : function.blocks()) {
+    if (!loop.Contains(block)) { continue; }
+    for (auto *instruction : block->instructions()) {
+      const auto op = instruction->op();
+      if (op == Opcode::kStore || op == Opcode::kCall) {
+        clobbers.push_back(instruction);
+      }
+    }
+  }
+  auto is_clobbered = [&](Variable *variable) {
+    for (auto *instruction : clobbers) {
+      if (mod_ref_->Clobbers(instruction, variable)) { return true; }
+    }
+    return false;
+  };
+
+  std::unordered_set<Instruction *> invariant;
+  auto is_invariant = [&](Instruction *value) {
+    return !loop.Contains(value->block()) || invariant.count(value) != 0;
+  };
+  std::vector<Instruction *> worth;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto *block : function.blocks()) {
+      if (!loop.Contains(block)) { continue; }
+      for (auto *instruction : block->instructions()) {
+        const auto op = instruction->op();
+        if (invariant.count(instruction) != 0) { continue; }
+        bool candidate = instruction->IsConstant();
+        if (IsBinary(op) || op == Opcode::kOdd
+            || op == Opcode::kDivisible) {
+          candidate = !instruction->MayTrap();
+        } else if (op == Opcode::kLoad) {
+          candidate = !is_clobbered(instruction->variable());
+        }
+        const auto &operands = instruction->operands();
+        if (!candidate
+            || !std::all_of(operands.begin(), operands.end(), is_invariant)) {
+          continue;
+        }
+        invariant.insert(instruction);
+        changed = true;
+        if (op == Opcode::kLoad
+                ? instruction->variable()->level() < function.level()
+                : !instruction->IsConstant()) {
+          worth.push_back(instruction);
+        }
+      }
+    }
+  }
+  if (worth.empty()) { return false; }
+  auto *preheader = Preheader(function, loop);
+  if (preheader == nullptr) { return false; }
+
+  // the operands go first, and with them what they need
+  std::function<void(Instruction *)> move = [&](Instruction *instruction) {
+    if (!loop.Contains(instruction->block())) { return; }
+    for (auto *operand : instruction->operands()) { move(operand); }
+    instruction->block()->Remove(instruction);
+    preheader->Append(instruction);
+  };
+  for (auto *instruction : worth) { move(instruction); }
+  return true;
+}
+
+} // namespace pl0::ir
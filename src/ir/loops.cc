@@ -0,0 +1,271 @@
+#include "ir/loops.h"
+
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+
+namespace pl0::ir {
+
+namespace {
+
+std::vector<BasicBlock *> ReversePostorder(const Function &function) {
+  std::vector<BasicBlock *> order;
+  std::unordered_set<BasicBlock *> visited{function.entry()};
+  // the block, and how many of its successors were visited
+  std::vector<std::pair<BasicBlock *, size_t>> stack{{function.entry(), 0}};
+  while (!stack.empty()) {
+    auto *block = stack.back().first;
+    const auto successors = block->successors();
+    if (stack.back().second == successors.size()) {
+      order.push_back(block);
+      stack.pop_back();
+      continue;
+    }
+    auto *succ = successors[stack.back().second++];
+    if (visited.insert(succ).second) { stack.emplace_back(succ, 0); }
+  }
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+Opcode Swapped(Opcode op) {
+  switch (op) {
+    case Opcode::kLt:
+      return Opcode::kGt;
+    case Opcode::kLe:
+      return Opcode::kGe;
+    case Opcode::kGt:
+      return Opcode::kLt;
+    case Opcode::kGe:
+      return Opcode::kLe;
+    default:
+      return op;
+  }
+}
+
+Opcode Negated(Opcode op) {
+  switch (op) {
+    case Opcode::kLt:
+      return Opcode::kGe;
+    case Opcode::kLe:
+      return Opcode::kGt;
+    case Opcode::kGt:
+      return Opcode::kLe;
+    case Opcode::kGe:
+      return Opcode::kLt;
+    case Opcode::kEq:
+      return Opcode::kNe;
+    default:
+      return Opcode::kEq;
+  }
+}
+
+} // namespace
+
+Dominators::Dominators(const Function &function)
+    : order_(ReversePostorder(function)), idom_(order_.size(), -1) {
+  for (size_t i = 0; i < order_.size(); i++) {
+    index_[order_[i]] = static_cast<int>(i);
+  }
+  idom_[0] = 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 1; i < order_.size(); i++) {
+      int idom = -1;
+      for (auto *pred : order_[i]->predecessors()) {
+        if (!IsReached(pred)) { continue; }
+        const int p = index_.at(pred);
+        if (idom_[p] == -1) { continue; }
+        idom = idom == -1 ? p : Intersect(p, idom);
+      }
+      if (idom_[i] != idom) {
+        idom_[i] = idom;
+        changed = true;
+      }
+    }
+  }
+}
+
+int Dominators::Intersect(int a, int b) const {
+  while (a != b) {
+    while (a > b) { a = idom_[a]; }
+    while (b > a) { b = idom_[b]; }
+  }
+  return a;
+}
+
+bool Dominators::Dominates(BasicBlock *a, BasicBlock *b) const {
+  int i = index_.at(b);
+  const int target = index_.at(a);
+  while (i > target) { i = idom_[i]; }
+  return i == target;
+}
+
+BasicBlock *Dominators::ImmediateDominator(BasicBlock *block) const {
+  const int i = index_.at(block);
+  return i == 0 ? nullptr : order_[idom_[i]];
+}
+
+std::vector<Loop> FindLoops(const Dominators &dominators) {
+  std::vector<Loop> loops;
+  std::unordered_map<BasicBlock *, size_t> of_header;
+  for (auto *block : dominators.order()) {
+    for (auto *header : block->successors()) {
+      if (!dominators.Dominates(header, block)) { continue; }
+      // back edges to the same header make one loop
+      if (of_header.count(header) == 0) {
+        of_header[header] = loops.size();
+        loops.push_back(Loop{header, {header}});
+      }
+      auto &loop = loops[of_header[header]];
+      std::vector<BasicBlock *> worklist{block};
+      while (!worklist.empty()) {
+        auto *member = worklist.back();
+        worklist.pop_back();
+        if (!loop.blocks.insert(member).second) { continue; }
+        for (auto *pred : member->predecessors()) {
+          if (dominators.IsReached(pred)) { worklist.push_back(pred); }
+        }
+      }
+    }
+  }
+  // a loop inside another has fewer blocks
+  std::stable_sort(loops.begin(), loops.end(),
+                   [](const Loop &a, const Loop &b) {
+                     return a.blocks.size() < b.blocks.size();
+                   });
+  return loops;
+}
+
+BasicBlock *Preheader(Function &function, const Loop &loop) {
+  auto *header = loop.header;
+  const auto preds = header->predecessors();
+  std::vector<size_t> entering;
+  std::vector<BasicBlock *> inside;
+  for (size_t i = 0; i < preds.size(); i++) {
+    if (loop.Contains(preds[i])) {
+      inside.push_back(preds[i]);
+    } else {
+      entering.push_back(i);
+    }
+  }
+  if (entering.empty()) { return nullptr; }
+  if (entering.size() == 1) {
+    auto *pred = preds[entering[0]];
+    if (pred->successors().size() == 1) { return pred; }
+    return function.SplitEdge(pred, header);
+  }
+
+  // the entering edges are joined first, their phi operands by new phis
+  auto *preheader = function.NewBlockBefore(header);
+  for (size_t i = 0; i < header->phi_count(); i++) {
+    auto *phi = header->instructions()[i];
+    std::vector<Instruction *> values;
+    for (auto edge : entering) { values.push_back(phi->operand(edge)); }
+    auto *value = values[0];
+    if (std::any_of(values.begin(), values.end(),
+                    [&](Instruction *v) { return v != values[0]; })) {
+      value = function.New(Opcode::kPhi, values);
+      preheader->Append(value);
+    }
+    std::vector<Instruction *> operands{value};
+    for (size_t j = 0; j < preds.size(); j++) {
+      if (loop.Contains(preds[j])) { operands.push_back(phi->operand(j)); }
+    }
+    phi->set_operands(std::move(operands));
+  }
+  for (auto edge : entering) {
+    auto *pred = preds[edge];
+    auto *terminator = pred->terminator();
+    const auto &targets = terminator->targets();
+    terminator->set_target(
+        std::find(targets.begin(), targets.end(), header) - targets.begin(),
+        preheader);
+    preheader->AddPredecessor(pred);
+  }
+  inside.insert(inside.begin(), preheader);
+  header->set_predecessors(std::move(inside));
+  auto *jump = function.New(Opcode::kJump);
+  jump->set_targets({header});
+  preheader->Append(jump);
+  return preheader;
+}
+
+std::optional<CountedLoop> AsCounted(const Loop &loop,
+                                     const Dominators &dominators) {
+  auto *header = loop.header;
+  CountedLoop counted{};
+  BasicBlock *entering = nullptr;
+  counted.latch = nullptr;
+  for (auto *pred : header->predecessors()) {
+    auto *&edge = loop.Contains(pred) ? counted.latch : entering;
+    if (edge != nullptr) { return std::nullopt; }
+    edge = pred;
+  }
+  if (entering == nullptr || counted.latch == nullptr) { return std::nullopt; }
+  counted.entry = header->predecessors()[0] == entering ? 0 : 1;
+  counted.back = 1 - counted.entry;
+
+  auto *branch = header->terminator();
+  if (branch->op() != Opcode::kBranch) { return std::nullopt; }
+  const bool stays_on_true = loop.Contains(branch->targets()[0]);
+  counted.exit = branch->targets()[stays_on_true ? 1 : 0];
+  if (loop.Contains(counted.exit)
+      || !loop.Contains(branch->targets()[stays_on_true ? 0 : 1])) {
+    return std::nullopt;
+  }
+  for (auto *block : loop.blocks) {
+    // an unreachable block still jumping into the loop counts as well
+    for (auto *pred : block->predecessors()) {
+      if (block != header && !loop.Contains(pred)) { return std::nullopt; }
+    }
+    for (auto *successor : block->successors()) {
+      if (block != header && !loop.Contains(successor)) { return std::nullopt; }
+      if (successor != header && dominators.Dominates(successor, block)) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  auto *compare = branch->operand(0);
+  auto op = compare->op();
+  if (!IsBinary(op) || op <= Opcode::kDiv || !loop.Contains(compare->block())) {
+    return std::nullopt;
+  }
+  counted.counter = compare->operand(0);
+  counted.bound = compare->operand(1);
+  if (counted.counter->block() != header
+      || counted.counter->op() != Opcode::kPhi) {
+    std::swap(counted.counter, counted.bound);
+    op = Swapped(op);
+  }
+  if (!stays_on_true) { op = Negated(op); }
+  counted.op = op;
+  auto *counter = counted.counter;
+  auto *bound = counted.bound;
+  if (counter->block() != header || counter->op() != Opcode::kPhi
+      || !(bound->IsConstant() || !loop.Contains(bound->block()))) {
+    return std::nullopt;
+  }
+
+  auto *next = counter->operand(counted.back);
+  const bool subtract = next->op() == Opcode::kSub;
+  if (next->op() != Opcode::kAdd && !subtract) { return std::nullopt; }
+  const int i = next->operand(0) == counter ? 1 : 0;
+  auto *step = next->operand(i);
+  if (next->operand(1 - i) != counter || !step->IsConstant()
+      || (subtract && i == 0) || step->value() == INT_MIN) {
+    return std::nullopt;
+  }
+  counted.step = subtract ? -step->value() : step->value();
+
+  const bool known = op == Opcode::kNe
+                         ? counted.step == 1 || counted.step == -1
+                     : counted.step > 0
+                         ? op == Opcode::kLt || op == Opcode::kLe
+                         : op == Opcode::kGt || op == Opcode::kGe;
+  if (!known || counted.step == 0) { return std::nullopt; }
+  return counted;
+}
+
+} // namespace pl0::ir
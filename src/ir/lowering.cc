@@ -0,0 +1,449 @@
+#include "ir/lowering.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace pl0::ir {
+
+void Lowering::Generate(Module &module) {
+  for (auto &function : module.functions()) { LowerFunction(*function); }
+  for (auto &[callee, patches] : patch_list_) {
+    auto iter = entry_points_.find(callee);
+    if (iter == entry_points_.end()) { throw GeneralError("unexpected error"); }
+    for (auto patch : patches) {
+      patch.set_level(patch.get_level() - callee->level());
+      patch.set_address(iter->second);
+    }
+  }
+}
+
+void Lowering::LowerFunction(Function &function) {
+  function_ = &function;
+  SplitCriticalEdges();
+  FindDeferred();
+  ComputeLiveness();
+  AllocateSlots();
+  JoinSplitEdges();
+  if (function.symbol() != nullptr) {
+    entry_points_[function.symbol()] = assembler_.GetNextAddress();
+  }
+  Emit();
+}
+
+// the copies for the phis of a block go where only its edge passes
+void Lowering::SplitCriticalEdges() {
+  split_.clear();
+  auto blocks = function_->blocks();
+  for (auto *block : blocks) {
+    if (block->phi_count() == 0) { continue; }
+    auto preds = block->predecessors();
+    for (auto *pred : preds) {
+      if (pred->successors().size() > 1) {
+        split_.push_back(function_->SplitEdge(pred, block));
+      }
+    }
+  }
+}
+
+void Lowering::FindDeferred() {
+  const auto count = static_cast<size_t>(function_->instruction_count());
+  deferred_.assign(count, false);
+  users_.assign(count, {});
+  for (auto *block : function_->blocks()) {
+    for (auto *instruction : block->instructions()) {
+      for (auto *operand : instruction->operands()) {
+        users_[operand->id()].push_back(instruction);
+      }
+    }
+  }
+
+  for (auto *block : function_->blocks()) {
+    const auto &instructions = block->instructions();
+    for (size_t i = 0; i < instructions.size(); i++) {
+      auto *instruction = instructions[i];
+      const auto op = instruction->op();
+      if (!IsBinary(op) && op != Opcode::kOdd && op != Opcode::kDivisible
+          && op != Opcode::kLoad && op != Opcode::kRead) {
+        continue;
+      }
+      const auto &users = users_[instruction->id()];
+      if (users.size() != 1 || users[0]->block() != block
+          || users[0]->op() == Opcode::kPhi) {
+        continue;
+      }
+      // the JIT wants the operand stack empty at a READ, as it is when the
+      // value is stored or written right away
+      if (op == Opcode::kRead && users[0]->op() != Opcode::kStore
+          && users[0]->op() != Opcode::kWrite) {
+        continue;
+      }
+      // nothing with an effect is passed, nor a division that may trap by a
+      // read of the input
+      size_t j = i + 1;
+      while (instructions[j] != users[0] && !instructions[j]->HasSideEffects()
+             && (op != Opcode::kRead || !instructions[j]->MayTrap())) {
+        j++;
+      }
+      deferred_[instruction->id()] = instructions[j] == users[0];
+    }
+  }
+}
+
+bool Lowering::IsMaterialized(Instruction *instruction) const {
+  return instruction->HasValue() && !instruction->IsConstant()
+         && !IsDeferred(instruction)
+         && (!users_[instruction->id()].empty()
+             || instruction->HasSideEffects() || instruction->MayTrap());
+}
+
+bool Lowering::IsEmitted(Instruction *instruction) const {
+  return instruction->HasValue() ? IsMaterialized(instruction)
+                                 : instruction->op() != Opcode::kPhi;
+}
+
+void Lowering::SlotOperands(
+    Instruction *instruction, std::vector<Instruction *> &out) {
+  for (auto *operand : instruction->operands()) {
+    if (operand->IsConstant()) { continue; }
+    if (IsDeferred(operand)) {
+      SlotOperands(operand, out);
+    } else {
+      out.push_back(operand);
+    }
+  }
+}
+
+// Live sets hold the values in slots; the phis of a block are not live into
+// it, their operands are live out of the predecessors.
+void Lowering::ComputeLiveness() {
+  const auto count = static_cast<size_t>(function_->instruction_count());
+  const auto &blocks = function_->blocks();
+  live_in_.clear();
+  live_out_.clear();
+  for (auto *block : blocks) {
+    live_in_[block].assign(count, false);
+    live_out_[block].assign(count, false);
+  }
+
+  std::vector<Instruction *> operands;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto iter = blocks.rbegin(); iter != blocks.rend(); ++iter) {
+      auto *block = *iter;
+      std::vector<bool> live(count, false);
+      for (auto *succ : block->successors()) {
+        const auto &live_in = live_in_[succ];
+        for (size_t i = 0; i < count; i++) {
+          if (live_in[i]) { live[i] = true; }
+        }
+        const auto &preds = succ->predecessors();
+        const auto edge = static_cast<size_t>(
+            std::find(preds.begin(), preds.end(), block) - preds.begin());
+        for (size_t i = 0; i < succ->phi_count(); i++) {
+          auto *value = succ->instructions()[i]->operand(edge);
+          if (!value->IsConstant()) { live[value->id()] = true; }
+        }
+      }
+      if (live != live_out_[block]) {
+        live_out_[block] = live;
+        changed = true;
+      }
+
+      const auto &instructions = block->instructions();
+      for (auto i = instructions.size(); i-- > block->phi_count();) {
+        auto *instruction = instructions[i];
+        if (!IsEmitted(instruction)) { continue; }
+        live[instruction->id()] = false;
+        operands.clear();
+        SlotOperands(instruction, operands);
+        for (auto *operand : operands) { live[operand->id()] = true; }
+      }
+      // used by a phi of a loop header, at the end of its latch
+      for (size_t i = 0; i < block->phi_count(); i++) {
+        live[instructions[i]->id()] = false;
+      }
+      if (live != live_in_[block]) {
+        live_in_[block] = std::move(live);
+        changed = true;
+      }
+    }
+  }
+}
+
+void Lowering::Interfere(Instruction *a, Instruction *b) {
+  if (a == b) { return; }
+  interference_[a->id()].insert(b->id());
+  interference_[b->id()].insert(a->id());
+}
+
+int Lowering::Find(int value) {
+  while (parent_[value] != value) {
+    parent_[value] = parent_[parent_[value]];
+    value = parent_[value];
+  }
+  return value;
+}
+
+void Lowering::AllocateSlots() {
+  const auto count = static_cast<size_t>(function_->instruction_count());
+  interference_.assign(count, {});
+  std::vector<Instruction *> values(count);
+  for (auto *block : function_->blocks()) {
+    for (auto *instruction : block->instructions()) {
+      values[instruction->id()] = instruction;
+    }
+  }
+
+  std::vector<Instruction *> operands;
+  for (auto *block : function_->blocks()) {
+    std::unordered_set<Instruction *> live;
+    const auto &live_out = live_out_[block];
+    for (size_t i = 0; i < count; i++) {
+      if (live_out[i]) { live.insert(values[i]); }
+    }
+    const auto &instructions = block->instructions();
+    for (auto i = instructions.size(); i-- > block->phi_count();) {
+      auto *instruction = instructions[i];
+      if (!IsEmitted(instruction)) { continue; }
+      if (instruction->HasValue()) {
+        for (auto *other : live) { Interfere(instruction, other); }
+        live.erase(instruction);
+      }
+      operands.clear();
+      SlotOperands(instruction, operands);
+      live.insert(operands.begin(), operands.end());
+    }
+    // the phis are written together, at the end of each predecessor
+    for (size_t i = 0; i < block->phi_count(); i++) {
+      live.erase(instructions[i]);
+    }
+    for (size_t i = 0; i < block->phi_count(); i++) {
+      auto *phi = instructions[i];
+      if (!IsMaterialized(phi)) { continue; }
+      for (auto *other : live) { Interfere(phi, other); }
+      for (size_t j = 0; j < i; j++) { Interfere(phi, instructions[j]); }
+    }
+  }
+
+  // a phi shares the slot of every operand it can
+  parent_.resize(count);
+  std::iota(parent_.begin(), parent_.end(), 0);
+  std::vector<std::vector<int>> members(count);
+  for (size_t i = 0; i < count; i++) { members[i] = {static_cast<int>(i)}; }
+  auto interferes = [&](int a, int b) {
+    for (int x : members[a]) {
+      for (int y : members[b]) {
+        if (interference_[x].count(y) != 0) { return true; }
+      }
+    }
+    return false;
+  };
+  for (auto *block : function_->blocks()) {
+    for (size_t i = 0; i < block->phi_count(); i++) {
+      auto *phi = block->instructions()[i];
+      if (!IsMaterialized(phi)) { continue; }
+      for (auto *operand : phi->operands()) {
+        if (operand->IsConstant()) { continue; }
+        const int a = Find(phi->id()), b = Find(operand->id());
+        if (a == b || interferes(a, b)) { continue; }
+        parent_[b] = a;
+        members[a].insert(
+            members[a].end(), members[b].begin(), members[b].end());
+        members[b].clear();
+      }
+    }
+  }
+
+  slot_.assign(count, -1);
+  const auto &reserved = function_->reserved_slots();
+  frame_size_ = 0;
+  for (int slot : reserved) { frame_size_ = std::max(frame_size_, slot + 1); }
+  for (auto *block : function_->blocks()) {
+    for (auto *instruction : block->instructions()) {
+      if (!IsMaterialized(instruction)) { continue; }
+      const int root = Find(instruction->id());
+      if (slot_[root] >= 0) { continue; }
+      std::unordered_set<int> taken(reserved.begin(), reserved.end());
+      for (int member : members[root]) {
+        for (int other : interference_[member]) {
+          taken.insert(slot_[Find(other)]);
+        }
+      }
+      int slot = 0;
+      while (taken.count(slot) != 0) { slot++; }
+      slot_[root] = slot;
+      frame_size_ = std::max(frame_size_, slot + 1);
+    }
+  }
+}
+
+// a block split off an edge only jumps if every phi took the slot of the
+// value coming along it, the edge goes straight to its target again
+void Lowering::JoinSplitEdges() {
+  for (auto *middle : split_) {
+    auto *pred = middle->predecessors().front();
+    auto *succ = middle->successors().front();
+    const auto &preds = succ->predecessors();
+    const auto edge = static_cast<size_t>(
+        std::find(preds.begin(), preds.end(), middle) - preds.begin());
+    bool empty = true;
+    for (size_t i = 0; i < succ->phi_count(); i++) {
+      auto *phi = succ->instructions()[i];
+      auto *value = phi->operand(edge);
+      if (IsMaterialized(phi)
+          && (value->IsConstant() || SlotOf(value) != SlotOf(phi))) {
+        empty = false;
+      }
+    }
+    if (!empty) { continue; }
+    auto *branch = pred->terminator();
+    for (size_t i = 0; i < branch->targets().size(); i++) {
+      if (branch->targets()[i] == middle) { branch->set_target(i, succ); }
+    }
+    succ->ReplacePredecessor(middle, pred);
+    auto blocks = function_->blocks();
+    blocks.erase(std::find(blocks.begin(), blocks.end(), middle));
+    function_->set_blocks(std::move(blocks));
+  }
+}
+
+bool Lowering::IsTailCall(Instruction *call, size_t position) const {
+  // a procedure declared in this one needs the frame as its static link
+  if (function_->level() <= call->callee()->level()) { return false; }
+  auto *next = call->block()->instructions()[position + 1];
+  if (next->op() == Opcode::kReturn) { return true; }
+  if (next->op() != Opcode::kJump) { return false; }
+  const auto &target = next->targets()[0]->instructions();
+  return target.size() == 1 && target[0]->op() == Opcode::kReturn;
+}
+
+void Lowering::Push(Instruction *value) {
+  if (value->IsConstant()) {
+    assembler_.Load(value->value());
+  } else if (IsDeferred(value)) {
+    Compute(value);
+  } else {
+    assembler_.Load(0, SlotOf(value));
+  }
+}
+
+void Lowering::Compute(Instruction *instruction) {
+  switch (instruction->op()) {
+    case Opcode::kConst:
+      assembler_.Load(instruction->value());
+      break;
+    case Opcode::kLoad: {
+      auto *var = instruction->variable();
+      assembler_.Load(function_->level() - var->level(), var->index());
+      break;
+    }
+    case Opcode::kRead:
+      assembler_.Read();
+      break;
+    case Opcode::kDivisible:
+      for (auto *operand : instruction->operands()) { Push(operand); }
+      assembler_.Divisible();
+      break;
+    default:
+      for (auto *operand : instruction->operands()) { Push(operand); }
+      assembler_.Operation(OperatorOf(instruction->op()));
+      break;
+  }
+}
+
+void Lowering::EmitCopies(BasicBlock *from, BasicBlock *to) {
+  const auto &preds = to->predecessors();
+  const auto edge = static_cast<size_t>(
+      std::find(preds.begin(), preds.end(), from) - preds.begin());
+  std::vector<Instruction *> phis;
+  for (size_t i = 0; i < to->phi_count(); i++) {
+    auto *phi = to->instructions()[i];
+    auto *value = phi->operand(edge);
+    if (!IsMaterialized(phi)
+        || (!value->IsConstant() && SlotOf(value) == SlotOf(phi))) {
+      continue;
+    }
+    Push(value);
+    phis.push_back(phi);
+  }
+  for (auto iter = phis.rbegin(); iter != phis.rend(); ++iter) {
+    assembler_.Store(0, SlotOf(*iter));
+  }
+}
+
+void Lowering::EmitJump(BasicBlock *target, bool conditional) {
+  auto iter = addresses_.find(target);
+  if (iter != addresses_.end()) {
+    if (conditional) {
+      assembler_.BranchIfFalse(iter->second);
+    } else {
+      assembler_.Branch(iter->second);
+    }
+    return;
+  }
+  pending_[target].push_back(
+      conditional ? assembler_.BranchIfFalse() : assembler_.Branch());
+}
+
+void Lowering::Emit() {
+  addresses_.clear();
+  pending_.clear();
+  const int level = function_->level();
+  auto frame = assembler_.Enter(kFrameBookkeeping);
+  const auto &blocks = function_->blocks();
+  for (size_t b = 0; b < blocks.size(); b++) {
+    auto *block = blocks[b];
+    next_block_ = b + 1 < blocks.size() ? blocks[b + 1] : nullptr;
+    const int address = assembler_.GetNextAddress();
+    addresses_[block] = address;
+    for (auto patch : pending_[block]) { patch.set_address(address); }
+
+    const auto &instructions = block->instructions();
+    for (size_t i = block->phi_count(); i < instructions.size(); i++) {
+      auto *instruction = instructions[i];
+      switch (instruction->op()) {
+        case Opcode::kJump: {
+          auto *target = instruction->targets()[0];
+          EmitCopies(block, target);
+          if (target != next_block_) { EmitJump(target, false); }
+          break;
+        }
+        case Opcode::kBranch: {
+          Push(instruction->operand(0));
+          EmitJump(instruction->targets()[1], true);
+          if (instruction->targets()[0] != next_block_) {
+            EmitJump(instruction->targets()[0], false);
+          }
+          break;
+        }
+        case Opcode::kReturn:
+          assembler_.leave();
+          break;
+        case Opcode::kStore: {
+          auto *var = instruction->variable();
+          Push(instruction->operand(0));
+          assembler_.Store(level - var->level(), var->index());
+          break;
+        }
+        case Opcode::kCall:
+          patch_list_[instruction->callee()].push_back(
+              IsTailCall(instruction, i) ? assembler_.TailCall(level)
+                                         : assembler_.Call(level));
+          break;
+        case Opcode::kWrite:
+          Push(instruction->operand(0));
+          assembler_.Write();
+          break;
+        default:
+          if (IsMaterialized(instruction)) {
+            Compute(instruction);
+            assembler_.Store(0, SlotOf(instruction));
+          }
+          break;
+      }
+    }
+  }
+  frame.set_address(frame_size_ + kFrameBookkeeping);
+}
+
+} // namespace pl0::ir
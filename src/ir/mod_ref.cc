@@ -0,0 +1,80 @@
+#include "ir/mod_ref.h"
+
+namespace pl0::ir {
+
+ModRef::ModRef(const Module &module) {
+  for (const auto &function : module.functions()) {
+    // the main program is never called
+    if (function->symbol() == nullptr) { continue; }
+    auto &summary = summaries_[function->symbol()];
+    for (auto *block : function->blocks()) {
+      for (auto *instruction : block->instructions()) {
+        switch (instruction->op()) {
+          case Opcode::kStore:
+            summary.modified.insert(instruction->variable());
+            break;
+          case Opcode::kLoad:
+            summary.referenced.insert(instruction->variable());
+            break;
+          case Opcode::kCall:
+            summary.callees.insert(instruction->callee());
+            break;
+          default:
+            break;
+        }
+      }
+    }
+  }
+
+  // what the callees do is done by the caller, until nothing is added
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto &[procedure, summary] : summaries_) {
+      for (auto *callee : summary.callees) {
+        auto iter = summaries_.find(callee);
+        if (iter == summaries_.end()) {
+          changed |= !summary.unknown;
+          summary.unknown = true;
+          continue;
+        }
+        if (iter->second.unknown) {
+          changed |= !summary.unknown;
+          summary.unknown = true;
+        }
+        if (&iter->second == &summary) { continue; }
+        for (auto *variable : iter->second.modified) {
+          changed |= summary.modified.insert(variable).second;
+        }
+        for (auto *variable : iter->second.referenced) {
+          changed |= summary.referenced.insert(variable).second;
+        }
+      }
+    }
+  }
+}
+
+bool ModRef::Modifies(Procedure *procedure, Variable *variable) const {
+  auto iter = summaries_.find(procedure);
+  return iter == summaries_.end() || iter->second.unknown
+         || iter->second.modified.count(variable) != 0;
+}
+
+bool ModRef::References(Procedure *procedure, Variable *variable) const {
+  auto iter = summaries_.find(procedure);
+  return iter == summaries_.end() || iter->second.unknown
+         || iter->second.referenced.count(variable) != 0;
+}
+
+bool ModRef::Clobbers(const Instruction *instruction,
+                      Variable *variable) const {
+  switch (instruction->op()) {
+    case Opcode::kStore:
+      return instruction->variable() == variable;
+    case Opcode::kCall:
+      return Modifies(instruction->callee(), variable);
+    default:
+      return false;
+  }
+}
+
+} // namespace pl0::ir
@@ -0,0 +1,12 @@
+#include "ir/pass.h"
+
+namespace pl0::ir {
+
+void PassManager::Run(Module &module) {
+  for (auto &pass : passes_) {
+    pass->Initialize(module);
+    for (auto &function : module.functions()) { pass->Run(*function); }
+  }
+}
+
+} // namespace pl0::ir
@@ -0,0 +1,203 @@
+#include "ir/simplify.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace pl0::ir {
+
+namespace {
+
+void ReplaceTerminator(BasicBlock *block, Instruction *terminator) {
+  block->Remove(block->terminator());
+  block->Append(terminator);
+}
+
+bool FoldBranches(Function &function) {
+  bool changed = false;
+  for (auto *block : function.blocks()) {
+    auto *branch = block->terminator();
+    if (branch == nullptr || branch->op() != Opcode::kBranch) { continue; }
+    auto *cond = branch->operand(0);
+    auto *on_true = branch->targets()[0];
+    auto *on_false = branch->targets()[1];
+    if (on_true != on_false && !cond->IsConstant()) { continue; }
+    auto *taken = on_true;
+    if (cond->IsConstant() && cond->value() == 0) {
+      taken = on_false;
+    }
+    // one edge is dropped, of two to the same block only one
+    (taken == on_true ? on_false : on_true)->RemovePredecessor(block);
+    auto *jump = function.New(Opcode::kJump);
+    jump->set_targets({taken});
+    ReplaceTerminator(block, jump);
+    changed = true;
+  }
+  return changed;
+}
+
+bool RemoveUnreachable(Function &function) {
+  std::unordered_set<BasicBlock *> reached{function.entry()};
+  std::vector<BasicBlock *> worklist{function.entry()};
+  while (!worklist.empty()) {
+    auto *block = worklist.back();
+    worklist.pop_back();
+    for (auto *succ : block->successors()) {
+      if (reached.insert(succ).second) { worklist.push_back(succ); }
+    }
+  }
+  if (reached.size() == function.blocks().size()) { return false; }
+
+  std::vector<BasicBlock *> blocks;
+  for (auto *block : function.blocks()) {
+    if (reached.count(block) != 0) {
+      blocks.push_back(block);
+      continue;
+    }
+    for (auto *succ : block->successors()) {
+      if (reached.count(succ) != 0) { succ->RemovePredecessor(block); }
+    }
+  }
+  function.set_blocks(std::move(blocks));
+  return true;
+}
+
+bool MergeBlocks(Function &function) {
+  for (auto *block : function.blocks()) {
+    auto *jump = block->terminator();
+    if (jump == nullptr || jump->op() != Opcode::kJump) { continue; }
+    auto *succ = jump->targets()[0];
+    if (succ == block || succ == function.entry()
+        || succ->predecessors().size() != 1) {
+      continue;
+    }
+
+    auto instructions = block->instructions();
+    instructions.pop_back();
+    for (auto *instruction : succ->instructions()) {
+      if (instruction->op() == Opcode::kPhi) {
+        function.ReplaceAllUses(instruction, instruction->operand(0));
+      } else {
+        instructions.push_back(instruction);
+      }
+    }
+    block->set_instructions(std::move(instructions));
+    succ->set_instructions({});
+    for (auto *next : block->successors()) {
+      next->ReplacePredecessor(succ, block);
+    }
+    auto blocks = function.blocks();
+    blocks.erase(std::find(blocks.begin(), blocks.end(), succ));
+    function.set_blocks(std::move(blocks));
+    return true;
+  }
+  return false;
+}
+
+bool ForwardJumps(Function &function) {
+  bool changed = false;
+  for (auto *block : function.blocks()) {
+    const auto &instructions = block->instructions();
+    if (block == function.entry() || instructions.size() != 1
+        || instructions[0]->op() != Opcode::kJump) {
+      continue;
+    }
+    auto *target = instructions[0]->targets()[0];
+    // the phis there would need an operand for every new predecessor
+    if (target == block || target->phi_count() != 0) { continue; }
+    for (auto *pred : block->predecessors()) {
+      auto *terminator = pred->terminator();
+      for (size_t i = 0; i < terminator->targets().size(); i++) {
+        if (terminator->targets()[i] == block) {
+          terminator->set_target(i, target);
+          target->AddPredecessor(pred);
+          changed = true;
+        }
+      }
+    }
+    // left for RemoveUnreachable
+    while (!block->predecessors().empty()) {
+      block->RemovePredecessor(block->predecessors().front());
+    }
+  }
+  return changed;
+}
+
+bool RemoveTrivialPhis(Function &function) {
+  bool changed = false;
+  for (auto *block : function.blocks()) {
+    for (size_t i = 0; i < block->phi_count();) {
+      auto *phi = block->instructions()[i];
+      Instruction *same = nullptr;
+      bool trivial = true;
+      for (auto *operand : phi->operands()) {
+        if (operand == phi || operand == same) { continue; }
+        if (same != nullptr) {
+          trivial = false;
+          break;
+        }
+        same = operand;
+      }
+      if (!trivial || same == nullptr) {
+        i++;
+        continue;
+      }
+      block->Remove(phi);
+      function.ReplaceAllUses(phi, same);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+} // namespace
+
+bool SimplifyCfg::Run(Function &function) {
+  bool changed = false;
+  for (bool again = true; again;) {
+    again = FoldBranches(function);
+    again |= RemoveUnreachable(function);
+    again |= MergeBlocks(function);
+    again |= ForwardJumps(function);
+    again |= RemoveTrivialPhis(function);
+    changed |= again;
+  }
+  return changed;
+}
+
+bool DeadCodeElimination::Run(Function &function) {
+  std::vector<bool> live(function.instruction_count());
+  std::vector<Instruction *> worklist;
+  for (auto *block : function.blocks()) {
+    for (auto *instruction : block->instructions()) {
+      if (instruction->HasSideEffects() || instruction->MayTrap()) {
+        live[instruction->id()] = true;
+        worklist.push_back(instruction);
+      }
+    }
+  }
+  while (!worklist.empty()) {
+    auto *instruction = worklist.back();
+    worklist.pop_back();
+    for (auto *operand : instruction->operands()) {
+      if (!live[operand->id()]) {
+        live[operand->id()] = true;
+        worklist.push_back(operand);
+      }
+    }
+  }
+
+  bool changed = false;
+  for (auto *block : function.blocks()) {
+    BasicBlock::ListType kept;
+    for (auto *instruction : block->instructions()) {
+      if (live[instruction->id()]) { kept.push_back(instruction); }
+    }
+    if (kept.size() != block->instructions().size()) {
+      block->set_instructions(std::move(kept));
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+} // namespace pl0::ir
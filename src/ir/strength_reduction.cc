@@ -0,0 +1,184 @@
+#include "ir/strength_reduction.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "ir/loops.h"
+
+namespace pl0::ir {
+
+namespace {
+
+std::vector<int> CountUses(const Function &function) {
+  std::vector<int> uses(function.instruction_count());
+  for (auto *block : function.blocks()) {
+    for (auto *instruction : block->instructions()) {
+      for (auto *operand : instruction->operands()) { uses[operand->id()]++; }
+    }
+  }
+  return uses;
+}
+
+// the division of a / b * b = a whose product and quotient nothing else
+// uses, nullptr if compare is not such a test
+Instruction *DivisibilityTest(Instruction *compare,
+                              const std::vector<int> &uses) {
+  if (compare->op() != Opcode::kEq && compare->op() != Opcode::kNe) {
+    return nullptr;
+  }
+  for (int i = 0; i < 2; i++) {
+    auto *product = compare->operand(i);
+    auto *dividend = compare->operand(1 - i);
+    if (product->op() != Opcode::kMul || uses[product->id()] != 1) {
+      continue;
+    }
+    for (int j = 0; j < 2; j++) {
+      auto *quotient = product->operand(j);
+      if (quotient->op() == Opcode::kDiv && uses[quotient->id()] == 1
+          && quotient->operand(0) == dividend
+          && quotient->operand(1) == product->operand(1 - j)) {
+        return quotient;
+      }
+    }
+  }
+  return nullptr;
+}
+
+bool ReduceDivisibility(Function &function) {
+  const auto uses = CountUses(function);
+  bool changed = false;
+  for (auto *block : function.blocks()) {
+    for (size_t i = 0; i < block->instructions().size(); i++) {
+      auto *compare = block->instructions()[i];
+      auto *quotient = DivisibilityTest(compare, uses);
+      if (quotient == nullptr) { continue; }
+      // where the division was, so that it traps at the same point; the
+      // product and the comparison are left to DeadCodeElimination
+      quotient->set_op(Opcode::kDivisible);
+      if (compare->op() == Opcode::kEq) {
+        function.ReplaceAllUses(compare, quotient);
+      } else {
+        auto *zero = function.New(Opcode::kConst);
+        block->Insert(i++, zero);
+        compare->set_op(Opcode::kEq);
+        compare->set_operands({quotient, zero});
+      }
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool IsInvariant(const Loop &loop, Instruction *value) {
+  return value->IsConstant() || !loop.Contains(value->block());
+}
+
+// the amount phi is stepped by on the back edge, negated for a Sub
+Instruction *Step(const Loop &loop, Instruction *phi, Instruction *next,
+                  bool &subtract) {
+  subtract = next->op() == Opcode::kSub;
+  if (next->op() != Opcode::kAdd && !subtract) { return nullptr; }
+  for (int i = 0; i < (subtract ? 1 : 2); i++) {
+    if (next->operand(i) == phi && IsInvariant(loop, next->operand(1 - i))) {
+      return next->operand(1 - i);
+    }
+  }
+  return nullptr;
+}
+
+int WrappingProduct(int a, int b) {
+  return static_cast<int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+}
+
+Instruction *Product(Function &function, BasicBlock *block, Instruction *a,
+                     Instruction *b) {
+  for (auto *one : {a, b}) {
+    if (one->IsConstant() && one->value() == 1) { return one == a ? b : a; }
+  }
+  Instruction *product;
+  if (a->IsConstant() && b->IsConstant()) {
+    product = function.New(Opcode::kConst);
+    product->set_value(WrappingProduct(a->value(), b->value()));
+  } else {
+    product = function.New(Opcode::kMul, {a, b});
+  }
+  block->Append(product);
+  return product;
+}
+
+// one product of an induction variable and an invariant made an induction
+// variable of its own
+bool ReduceInduction(Function &function, const Dominators &dominators,
+                     const Loop &loop) {
+  auto *header = loop.header;
+  BasicBlock *latch = nullptr;
+  for (auto *pred : header->predecessors()) {
+    if (!loop.Contains(pred)) { continue; }
+    if (latch != nullptr) { return false; }
+    latch = pred;
+  }
+  const auto &preds = header->predecessors();
+  const auto back = static_cast<size_t>(
+      std::find(preds.begin(), preds.end(), latch) - preds.begin());
+
+  for (size_t p = 0; p < header->phi_count(); p++) {
+    auto *phi = header->instructions()[p];
+    bool subtract;
+    auto *step = Step(loop, phi, phi->operand(back), subtract);
+    if (step == nullptr) { continue; }
+    for (auto *block : dominators.order()) {
+      // only what is computed on every iteration
+      if (!loop.Contains(block) || !dominators.Dominates(block, latch)) {
+        continue;
+      }
+      for (auto *product : block->instructions()) {
+        if (product->op() != Opcode::kMul) { continue; }
+        const int i = product->operand(0) == phi ? 1 : 0;
+        auto *factor = product->operand(i);
+        if (product->operand(1 - i) != phi || !IsInvariant(loop, factor)) {
+          continue;
+        }
+
+        auto *preheader = Preheader(function, loop);
+        if (preheader == nullptr || header->predecessors().size() != 2) {
+          return false;
+        }
+        const auto &edges = header->predecessors();
+        const size_t entry = edges[0] == latch ? 1 : 0;
+        auto *reduced = function.New(Opcode::kPhi, {nullptr, nullptr});
+        auto *next = function.New(subtract ? Opcode::kSub : Opcode::kAdd);
+        reduced->set_operand(
+            entry, Product(function, preheader, phi->operand(entry), factor));
+        reduced->set_operand(1 - entry, next);
+        next->set_operands(
+            {reduced, Product(function, preheader, step, factor)});
+        header->Append(reduced);
+        latch->Append(next);
+        block->Remove(product);
+        function.ReplaceAllUses(product, reduced);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+bool StrengthReduction::Run(Function &function) {
+  bool changed = ReduceDivisibility(function);
+  // the loops are found again after every change to the graph
+  for (bool again = true; again;) {
+    again = false;
+    const Dominators dominators(function);
+    for (const auto &loop : FindLoops(dominators)) {
+      if (ReduceInduction(function, dominators, loop)) {
+        again = changed = true;
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+} // namespace pl0::ir
@@ -0,0 +1,195 @@
+#include "ir/unroll.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <unordered_map>
+
+namespace pl0::ir {
+
+namespace {
+
+// operands and targets still those of the original
+Instruction *Copy(Function &function, Instruction *original) {
+  auto *copy = function.New(original->op(), original->operands());
+  copy->set_value(original->value());
+  copy->set_variable(original->variable());
+  copy->set_callee(original->callee());
+  copy->set_targets(original->targets());
+  return copy;
+}
+
+} // namespace
+
+bool LoopUnrolling::Run(Function &function) {
+  done_.clear();
+  if (factor_ < 2) { return false; }
+  bool changed = false;
+  for (bool again = true; again;) {
+    again = false;
+    const Dominators dominators(function);
+    for (const auto &loop : FindLoops(dominators)) {
+      if (done_.count(loop.header) != 0) { continue; }
+      if (Unroll(function, dominators, loop)) {
+        again = changed = true;
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+bool LoopUnrolling::Unroll(Function &function, const Dominators &dominators,
+                           const Loop &loop) {
+  auto counted = AsCounted(loop, dominators);
+  if (!counted || counted->op == Opcode::kNe) { return false; }
+  auto *header = loop.header;
+  // in layout order, so that the copies are laid out as the loop is
+  std::vector<BasicBlock *> blocks;
+  int size = 0;
+  for (auto *block : function.blocks()) {
+    if (!loop.Contains(block)) { continue; }
+    blocks.push_back(block);
+    for (auto *instruction : block->instructions()) {
+      if (instruction->op() == Opcode::kCall) { return false; }
+      if (!instruction->IsConstant()) { size++; }
+    }
+  }
+  const int factor = std::min(factor_, budget_ / size + 1);
+  if (factor < 2) { return false; }
+  // how much further the counter gets in the iterations tested at once
+  const int64_t reach = int64_t{factor - 1} * counted->step;
+  if (reach > INT_MAX || reach < -INT_MAX) { return false; }
+  done_.insert(header);
+
+  auto *preheader = Preheader(function, loop);
+  auto *bound = counted->bound;
+  // the copies go on while counter op bound - reach, if that does not wrap
+  Instruction *guard;
+  Instruction *limit;
+  if (bound->IsConstant()) {
+    const int64_t moved = int64_t{bound->value()} - reach;
+    guard = function.New(Opcode::kConst);
+    guard->set_value(moved >= INT_MIN && moved <= INT_MAX);
+    limit = function.New(Opcode::kConst);
+    limit->set_value(static_cast<int>(moved));
+    preheader->Append(guard);
+    preheader->Append(limit);
+    if (guard->value() == 0) { return true; }
+  } else {
+    auto *amount = function.New(Opcode::kConst);
+    auto *edge = function.New(Opcode::kConst);
+    amount->set_value(static_cast<int>(reach));
+    edge->set_value(static_cast<int>(reach > 0 ? INT_MIN + reach
+                                                : INT_MAX + reach));
+    guard = function.New(reach > 0 ? Opcode::kGe : Opcode::kLe, {bound, edge});
+    limit = function.New(Opcode::kSub, {bound, amount});
+    for (auto *instruction : {amount, edge, guard, limit}) {
+      preheader->Append(instruction);
+    }
+  }
+
+  auto *top = function.NewBlockBefore(header);
+  done_.insert(top);
+  std::vector<std::unordered_map<BasicBlock *, BasicBlock *>> copies(factor);
+  for (auto &copy : copies) {
+    for (auto *block : blocks) {
+      copy[block] = function.NewBlockBefore(header);
+    }
+  }
+
+  // the phis of the header, as the copy on top of the others sees them
+  std::unordered_map<Instruction *, Instruction *> values;
+  const size_t phi_count = header->phi_count();
+  for (size_t p = 0; p < phi_count; p++) {
+    auto *phi = header->instructions()[p];
+    auto *value = function.New(Opcode::kPhi, {phi->operand(counted->entry)});
+    top->Append(value);
+    values[phi] = value;
+  }
+  auto *counter = values[counted->counter];
+  BasicBlock *from = top;
+  for (int k = 0; k < factor; k++) {
+    auto &copy = copies[k];
+    auto *next = k + 1 < factor ? copies[k + 1][header] : top;
+    std::vector<Instruction *> made;
+    for (auto *block : blocks) {
+      const auto &instructions = block->instructions();
+      for (size_t i = block == header ? phi_count : 0; i < instructions.size();
+           i++) {
+        auto *instruction = instructions[i];
+        auto *clone = Copy(function, instruction);
+        if (instruction == header->terminator()) {
+          // the test is known to pass
+          clone->set_op(Opcode::kJump);
+          clone->set_operands({});
+          clone->set_targets(
+              {instruction->targets()[0] == counted->exit
+                   ? instruction->targets()[1]
+                   : instruction->targets()[0]});
+        }
+        copy[block]->Append(clone);
+        values[instruction] = clone;
+        made.push_back(clone);
+      }
+      for (auto *pred : block->predecessors()) {
+        if (block != header) {
+          copy[block]->AddPredecessor(copy[pred]);
+        } else if (pred == counted->latch) {
+          copy[block]->AddPredecessor(from);
+        }
+      }
+    }
+    for (auto *clone : made) {
+      for (size_t i = 0; i < clone->operands().size(); i++) {
+        auto found = values.find(clone->operand(i));
+        if (found != values.end()) { clone->set_operand(i, found->second); }
+      }
+      for (size_t i = 0; i < clone->targets().size(); i++) {
+        auto *target = clone->targets()[i];
+        clone->set_target(i, target == header ? next : copy[target]);
+      }
+    }
+    // the phis of the header, as the next copy sees them
+    std::unordered_map<Instruction *, Instruction *> carried;
+    for (size_t p = 0; p < phi_count; p++) {
+      auto *phi = header->instructions()[p];
+      auto *value = phi->operand(counted->back);
+      auto found = values.find(value);
+      carried[phi] = found != values.end() ? found->second : value;
+    }
+    for (const auto &[phi, value] : carried) { values[phi] = value; }
+    from = copy[counted->latch];
+  }
+
+  // the loop left over is entered from the top of the copies with what they
+  // carried into it
+  for (size_t p = 0; p < phi_count; p++) {
+    auto *phi = header->instructions()[p];
+    top->instructions()[p]->AddOperand(values[phi]);
+  }
+  top->set_predecessors({preheader, from});
+  auto *test = function.New(counted->op, {counter, limit});
+  auto *branch = function.New(Opcode::kBranch, {test});
+  branch->set_targets({copies[0][header], header});
+  top->Append(test);
+  top->Append(branch);
+  header->AddPredecessor(top);
+  for (size_t p = 0; p < phi_count; p++) {
+    header->instructions()[p]->AddOperand(top->instructions()[p]);
+  }
+
+  auto *enter = preheader->terminator();
+  if (guard->IsConstant()) {
+    enter->set_target(0, top);
+    header->RemovePredecessor(preheader);
+  } else {
+    auto *split = function.New(Opcode::kBranch, {guard});
+    split->set_targets({top, header});
+    preheader->Remove(enter);
+    preheader->Append(split);
+  }
+  return true;
+}
+
+} // namespace pl0::ir
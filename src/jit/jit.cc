@@ -0,0 +1,997 @@
+#include "jit/jit.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+
+#include "bytecode/superinstruction.h"
+#include "jit/x64_assembler.h"
+
+#if PL0_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+namespace pl0::jit {
+
+// Facts about the whole program shared by every compilation.
+struct Analysis {
+  std::vector<bool> procedure_entry;
+  std::vector<bool> jump_target;
+  // targets of backward jumps, where native code can be entered mid-procedure
+  std::vector<bool> loop_header;
+  // lexical level of the procedure starting at each entry, -1 if never called
+  std::vector<int> levels;
+  std::vector<int> entries;
+
+  explicit Analysis(const bytecode &code);
+
+  // the entry of the procedure containing pos
+  [[nodiscard]] int Owner(int pos) const {
+    return *(std::upper_bound(entries.begin(), entries.end(), pos) - 1);
+  }
+
+  // one past the last instruction of the procedure starting at entry
+  [[nodiscard]] int End(int entry) const {
+    auto next = std::upper_bound(entries.begin(), entries.end(), entry);
+    return next == entries.end() ? static_cast<int>(procedure_entry.size()) - 1
+                                 : *next;
+  }
+
+  [[nodiscard]] int display_size() const {
+    return *std::max_element(levels.begin(), levels.end()) + 1;
+  }
+};
+
+Analysis::Analysis(const bytecode &code) {
+  const int length = static_cast<int>(code.size());
+  jump_target.assign(length + 1, false);
+  loop_header.assign(length + 1, false);
+  procedure_entry.assign(length + 1, false);
+  procedure_entry[0] = true;
+  for (int pos = 0; pos < length; pos++) {
+    const auto &ins = code[pos];
+    auto op = Unfused(ins.op);
+    if (ins.address < 0 || ins.address > length) { continue; }
+    if (op == opcode::JMP || op == opcode::JPC) {
+      jump_target[ins.address] = true;
+      if (op == opcode::JMP && ins.address <= pos) {
+        loop_header[ins.address] = true;
+      }
+    } else if (IsCall(op)) {
+      procedure_entry[ins.address] = true;
+    }
+  }
+  for (int pos = 0; pos < length; pos++) {
+    if (procedure_entry[pos]) { entries.push_back(pos); }
+  }
+
+  // a call at level distance d from level l enters level l - d + 1
+  levels.assign(length + 1, -1);
+  levels[0] = 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    int level = -1;
+    for (int pos = 0; pos < length; pos++) {
+      if (procedure_entry[pos]) { level = levels[pos]; }
+      const auto &ins = code[pos];
+      if (level < 0 || !IsCall(Unfused(ins.op))) { continue; }
+      if (levels[ins.address] < 0) {
+        levels[ins.address] = level - ins.level + 1;
+        changed = true;
+      }
+    }
+  }
+}
+
+namespace {
+
+// Everything native code needs from C++, addressed through r13.
+struct Runtime {
+  int *stack_base;
+  int *stack_limit;
+  int *display;
+  void *saved_rsp;
+  void *machine_stack_top;
+  Io *io;
+};
+
+using Trampoline = int (*)(Runtime *, int *, const void *);
+
+// how native code left, bailing out through EmitExit for all but kReturned
+enum Exit : int {
+  kReturned,
+  kStackOverflow,
+  kDivisionByZero,
+  kDivisionOverflow,
+  kExitCount
+};
+
+// Registers pinned for the whole run.
+constexpr Reg kStackBase = RBX;
+constexpr Reg kFrame = R12;
+constexpr Reg kRuntime = R13;
+constexpr Reg kStackLimit = R14;
+constexpr Reg kDisplay = R15;
+
+// Registers holding operand stack entries. RAX and RDX are left out for
+// division and address computations.
+constexpr Reg kOperandRegisters[] = {R8, R9, R10, R11, RSI, RDI, RCX};
+
+int ReadInteger(Runtime *runtime) {
+  return runtime->io->Read();
+}
+
+void WriteInteger(Runtime *runtime, int value) {
+  runtime->io->Write(value);
+}
+
+Mem Slot(Reg frame, int slot) {
+  return {frame, slot * 4};
+}
+
+// k if magnitude is 2^k, -1 otherwise
+int Log2(uint32_t magnitude) {
+  if (magnitude == 0 || (magnitude & (magnitude - 1)) != 0) { return -1; }
+  int k = 0;
+  while (magnitude >> k != 1) { k++; }
+  return k;
+}
+
+uint32_t Magnitude(int32_t value) {
+  return value < 0 ? 0U - static_cast<uint32_t>(value)
+                   : static_cast<uint32_t>(value);
+}
+
+// n / d is the high half of n * multiplier, corrected by n where the signs
+// of multiplier and d differ, shifted right by shift and rounded towards zero
+struct Magic {
+  int32_t multiplier;
+  int shift;
+};
+
+// for 2 <= |d|, as in Hacker's Delight 10-1
+Magic MagicOf(int32_t d) {
+  constexpr uint32_t kTwo31 = 0x80000000U;
+  const uint32_t ad = Magnitude(d);
+  const uint32_t t = kTwo31 + (static_cast<uint32_t>(d) >> 31);
+  // |nc|, the largest multiple of d minus one that fits
+  const uint32_t anc = t - 1 - t % ad;
+  int p = 31;
+  uint32_t q1 = kTwo31 / anc, r1 = kTwo31 - q1 * anc;
+  uint32_t q2 = kTwo31 / ad, r2 = kTwo31 - q2 * ad;
+  uint32_t delta;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  auto multiplier = static_cast<int32_t>(q2 + 1);
+  if (d < 0) { multiplier = -multiplier; }
+  return {multiplier, p - 32};
+}
+
+class Translator {
+  // an operand stack entry, either folded or held in a register
+  struct Value {
+    bool constant;
+    int32_t value;
+    Reg reg;
+  };
+
+  struct Fixup {
+    int position;
+    int target;
+  };
+
+  const bytecode &code_;
+  const Analysis &analysis_;
+  // procedures compiled before, called through their absolute address
+  const std::vector<const uint8_t *> &compiled_;
+  X64Assembler masm_;
+  std::vector<int> native_;
+  std::vector<bool> selected_;
+  std::vector<std::pair<int, int>> osr_stubs_;
+  int level_{0};
+  std::vector<Fixup> fixups_;
+  std::vector<Value> stack_;
+  std::vector<Reg> free_;
+  // offsets of the stubs bailing out with each Exit
+  int exits_[kExitCount]{};
+  int frame_slots_{Stack::kHeaderSize};
+
+  Reg Allocate() {
+    if (free_.empty()) {
+      throw GeneralError("jit: expression too deep to keep in registers");
+    }
+    auto reg = free_.back();
+    free_.pop_back();
+    return reg;
+  }
+
+  void Release(const Value &value) {
+    if (!value.constant) { free_.push_back(value.reg); }
+  }
+
+  void ResetStack() {
+    stack_.clear();
+    free_.assign(std::begin(kOperandRegisters), std::end(kOperandRegisters));
+  }
+
+  void ExpectEmptyStack(int pos) const {
+    if (!stack_.empty()) {
+      throw GeneralError(
+          "jit: operand stack is not empty at instruction ", pos);
+    }
+  }
+
+  // code no path reaches is translated too, it is only verified for the
+  // interpreter
+  [[nodiscard]] const Value &Top() const {
+    if (stack_.empty()) { throw GeneralError("jit: operand stack underflow"); }
+    return stack_.back();
+  }
+
+  Value Pop() {
+    auto value = Top();
+    stack_.pop_back();
+    return value;
+  }
+
+  void PushConstant(int32_t value) { stack_.push_back({true, value, kNoReg}); }
+  void PushRegister(Reg reg) { stack_.push_back({false, 0, reg}); }
+
+  Reg Materialize(const Value &value) {
+    if (!value.constant) { return value.reg; }
+    auto reg = Allocate();
+    masm_.Mov(reg, value.value);
+    return reg;
+  }
+
+  // the frame level_dist levels out, looked up in the display into RAX
+  Reg Frame(int level_dist) {
+    if (level_dist == 0) { return kFrame; }
+    masm_.Movsxd(RAX, Slot(kDisplay, level_ - level_dist));
+    masm_.Lea64(RAX, {kStackBase, 0, RAX, 4});
+    return RAX;
+  }
+
+  Mem Local(int level_dist, int index) {
+    return Slot(Frame(level_dist), Stack::kHeaderSize + index);
+  }
+
+  void Branch(int fixup, int target) { fixups_.push_back({fixup, target}); }
+
+  // targets below zero stand for the stubs
+  void BailOut(Condition cc, Exit exit) { Branch(masm_.Jcc(cc), -exit); }
+
+  void CheckOverflow(int slots) {
+    masm_.Lea64(RAX, Slot(kFrame, slots));
+    masm_.Cmp64(RAX, kStackLimit);
+    BailOut(kAbove, kStackOverflow);
+  }
+
+  // the divisions the interpreter reports, of the dividend in RAX
+  void CheckDivision(Reg divisor) {
+    masm_.Test(divisor, divisor);
+    BailOut(kEqual, kDivisionByZero);
+    masm_.Cmp(divisor, -1);
+    const int skip = masm_.Jcc(kNotEqual);
+    masm_.Cmp(RAX, INT_MIN);
+    BailOut(kEqual, kDivisionOverflow);
+    masm_.Patch(skip, masm_.size());
+  }
+
+  // the offset of a frame pointer, as stored in the links
+  void FrameOffset(Reg dst, Reg frame) {
+    if (dst != frame) { masm_.Mov64(dst, frame); }
+    masm_.Sub64(dst, kStackBase);
+    masm_.Shr64(dst, 2);
+  }
+
+  void CallRuntime(const void *function) {
+    masm_.Mov64(RDI, kRuntime);
+    masm_.Mov64(RAX, reinterpret_cast<int64_t>(function));
+    masm_.Call(RAX);
+  }
+
+  void EmitExit(int status);
+  void EmitArithmetic(opcode op);
+  void EmitDivision();
+  void DivideByConstant(Reg dst, int32_t divisor);
+  void EmitDivisibility(int pos);
+  void EmitCondition(Condition cc, Reg reg, int pos);
+  void EmitComparison(Condition cc, int pos);
+  void EmitOdd(int pos);
+  void EmitCall(const Instruction &ins, int pos);
+  void EmitTailCall(const Instruction &ins, int pos);
+  void EmitEnter(const Instruction &ins);
+  void Translate(int pos);
+
+  [[nodiscard]] bool FollowedByBranch(int pos) const {
+    return pos + 1 < static_cast<int>(code_.size())
+           && Unfused(code_[pos + 1].op) == opcode::JPC
+           && !analysis_.jump_target[pos + 1];
+  }
+
+ public:
+  Translator(
+      const bytecode &code,
+      const Analysis &analysis,
+      const std::vector<const uint8_t *> &compiled)
+      : code_(code), analysis_(analysis), compiled_(compiled) {}
+
+  /**
+   * Translate the procedures starting at entries into one piece of code,
+   * followed by an entry stub for each of their loop headers
+   */
+  void Generate(const std::vector<int> &entries);
+
+  [[nodiscard]] const std::vector<uint8_t> &buffer() const {
+    return masm_.buffer();
+  }
+  [[nodiscard]] int native(int pos) const { return native_[pos]; }
+  // (loop header, offset of its stub)
+  [[nodiscard]] const std::vector<std::pair<int, int>> &osr_stubs() const {
+    return osr_stubs_;
+  }
+};
+
+/**
+ * int Enter(Runtime *runtime, int *frame, const void *target)
+ *
+ * Saves the callee-saved registers, switches to the machine stack and calls
+ * target, which returns once the procedure of frame returns. Returns an Exit,
+ * kReturned unless native code bailed out.
+ */
+std::vector<uint8_t> TrampolineCode() {
+  X64Assembler masm;
+  for (auto reg : {RBX, RBP, R12, R13, R14, R15}) { masm.Push(reg); }
+  masm.Mov64(kRuntime, RDI);
+  masm.Mov64(kStackBase, Mem{kRuntime, offsetof(Runtime, stack_base)});
+  masm.Mov64(kStackLimit, Mem{kRuntime, offsetof(Runtime, stack_limit)});
+  masm.Mov64(kDisplay, Mem{kRuntime, offsetof(Runtime, display)});
+  masm.Mov64(kFrame, RSI);
+  masm.Mov64(Mem{kRuntime, offsetof(Runtime, saved_rsp)}, RSP);
+  masm.Mov64(RSP, Mem{kRuntime, offsetof(Runtime, machine_stack_top)});
+  masm.Call(RDX);
+  masm.Xor(RAX, RAX);
+  masm.Mov64(RSP, Mem{kRuntime, offsetof(Runtime, saved_rsp)});
+  for (auto reg : {R15, R14, R13, R12, RBP, RBX}) { masm.Pop(reg); }
+  masm.Ret();
+  return masm.buffer();
+}
+
+// Leave native code from any depth, as the trampoline would
+void Translator::EmitExit(int status) {
+  masm_.Mov(RAX, status);
+  masm_.Mov64(RSP, Mem{kRuntime, offsetof(Runtime, saved_rsp)});
+  for (auto reg : {R15, R14, R13, R12, RBP, RBX}) { masm_.Pop(reg); }
+  masm_.Ret();
+}
+
+void Translator::EmitArithmetic(opcode op) {
+  auto rhs = Pop(), lhs = Pop();
+  if (lhs.constant && rhs.constant) {
+    const int64_t l = lhs.value, r = rhs.value;
+    PushConstant(Wrap(op == opcode::ADD   ? l + r
+                      : op == opcode::SUB ? l - r
+                                          : l * r));
+    return;
+  }
+  if (lhs.constant && op != opcode::SUB) { std::swap(lhs, rhs); }
+  auto dst = Materialize(lhs);
+  if (rhs.constant) {
+    switch (op) {
+      case opcode::ADD:
+        masm_.Add(dst, rhs.value);
+        break;
+      case opcode::SUB:
+        masm_.Sub(dst, rhs.value);
+        break;
+      default:
+        if (const int k = Log2(static_cast<uint32_t>(rhs.value)); k > 0) {
+          masm_.Shl(dst, static_cast<uint8_t>(k));
+        } else {
+          masm_.Imul(dst, dst, rhs.value);
+        }
+        break;
+    }
+  } else {
+    switch (op) {
+      case opcode::ADD:
+        masm_.Add(dst, rhs.reg);
+        break;
+      case opcode::SUB:
+        masm_.Sub(dst, rhs.reg);
+        break;
+      default:
+        masm_.Imul(dst, rhs.reg);
+        break;
+    }
+    Release(rhs);
+  }
+  PushRegister(dst);
+}
+
+void Translator::EmitDivision() {
+  auto rhs = Pop(), lhs = Pop();
+  // division by zero and overflow are left to be reported at run time
+  if (lhs.constant && rhs.constant && rhs.value != 0
+      && !(lhs.value == INT_MIN && rhs.value == -1)) {
+    PushConstant(lhs.value / rhs.value);
+    return;
+  }
+  // 0 and -1 are left to idiv, checked for them
+  if (!lhs.constant && rhs.constant && rhs.value != 0 && rhs.value != -1) {
+    DivideByConstant(lhs.reg, rhs.value);
+    PushRegister(lhs.reg);
+    return;
+  }
+  auto divisor = Materialize(rhs);
+  if (lhs.constant) {
+    masm_.Mov(RAX, lhs.value);
+  } else {
+    masm_.Mov(RAX, lhs.reg);
+  }
+  CheckDivision(divisor);
+  masm_.Cdq();
+  masm_.Idiv(divisor);
+  auto dst = divisor;
+  if (!lhs.constant) {
+    dst = lhs.reg;
+    free_.push_back(divisor);
+  }
+  masm_.Mov(dst, RAX);
+  PushRegister(dst);
+}
+
+// truncating like idiv, without it: shifts for a power of two, otherwise a
+// multiplication by the magic number of the divisor
+void Translator::DivideByConstant(Reg dst, int32_t divisor) {
+  if (divisor == 1) { return; }
+  const int k = Log2(Magnitude(divisor));
+  if (k > 0) {
+    // a negative dividend is biased by 2^k - 1 to round towards zero
+    masm_.Mov(RAX, dst);
+    masm_.Sar(RAX, 31);
+    masm_.Shr(RAX, static_cast<uint8_t>(32 - k));
+    masm_.Add(dst, RAX);
+    masm_.Sar(dst, static_cast<uint8_t>(k));
+    if (divisor < 0) { masm_.Neg(dst); }
+    return;
+  }
+  const auto magic = MagicOf(divisor);
+  masm_.Movsxd(RAX, dst);
+  masm_.Imul64(RAX, RAX, magic.multiplier);
+  masm_.Sar64(RAX, 32);
+  if (divisor > 0 && magic.multiplier < 0) { masm_.Add(RAX, dst); }
+  if (divisor < 0 && magic.multiplier > 0) { masm_.Sub(RAX, dst); }
+  if (magic.shift > 0) { masm_.Sar(RAX, static_cast<uint8_t>(magic.shift)); }
+  // plus one for a negative quotient
+  masm_.Mov(dst, RAX);
+  masm_.Shr(dst, 31);
+  masm_.Add(dst, RAX);
+}
+
+void Translator::EmitDivisibility(int pos) {
+  auto rhs = Pop(), lhs = Pop();
+  if (lhs.constant && rhs.constant && rhs.value != 0
+      && !(lhs.value == INT_MIN && rhs.value == -1)) {
+    PushConstant(lhs.value % rhs.value == 0);
+    return;
+  }
+  if (rhs.constant && rhs.value == 1) {
+    Release(lhs);
+    PushConstant(1);
+    return;
+  }
+  auto dividend = Materialize(lhs);
+  if (rhs.constant && rhs.value != 0 && rhs.value != -1) {
+    if (const int k = Log2(Magnitude(rhs.value)); k > 0) {
+      masm_.And(dividend, static_cast<int32_t>((1U << k) - 1));
+    } else {
+      auto quotient = Allocate();
+      masm_.Mov(quotient, dividend);
+      DivideByConstant(quotient, rhs.value);
+      masm_.Imul(quotient, quotient, rhs.value);
+      masm_.Cmp(quotient, dividend);
+      free_.push_back(quotient);
+    }
+    EmitCondition(kEqual, dividend, pos);
+    return;
+  }
+  auto divisor = Materialize(rhs);
+  masm_.Mov(RAX, dividend);
+  CheckDivision(divisor);
+  masm_.Cdq();
+  masm_.Idiv(divisor);
+  free_.push_back(divisor);
+  masm_.Test(RDX, RDX);
+  EmitCondition(kEqual, dividend, pos);
+}
+
+// the flags hold the outcome, reg becomes the result unless a branch takes
+// it right away
+void Translator::EmitCondition(Condition cc, Reg reg, int pos) {
+  if (FollowedByBranch(pos)) {
+    // the result only feeds the next JPC, branch on the flags directly
+    free_.push_back(reg);
+    native_[pos + 1] = masm_.size();
+    Branch(masm_.Jcc(Negate(cc)), code_[pos + 1].address);
+    return;
+  }
+  masm_.Setcc(cc, reg);
+  masm_.Movzxb(reg, reg);
+  PushRegister(reg);
+}
+
+void Translator::EmitComparison(Condition cc, int pos) {
+  auto rhs = Pop(), lhs = Pop();
+  if (lhs.constant && rhs.constant) {
+    const int l = lhs.value, r = rhs.value;
+    bool result;
+    switch (cc) {
+      case kLess:
+        result = l < r;
+        break;
+      case kLessEqual:
+        result = l <= r;
+        break;
+      case kGreater:
+        result = l > r;
+        break;
+      case kGreaterEqual:
+        result = l >= r;
+        break;
+      case kEqual:
+        result = l == r;
+        break;
+      default:
+        result = l != r;
+        break;
+    }
+    PushConstant(result);
+    return;
+  }
+  if (lhs.constant) {
+    std::swap(lhs, rhs);
+    switch (cc) {
+      case kLess:
+        cc = kGreater;
+        break;
+      case kLessEqual:
+        cc = kGreaterEqual;
+        break;
+      case kGreater:
+        cc = kLess;
+        break;
+      case kGreaterEqual:
+        cc = kLessEqual;
+        break;
+      default:
+        break;
+    }
+  }
+  if (rhs.constant) {
+    masm_.Cmp(lhs.reg, rhs.value);
+  } else {
+    masm_.Cmp(lhs.reg, rhs.reg);
+    Release(rhs);
+  }
+  EmitCondition(cc, lhs.reg, pos);
+}
+
+void Translator::EmitOdd(int pos) {
+  auto value = Pop();
+  if (value.constant) {
+    PushConstant(value.value % 2);
+    return;
+  }
+  const auto reg = value.reg;
+  if (FollowedByBranch(pos)) {
+    Release(value);
+    masm_.And(reg, 1);
+    native_[pos + 1] = masm_.size();
+    Branch(masm_.Jcc(kEqual), code_[pos + 1].address);
+    return;
+  }
+  // the remainder keeps the sign of the dividend, like % does
+  masm_.Mov(RAX, reg);
+  masm_.Sar(RAX, 31);
+  masm_.And(reg, 1);
+  masm_.Xor(reg, RAX);
+  masm_.Sub(reg, RAX);
+  PushRegister(reg);
+}
+
+void Translator::EmitCall(const Instruction &ins, int pos) {
+  ExpectEmptyStack(pos);
+  CheckOverflow(frame_slots_ + Stack::kHeaderSize);
+  const int callee_level = level_ - ins.level + 1;
+  FrameOffset(RDX, kFrame);
+  masm_.Mov(Slot(kFrame, frame_slots_ + Stack::kDynamicLink), RDX);
+  masm_.Mov(Slot(kFrame, frame_slots_ + Stack::kReturnAddress), pos + 1);
+  masm_.Mov(RAX, Slot(kDisplay, callee_level));
+  masm_.Mov(Slot(kFrame, frame_slots_ + Stack::kSavedDisplay), RAX);
+  masm_.Mov(Slot(kFrame, frame_slots_ + Stack::kCallerLevel), level_);
+  masm_.Add(RDX, frame_slots_);
+  masm_.Mov(Slot(kDisplay, callee_level), RDX);
+  masm_.Lea64(kFrame, Slot(kFrame, frame_slots_));
+  if (selected_[ins.address]) {
+    Branch(masm_.Call(), ins.address);
+  } else {
+    masm_.Mov64(RAX, reinterpret_cast<int64_t>(compiled_[ins.address]));
+    masm_.Call(RAX);
+  }
+}
+
+// Hand the frame over to the callee, which returns straight to our caller.
+// The caller level in the header stays as it is.
+void Translator::EmitTailCall(const Instruction &ins, int pos) {
+  ExpectEmptyStack(pos);
+  const int callee_level = level_ - ins.level + 1;
+  masm_.Mov(RAX, Slot(kFrame, Stack::kSavedDisplay));
+  masm_.Mov(Slot(kDisplay, level_), RAX);
+  masm_.Mov(RAX, Slot(kDisplay, callee_level));
+  masm_.Mov(Slot(kFrame, Stack::kSavedDisplay), RAX);
+  FrameOffset(RDX, kFrame);
+  masm_.Mov(Slot(kDisplay, callee_level), RDX);
+  // the callee reserves its own alignment slot on entry
+  masm_.Add64(RSP, 8);
+  if (selected_[ins.address]) {
+    Branch(masm_.Jmp(), ins.address);
+  } else {
+    masm_.Mov64(RAX, reinterpret_cast<int64_t>(compiled_[ins.address]));
+    masm_.Jmp(RAX);
+  }
+  ResetStack();
+}
+
+void Translator::EmitEnter(const Instruction &ins) {
+  const int locals = ins.address - kFrameBookkeeping;
+  frame_slots_ = Stack::kHeaderSize + locals;
+  CheckOverflow(frame_slots_);
+  if (locals <= 8) {
+    for (int i = 0; i < locals; i++) {
+      masm_.Mov(Slot(kFrame, Stack::kHeaderSize + i), 0);
+    }
+    return;
+  }
+  masm_.Lea64(RDI, Slot(kFrame, Stack::kHeaderSize));
+  masm_.Mov(RCX, locals);
+  masm_.Xor(RAX, RAX);
+  masm_.RepStosd();
+}
+
+void Translator::Translate(int pos) {
+  const auto &ins = code_[pos];
+  switch (Unfused(ins.op)) {
+    case opcode::LIT:
+      PushConstant(ins.address);
+      break;
+    case opcode::LOD: {
+      auto reg = Allocate();
+      masm_.Mov(reg, Local(ins.level, ins.address));
+      PushRegister(reg);
+      break;
+    }
+    case opcode::STO: {
+      auto value = Pop();
+      auto slot = Local(ins.level, ins.address);
+      if (value.constant) {
+        masm_.Mov(slot, value.value);
+      } else {
+        masm_.Mov(slot, value.reg);
+      }
+      Release(value);
+      break;
+    }
+    case opcode::CAL:
+      EmitCall(ins, pos);
+      break;
+    case opcode::TCL:
+      EmitTailCall(ins, pos);
+      break;
+    case opcode::INT:
+      EmitEnter(ins);
+      break;
+    case opcode::JMP:
+      ExpectEmptyStack(pos);
+      Branch(masm_.Jmp(), ins.address);
+      break;
+    case opcode::JPC: {
+      auto value = Pop();
+      if (value.constant) {
+        if (value.value == 0) { Branch(masm_.Jmp(), ins.address); }
+        break;
+      }
+      masm_.Test(value.reg, value.reg);
+      Release(value);
+      Branch(masm_.Jcc(kEqual), ins.address);
+      break;
+    }
+    case opcode::ADD:
+    case opcode::SUB:
+    case opcode::MUL:
+      EmitArithmetic(Unfused(ins.op));
+      break;
+    case opcode::DIV:
+      EmitDivision();
+      break;
+    case opcode::DVD:
+      EmitDivisibility(pos);
+      break;
+    case opcode::ODD:
+      EmitOdd(pos);
+      break;
+    case opcode::LT:
+      EmitComparison(kLess, pos);
+      break;
+    case opcode::LE:
+      EmitComparison(kLessEqual, pos);
+      break;
+    case opcode::GT:
+      EmitComparison(kGreater, pos);
+      break;
+    case opcode::GE:
+      EmitComparison(kGreaterEqual, pos);
+      break;
+    case opcode::EQ:
+      EmitComparison(kEqual, pos);
+      break;
+    case opcode::NE:
+      EmitComparison(kNotEqual, pos);
+      break;
+    case opcode::READ: {
+      ExpectEmptyStack(pos);
+      CallRuntime(reinterpret_cast<const void *>(&ReadInteger));
+      auto reg = Allocate();
+      masm_.Mov(reg, RAX);
+      PushRegister(reg);
+      break;
+    }
+    case opcode::WRITE: {
+      auto value = Pop();
+      ExpectEmptyStack(pos);
+      if (value.constant) {
+        masm_.Mov(RSI, value.value);
+      } else if (value.reg != RSI) {
+        masm_.Mov(RSI, value.reg);
+      }
+      Release(value);
+      CallRuntime(reinterpret_cast<const void *>(&WriteInteger));
+      break;
+    }
+    case opcode::DUP: {
+      const auto top = Top();
+      if (top.constant) {
+        PushConstant(top.value);
+        break;
+      }
+      auto reg = Allocate();
+      masm_.Mov(reg, top.reg);
+      PushRegister(reg);
+      break;
+    }
+    case opcode::RET:
+      masm_.Mov(RAX, Slot(kFrame, Stack::kSavedDisplay));
+      masm_.Mov(Slot(kDisplay, level_), RAX);
+      masm_.Movsxd(RAX, Slot(kFrame, Stack::kDynamicLink));
+      masm_.Lea64(kFrame, {kStackBase, 0, RAX, 4});
+      masm_.Add64(RSP, 8);
+      masm_.Ret();
+      ResetStack();
+      break;
+    default:
+      throw GeneralError("jit: unsupported opcode ", *ins.op);
+  }
+}
+
+void Translator::Generate(const std::vector<int> &entries) {
+  const int length = static_cast<int>(code_.size());
+  native_.assign(length, -1);
+  selected_.assign(length + 1, false);
+  for (auto entry : entries) { selected_[entry] = true; }
+
+  for (int exit = kStackOverflow; exit < kExitCount; exit++) {
+    exits_[exit] = masm_.size();
+    EmitExit(exit);
+  }
+
+  for (auto entry : entries) {
+    level_ = analysis_.levels[entry];
+    if (level_ < 0) {
+      throw GeneralError("jit: procedure at ", entry, " is never called");
+    }
+    ResetStack();
+    // a procedure without locals may have no INT
+    frame_slots_ = Stack::kHeaderSize;
+    native_[entry] = masm_.size();
+    // keep the machine stack 16-byte aligned for runtime calls
+    masm_.Sub64(RSP, 8);
+    Translate(entry);
+    for (int pos = entry + 1, end = analysis_.End(entry); pos < end; pos++) {
+      if (native_[pos] >= 0) {
+        // already emitted along with a fused compare and branch
+        continue;
+      }
+      if (analysis_.jump_target[pos]) { ExpectEmptyStack(pos); }
+      native_[pos] = masm_.size();
+      Translate(pos);
+    }
+    ExpectEmptyStack(entry);
+  }
+
+  // entering at a loop header: the interpreter has already set up the frame
+  for (auto entry : entries) {
+    for (int pos = entry + 1, end = analysis_.End(entry); pos < end; pos++) {
+      if (!analysis_.loop_header[pos] || native_[pos] < 0) { continue; }
+      osr_stubs_.emplace_back(pos, masm_.size());
+      masm_.Sub64(RSP, 8);
+      Branch(masm_.Jmp(), pos);
+    }
+  }
+
+  for (const auto &fixup : fixups_) {
+    if (fixup.target < 0) {
+      masm_.Patch(fixup.position, exits_[-fixup.target]);
+      continue;
+    }
+    if (fixup.target >= length || native_[fixup.target] < 0) {
+      throw GeneralError("jit: jump outside of the compiled code");
+    }
+    masm_.Patch(fixup.position, native_[fixup.target]);
+  }
+}
+
+} // namespace
+
+#if PL0_JIT_SUPPORTED
+
+// Every PL/0 call takes 16 bytes of machine stack, plus room for the runtime
+// calls made from the innermost frame.
+class MachineStack {
+  void *memory_;
+  size_t size_;
+
+ public:
+  explicit MachineStack(int stack_size)
+      : size_(
+          (static_cast<size_t>(stack_size) / Stack::kHeaderSize + 1) * 16
+          + (1 << 20)) {
+    size_ = (size_ + 4095) & ~static_cast<size_t>(4095);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    memory_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (memory_ == MAP_FAILED) {
+      throw RuntimeError("cannot allocate the native stack");
+    }
+  }
+  ~MachineStack() { munmap(memory_, size_); }
+  MachineStack(const MachineStack &) = delete;
+  MachineStack &operator=(const MachineStack &) = delete;
+
+  [[nodiscard]] void *top() const {
+    return static_cast<char *>(memory_) + size_;
+  }
+};
+
+#else
+
+class MachineStack {};
+
+#endif
+
+NativeCode::NativeCode(const bytecode &code)
+    : code_(code),
+      analysis_(std::make_unique<Analysis>(code)),
+      compiled_(code.size() + 1, nullptr) {
+  if (!kJitAvailable) {
+    throw GeneralError("jit: not supported on this platform");
+  }
+  chunks_.push_back(std::make_unique<ExecutableMemory>(TrampolineCode()));
+}
+
+NativeCode::~NativeCode() = default;
+
+const void *NativeCode::Compile(int pos) {
+  if (pos < 0 || pos >= static_cast<int>(code_.size())) {
+    throw GeneralError("jit: no code at ", pos);
+  }
+  if (compiled_[pos] != nullptr) { return compiled_[pos]; }
+
+  // the procedure and everything it may call that has no native code yet,
+  // native code never calls back into the interpreter
+  std::vector<int> entries;
+  std::vector<int> worklist{analysis_->Owner(pos)};
+  std::vector<bool> seen(code_.size() + 1, false);
+  seen[worklist.back()] = true;
+  while (!worklist.empty()) {
+    const int entry = worklist.back();
+    worklist.pop_back();
+    entries.push_back(entry);
+    for (int i = entry, end = analysis_->End(entry); i < end; i++) {
+      const auto &ins = code_[i];
+      if (!IsCall(Unfused(ins.op)) || seen[ins.address]
+          || compiled_[ins.address] != nullptr) {
+        continue;
+      }
+      seen[ins.address] = true;
+      worklist.push_back(ins.address);
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+
+  Translator translator{code_, *analysis_, compiled_};
+  translator.Generate(entries);
+  auto chunk = std::make_unique<ExecutableMemory>(translator.buffer());
+  for (auto entry : entries) {
+    compiled_[entry] = chunk->data() + translator.native(entry);
+  }
+  for (const auto &stub : translator.osr_stubs()) {
+    compiled_[stub.first] = chunk->data() + stub.second;
+  }
+  code_size_ += translator.buffer().size();
+  chunks_.push_back(std::move(chunk));
+
+  if (compiled_[pos] == nullptr) {
+    throw GeneralError("jit: cannot enter native code at ", pos);
+  }
+  return compiled_[pos];
+}
+
+void NativeCode::Enter(
+    Stack &stack, Display &display, Io &io, int bp, const void *code) {
+#if PL0_JIT_SUPPORTED
+  if (!machine_stack_ || machine_stack_capacity_ != stack.capacity()) {
+    machine_stack_ = std::make_unique<MachineStack>(stack.capacity());
+    machine_stack_capacity_ = stack.capacity();
+  }
+  Runtime runtime{
+      &stack[0], &stack[0] + stack.capacity(), display.frames(), nullptr,
+      machine_stack_->top(), &io};
+  // the trampoline is the first chunk
+  auto enter = reinterpret_cast<Trampoline>(
+      reinterpret_cast<uintptr_t>(chunks_[0]->data()));
+  switch (enter(&runtime, &stack[bp], code)) {
+    case kStackOverflow:
+      throw RuntimeError("stack overflow");
+    case kDivisionByZero:
+      throw RuntimeError("division by zero");
+    case kDivisionOverflow:
+      throw RuntimeError("division overflow");
+    default:
+      break;
+  }
+#else
+  (void)stack, (void)display, (void)io, (void)bp, (void)code;
+  throw GeneralError("jit: not supported on this platform");
+#endif
+}
+
+void NativeCode::Run(int stack_size, Io &io) {
+  const void *main = Compile(0);
+  Stack stack{stack_size};
+  stack.Reserve(0, Stack::kHeaderSize);
+  stack[Stack::kDynamicLink] = 0;
+  stack[Stack::kReturnAddress] = static_cast<int>(code_.size());
+  stack[Stack::kSavedDisplay] = 0;
+  stack[Stack::kCallerLevel] = 0;
+  Display display{analysis_->display_size()};
+  Enter(stack, display, io, 0, main);
+}
+
+} // namespace pl0::jit
@@ -0,0 +1,359 @@
+#include "jit/x64_assembler.h"
+
+#include <cstring>
+
+#include "jit/jit.h"
+#include "util.h"
+
+#if PL0_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+namespace pl0::jit {
+
+namespace {
+
+bool IsInt8(int32_t value) {
+  return value >= -128 && value <= 127;
+}
+
+} // namespace
+
+void X64Assembler::Int32(int32_t value) {
+  for (int i = 0; i < 4; i++) { Byte(static_cast<uint8_t>(value >> (8 * i))); }
+}
+
+void X64Assembler::Int64(int64_t value) {
+  for (int i = 0; i < 8; i++) { Byte(static_cast<uint8_t>(value >> (8 * i))); }
+}
+
+void X64Assembler::Rex(
+    bool wide, uint8_t reg, uint8_t index, uint8_t base, bool byte_reg) {
+  uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg >> 3 & 1) << 2)
+                | ((index >> 3 & 1) << 1) | (base >> 3 & 1);
+  // SPL, BPL, SIL and DIL can only be addressed with a REX prefix
+  if (rex != 0x40 || byte_reg) { Byte(rex); }
+}
+
+void X64Assembler::ModRM(uint8_t reg, Reg rm) {
+  Byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+void X64Assembler::ModRM(uint8_t reg, const Mem &mem) {
+  const uint8_t base = mem.base & 7;
+  uint8_t mod;
+  if (mem.disp == 0 && base != RBP) {
+    mod = 0;
+  } else if (IsInt8(mem.disp)) {
+    mod = 1;
+  } else {
+    mod = 2;
+  }
+  if (mem.index == kNoReg && base != RSP) {
+    Byte(mod << 6 | (reg & 7) << 3 | base);
+  } else {
+    uint8_t scale = 0;
+    while ((1 << scale) < mem.scale) { scale++; }
+    const uint8_t index = mem.index == kNoReg ? RSP : mem.index & 7;
+    Byte(mod << 6 | (reg & 7) << 3 | RSP);
+    Byte(scale << 6 | index << 3 | base);
+  }
+  if (mod == 1) {
+    Byte(static_cast<uint8_t>(mem.disp));
+  } else if (mod == 2) {
+    Int32(mem.disp);
+  }
+}
+
+void X64Assembler::RegReg(uint8_t opcode, uint8_t reg, Reg rm, bool wide) {
+  Rex(wide, reg, 0, rm, false);
+  Byte(opcode);
+  ModRM(reg, rm);
+}
+
+void X64Assembler::RegMem(
+    uint8_t opcode, uint8_t reg, const Mem &mem, bool wide) {
+  Rex(wide, reg, mem.index == kNoReg ? 0 : mem.index, mem.base, false);
+  Byte(opcode);
+  ModRM(reg, mem);
+}
+
+void X64Assembler::Group1(uint8_t ext, Reg dst, int32_t imm, bool wide) {
+  Rex(wide, 0, 0, dst, false);
+  if (IsInt8(imm)) {
+    Byte(0x83);
+    ModRM(ext, dst);
+    Byte(static_cast<uint8_t>(imm));
+  } else {
+    Byte(0x81);
+    ModRM(ext, dst);
+    Int32(imm);
+  }
+}
+
+void X64Assembler::Mov(Reg dst, Reg src) {
+  RegReg(0x89, src, dst);
+}
+
+void X64Assembler::Mov(Reg dst, int32_t imm) {
+  Rex(false, 0, 0, dst, false);
+  Byte(0xb8 + (dst & 7));
+  Int32(imm);
+}
+
+void X64Assembler::Mov(Reg dst, const Mem &src) {
+  RegMem(0x8b, dst, src);
+}
+
+void X64Assembler::Mov(const Mem &dst, Reg src) {
+  RegMem(0x89, src, dst);
+}
+
+void X64Assembler::Mov(const Mem &dst, int32_t imm) {
+  RegMem(0xc7, 0, dst);
+  Int32(imm);
+}
+
+void X64Assembler::Mov64(Reg dst, Reg src) {
+  RegReg(0x89, src, dst, true);
+}
+
+void X64Assembler::Mov64(Reg dst, int64_t imm) {
+  Rex(true, 0, 0, dst, false);
+  Byte(0xb8 + (dst & 7));
+  Int64(imm);
+}
+
+void X64Assembler::Mov64(Reg dst, const Mem &src) {
+  RegMem(0x8b, dst, src, true);
+}
+
+void X64Assembler::Mov64(const Mem &dst, Reg src) {
+  RegMem(0x89, src, dst, true);
+}
+
+void X64Assembler::Movsxd(Reg dst, Reg src) {
+  RegReg(0x63, dst, src, true);
+}
+
+void X64Assembler::Movsxd(Reg dst, const Mem &src) {
+  RegMem(0x63, dst, src, true);
+}
+
+void X64Assembler::Lea64(Reg dst, const Mem &src) {
+  RegMem(0x8d, dst, src, true);
+}
+
+void X64Assembler::Add(Reg dst, Reg src) {
+  RegReg(0x01, src, dst);
+}
+
+void X64Assembler::Add(Reg dst, int32_t imm) {
+  Group1(0, dst, imm, false);
+}
+
+void X64Assembler::Sub(Reg dst, Reg src) {
+  RegReg(0x29, src, dst);
+}
+
+void X64Assembler::Sub(Reg dst, int32_t imm) {
+  Group1(5, dst, imm, false);
+}
+
+void X64Assembler::And(Reg dst, int32_t imm) {
+  Group1(4, dst, imm, false);
+}
+
+void X64Assembler::Xor(Reg dst, Reg src) {
+  RegReg(0x31, src, dst);
+}
+
+void X64Assembler::Cmp(Reg lhs, Reg rhs) {
+  RegReg(0x39, rhs, lhs);
+}
+
+void X64Assembler::Cmp(Reg lhs, int32_t imm) {
+  Group1(7, lhs, imm, false);
+}
+
+void X64Assembler::Test(Reg lhs, Reg rhs) {
+  RegReg(0x85, rhs, lhs);
+}
+
+void X64Assembler::Imul(Reg dst, Reg src) {
+  Rex(false, dst, 0, src, false);
+  Byte(0x0f);
+  Byte(0xaf);
+  ModRM(dst, src);
+}
+
+void X64Assembler::Imul(Reg dst, Reg src, int32_t imm) {
+  Rex(false, dst, 0, src, false);
+  if (IsInt8(imm)) {
+    Byte(0x6b);
+    ModRM(dst, src);
+    Byte(static_cast<uint8_t>(imm));
+  } else {
+    Byte(0x69);
+    ModRM(dst, src);
+    Int32(imm);
+  }
+}
+
+void X64Assembler::Idiv(Reg divisor) {
+  RegReg(0xf7, 7, divisor);
+}
+
+void X64Assembler::Cdq() {
+  Byte(0x99);
+}
+
+void X64Assembler::Neg(Reg dst) {
+  RegReg(0xf7, 3, dst);
+}
+
+void X64Assembler::Shl(Reg dst, uint8_t count) {
+  RegReg(0xc1, 4, dst);
+  Byte(count);
+}
+
+void X64Assembler::Shr(Reg dst, uint8_t count) {
+  RegReg(0xc1, 5, dst);
+  Byte(count);
+}
+
+void X64Assembler::Sar(Reg dst, uint8_t count) {
+  RegReg(0xc1, 7, dst);
+  Byte(count);
+}
+
+void X64Assembler::Setcc(Condition cc, Reg dst) {
+  Rex(false, 0, 0, dst, dst >= RSP && dst <= RDI);
+  Byte(0x0f);
+  Byte(0x90 + cc);
+  ModRM(0, dst);
+}
+
+void X64Assembler::Movzxb(Reg dst, Reg src) {
+  Rex(false, dst, 0, src, src >= RSP && src <= RDI);
+  Byte(0x0f);
+  Byte(0xb6);
+  ModRM(dst, src);
+}
+
+void X64Assembler::Add64(Reg dst, int32_t imm) {
+  Group1(0, dst, imm, true);
+}
+
+void X64Assembler::Sub64(Reg dst, Reg src) {
+  RegReg(0x29, src, dst, true);
+}
+
+void X64Assembler::Sub64(Reg dst, int32_t imm) {
+  Group1(5, dst, imm, true);
+}
+
+void X64Assembler::Cmp64(Reg lhs, Reg rhs) {
+  RegReg(0x39, rhs, lhs, true);
+}
+
+void X64Assembler::Imul64(Reg dst, Reg src, int32_t imm) {
+  RegReg(0x69, dst, src, true);
+  Int32(imm);
+}
+
+void X64Assembler::Shr64(Reg dst, uint8_t count) {
+  RegReg(0xc1, 5, dst, true);
+  Byte(count);
+}
+
+void X64Assembler::Sar64(Reg dst, uint8_t count) {
+  RegReg(0xc1, 7, dst, true);
+  Byte(count);
+}
+
+void X64Assembler::Push(Reg reg) {
+  Rex(false, 0, 0, reg, false);
+  Byte(0x50 + (reg & 7));
+}
+
+void X64Assembler::Pop(Reg reg) {
+  Rex(false, 0, 0, reg, false);
+  Byte(0x58 + (reg & 7));
+}
+
+void X64Assembler::Call(Reg target) {
+  RegReg(0xff, 2, target);
+}
+
+void X64Assembler::Jmp(Reg target) {
+  RegReg(0xff, 4, target);
+}
+
+void X64Assembler::Ret() {
+  Byte(0xc3);
+}
+
+void X64Assembler::RepStosd() {
+  Byte(0xf3);
+  Byte(0xab);
+}
+
+int X64Assembler::Jmp() {
+  Byte(0xe9);
+  Int32(0);
+  return size() - 4;
+}
+
+int X64Assembler::Jcc(Condition cc) {
+  Byte(0x0f);
+  Byte(0x80 + cc);
+  Int32(0);
+  return size() - 4;
+}
+
+int X64Assembler::Call() {
+  Byte(0xe8);
+  Int32(0);
+  return size() - 4;
+}
+
+void X64Assembler::Patch(int fixup, int target) {
+  const int32_t rel = target - (fixup + 4);
+  std::memcpy(&buffer_[fixup], &rel, sizeof(rel));
+}
+
+#if PL0_JIT_SUPPORTED
+
+ExecutableMemory::ExecutableMemory(const std::vector<uint8_t> &code)
+    : size_(code.size()) {
+  memory_ = mmap(
+      nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+      0);
+  if (memory_ == MAP_FAILED) {
+    memory_ = nullptr;
+    throw GeneralError("jit: cannot map memory for native code");
+  }
+  std::memcpy(memory_, code.data(), size_);
+  if (mprotect(memory_, size_, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory_, size_);
+    memory_ = nullptr;
+    throw GeneralError("jit: cannot make native code executable");
+  }
+}
+
+ExecutableMemory::~ExecutableMemory() {
+  if (memory_ != nullptr) { munmap(memory_, size_); }
+}
+
+#else
+
+ExecutableMemory::ExecutableMemory(const std::vector<uint8_t> & /*code*/) {
+  throw GeneralError("jit: not supported on this platform");
+}
+
+ExecutableMemory::~ExecutableMemory() = default;
+
+#endif
+
+} // namespace pl0::jit
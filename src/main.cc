@@ -1,20 +1,99 @@
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include "argparser.h"
+#include "ast/constant_folder.h"
+#include "ast/dead_code_eliminator.h"
 #include "ast/printer.h"
+#include "bytecode/cache.h"
 #include "bytecode/compiler.h"
+#include "bytecode/image.h"
+#include "bytecode/peephole.h"
+#include "bytecode/register_compiler.h"
+#include "bytecode/superinstruction.h"
+#include "ir/builder.h"
+#include "ir/closed_form.h"
+#include "ir/gvn.h"
+#include "ir/licm.h"
+#include "ir/lowering.h"
+#include "ir/simplify.h"
+#include "ir/strength_reduction.h"
+#include "ir/unroll.h"
+#include "jit/jit.h"
 #include "parsing/parser.h"
+#include "partial_eval.h"
+#include "register_vm.h"
+#include "snapshot.h"
 #include "vm.h"
 
 struct options {
   bool show_ast = false;
+  bool show_ir = false;
   bool show_tokens = false;
   bool compile_only = false;
   bool show_bytecode = false;
+  bool classic_bytecode = false;
+  bool show_ngrams = false;
+  bool superinstructions = true;
+  bool peephole = true;
+  bool inlining = true;
+  bool folding = true;
+  bool dead_code_elimination = true;
+  bool ir = true;
+  bool gvn = true;
+  bool licm = true;
+  bool strength_reduction = true;
+  bool closed_form = true;
+  int unroll_factor = pl0::ir::LoopUnrolling::kDefaultFactor;
+  int unroll_budget = pl0::ir::LoopUnrolling::kDefaultBudget;
+  bool register_vm = false;
+  bool jit = false;
+  bool tiering = true;
+  int tier_threshold = pl0::Tiering{}.threshold;
+  bool show_tiers = false;
+  bool show_stats = false;
+  int stack_size = pl0::Stack::kDefaultCapacity;
+  pl0::Dispatch dispatch = pl0::Dispatch::kThreaded;
+  pl0::IoMode io = pl0::IoMode::kBuffered;
+  bool image = false;
+  std::string output_file;
+  bool cache = true;
+  std::string cache_dir;
+  int cache_size = pl0::CompilationCache::kDefaultCapacity >> 20;
+  bool show_cache = false;
+  std::string snapshot_file;
+  bool restore = false;
+  bool partial_eval = false;
+  int fuel = 10000000;
   std::string input_file;
 };
 
+void Optimize(const options &option, pl0::ir::Module &module) {
+  pl0::ir::PassManager passes;
+  passes.Add(std::make_unique<pl0::ir::SimplifyCfg>());
+  if (option.gvn) {
+    passes.Add(std::make_unique<pl0::ir::GlobalValueNumbering>());
+  }
+  if (option.licm) {
+    passes.Add(std::make_unique<pl0::ir::LoopInvariantCodeMotion>());
+  }
+  if (option.strength_reduction) {
+    passes.Add(std::make_unique<pl0::ir::StrengthReduction>());
+  }
+  if (option.closed_form) {
+    passes.Add(std::make_unique<pl0::ir::ClosedForm>());
+    // the loops replaced by constants are left unreachable
+    passes.Add(std::make_unique<pl0::ir::SimplifyCfg>());
+  }
+  passes.Add(std::make_unique<pl0::ir::LoopUnrolling>(
+      option.unroll_factor, option.unroll_budget));
+  // unreachable loops replaced, copies of loop bodies to merge
+  passes.Add(std::make_unique<pl0::ir::SimplifyCfg>());
+  passes.Add(std::make_unique<pl0::ir::DeadCodeElimination>());
+  passes.Run(module);
+}
+
 [[noreturn]] void PrintTokens(pl0::Lexer &lex) {
   while (true) {
     auto token = lex.peek();
@@ -26,11 +105,48 @@ struct options {
   exit(0);
 }
 
-void PrintBytecode(const pl0::bytecode &code) {
+void PrintBytecode(const pl0::bytecode &code, bool classic) {
   std::cout << "Bytecode Generate:\n";
   for (size_t i = 0; i < code.size(); i++) {
-    std::cout << i << '\t' << *code[i].op << '\t' << code[i].level << '\t'
-              << code[i].address << '\n';
+    if (classic) {
+      auto ins = pl0::Classic(
+          {pl0::Unfused(code[i].op), code[i].level, code[i].address});
+      std::cout << i << '\t' << ins.op << '\t' << ins.level << '\t'
+                << ins.address << '\n';
+    } else {
+      std::cout << i << '\t' << *code[i].op << '\t' << code[i].level << '\t'
+                << code[i].address << '\n';
+    }
+  }
+  std::cout << '\n';
+}
+
+int ParsePositive(const std::string &arg) {
+  try {
+    size_t end;
+    int value = std::stoi(arg, &end);
+    if (end == arg.size() && value > 0) { return value; }
+  } catch (std::logic_error &) {}
+  throw pl0::BasicError("expect a positive integer instead of '" + arg + '\'');
+}
+
+pl0::Dispatch ParseDispatch(const std::string &arg) {
+  if (arg == "switch") { return pl0::Dispatch::kSwitch; }
+  if (arg == "threaded") { return pl0::Dispatch::kThreaded; }
+  throw pl0::BasicError("unknown dispatch engine '" + arg + '\'');
+}
+
+pl0::IoMode ParseIo(const std::string &arg) {
+  if (arg == "stream") { return pl0::IoMode::kStream; }
+  if (arg == "buffered") { return pl0::IoMode::kBuffered; }
+  throw pl0::BasicError("unknown I/O mode '" + arg + '\'');
+}
+
+void PrintBytecode(const pl0::reg::bytecode &code) {
+  std::cout << "Register Bytecode Generate:\n";
+  for (size_t i = 0; i < code.size(); i++) {
+    std::cout << i << '\t' << *code[i].op << '\t' << code[i].a << '\t'
+              << code[i].b << '\t' << code[i].c << '\n';
   }
   std::cout << '\n';
 }
@@ -45,17 +161,183 @@ options parse_args(int argc, const char *argv[]) {
     parser.Flags(
         {"--show-ast", "-t"}, "Print abstract syntax tree.",
         &options::show_ast);
+    parser.Flags(
+        {"--show-ir"}, "Print the SSA form the bytecode is generated from.",
+        &options::show_ir);
     parser.Flags(
         {"--show-bytecode", "-s"}, "Print bytecode after code generation",
         &options::show_bytecode);
+    parser.Flags(
+        {"--classic-bytecode"},
+        "Print operations in the classic PL/0 form OPR 0 n with "
+        "--show-bytecode, superinstructions are shown unfused.",
+        &options::classic_bytecode);
     parser.Flags(
         {"--compile-only", "-c"},
         "If specified, bytecode will not be executed.", &options::compile_only);
+    parser.Store(
+        std::vector<std::string>{"--output", "-o"},
+        "Write the bytecode as a binary image to the given file.",
+        &options::output_file);
+    parser.Flags(
+        {"--image"},
+        "The input file is a binary image written by --output, run it without "
+        "compiling.",
+        &options::image);
+    parser.Store(
+        std::vector<std::string>{"--snapshot"},
+        "Save the state of the program to the given file right before its "
+        "first read, then carry on.",
+        &options::snapshot_file);
+    parser.Flags(
+        {"--restore"},
+        "The input file is a snapshot written by --snapshot, resume it.",
+        &options::restore);
+    parser.Flags(
+        {"--partial-eval"},
+        "Run the program at compile time up to its first read, and start the "
+        "run from there.",
+        &options::partial_eval);
+    parser.Store(
+        std::vector<std::string>{"--fuel"},
+        "Instructions --partial-eval may execute before it gives up folding "
+        "(default 10000000).",
+        &options::fuel, ParsePositive);
+    parser.Flags(
+        {"--no-cache"},
+        "Always compile, instead of reusing the bytecode of an unchanged "
+        "source from the compilation cache.",
+        &options::cache, false);
+    parser.Store(
+        std::vector<std::string>{"--cache-dir"},
+        "Directory of the compilation cache (default $PL0_CACHE_DIR, "
+        "$XDG_CACHE_HOME/pl0 or ~/.cache/pl0).",
+        &options::cache_dir);
+    parser.Store(
+        std::vector<std::string>{"--cache-size"},
+        "Size of the compilation cache in MiB before the least recently used "
+        "entries are evicted (default 64).",
+        &options::cache_size, ParsePositive);
+    parser.Flags(
+        {"--show-cache"},
+        "Report whether the compilation cache was hit, and its statistics.",
+        &options::show_cache);
+    parser.Store(
+        std::vector<std::string>{"--stack-size"},
+        "Capacity of the VM stack in slots (default 4194304).",
+        &options::stack_size, ParsePositive);
+    parser.Flags(
+        {"--register-vm", "-r"},
+        "Compile to register bytecode and run it on the register VM.",
+        &options::register_vm);
+    parser.Flags(
+        {"--jit"},
+        "Compile the bytecode to native code, falls back to the interpreter "
+        "where this is not possible.",
+        &options::jit);
+    parser.Flags(
+        {"--no-tiering"},
+        "Interpret everything instead of moving hot procedures and loops to "
+        "native code.",
+        &options::tiering, false);
+    parser.Store(
+        std::vector<std::string>{"--tier-threshold"},
+        "Calls of a procedure or iterations of a loop before it is compiled "
+        "to native code (default 1000).",
+        &options::tier_threshold, ParsePositive);
+    parser.Flags(
+        {"--show-tiers"}, "Report every procedure and loop moved to native code.",
+        &options::show_tiers);
+    parser.Flags(
+        {"--show-stats"},
+        "Print what the interpreter counted during the run on stderr.",
+        &options::show_stats);
+    parser.Flags(
+        {"--no-superinstructions"}, "Do not fuse common instruction sequences.",
+        &options::superinstructions, false);
+    parser.Flags(
+        {"--no-peephole"},
+        "Keep jumps to jumps, unreachable instructions, empty frame setups "
+        "and loads of what was just stored.",
+        &options::peephole, false);
+    parser.Flags(
+        {"--no-fold"},
+        "Compile constant expressions and conditions as written instead of "
+        "folding them.",
+        &options::folding, false);
+    parser.Flags(
+        {"--no-inline"},
+        "Call every procedure instead of expanding small and hot ones in "
+        "place.",
+        &options::inlining, false);
+    parser.Flags(
+        {"--no-dce"},
+        "Keep unreachable statements and procedures and assignments no one "
+        "reads.",
+        &options::dead_code_elimination, false);
+    parser.Flags(
+        {"--no-ir"},
+        "Generate bytecode straight from the syntax tree instead of going "
+        "through the SSA form.",
+        &options::ir, false);
+    parser.Flags(
+        {"--no-gvn"},
+        "Compute again what an earlier instruction already computed.",
+        &options::gvn, false);
+    parser.Flags(
+        {"--no-licm"},
+        "Leave what a loop computes the same way every time inside it.",
+        &options::licm, false);
+    parser.Flags(
+        {"--no-strength-reduction"},
+        "Keep divisibility tests as a division, a multiplication and a "
+        "comparison, and products of induction variables as they are.",
+        &options::strength_reduction, false);
+    parser.Flags(
+        {"--no-closed-form"},
+        "Run loops that only sum induction variables instead of computing "
+        "their results directly.",
+        &options::closed_form, false);
+    parser.Store(
+        std::vector<std::string>{"--unroll"},
+        "Iterations of a counted loop run for every test of its counter, 1 "
+        "to leave loops as they are (default 4).",
+        &options::unroll_factor, ParsePositive);
+    parser.Store(
+        std::vector<std::string>{"--unroll-budget"},
+        "Instructions unrolling may add to a loop (default 64).",
+        &options::unroll_budget, ParsePositive);
+    parser.Flags(
+        {"--show-ngrams"}, "Print the most frequent opcode n-grams.",
+        &options::show_ngrams);
+    parser.Store(
+        std::vector<std::string>{"--dispatch"},
+        "Interpreter engine, either 'threaded' (default) or 'switch'.",
+        &options::dispatch, ParseDispatch);
+    parser.Store(
+        std::vector<std::string>{"--io"},
+        "How READ and WRITE reach the standard streams, either 'buffered' "
+        "(default) or 'stream' for iostreams.",
+        &options::io, ParseIo);
     parser.Parse(argc, argv, option, rest);
 
     if (rest.empty()) { parser.ShowHelp(); }
 
     option.input_file = rest[0];
+    if (option.register_vm && (option.image || !option.output_file.empty())) {
+      throw pl0::BasicError("images hold stack bytecode, not register bytecode");
+    }
+    if ((option.restore || !option.snapshot_file.empty())
+        && (option.register_vm || option.jit || option.image)) {
+      throw pl0::BasicError(
+          "snapshots are taken of the stack machine interpreting source");
+    }
+    if (option.partial_eval
+        && (option.register_vm || option.jit || !option.snapshot_file.empty())) {
+      throw pl0::BasicError(
+          "partial evaluation hands a snapshot to the stack machine, which "
+          "cannot be combined with --register-vm, --jit or --snapshot");
+    }
     return option;
   } catch (pl0::BasicError &error) {
     std::cout << "Error: " << error.what() << '\n';
@@ -63,17 +345,168 @@ options parse_args(int argc, const char *argv[]) {
   }
 }
 
+void ReportCache(const pl0::CompilationCache &cache, bool hit) {
+  const auto stats = cache.statistics();
+  std::cerr << "cache: " << (hit ? "hit" : "miss") << " (" << stats.hits
+            << " hits, " << stats.misses << " misses, " << stats.evictions
+            << " evictions)\n";
+}
+
+int RunBytecode(
+    const options &option,
+    const pl0::bytecode &code,
+    const pl0::Snapshot *restore = nullptr) {
+  if (option.show_bytecode) { PrintBytecode(code, option.classic_bytecode); }
+
+  if (!option.output_file.empty()) {
+    try {
+      pl0::WriteImage(code, option.output_file);
+    } catch (pl0::GeneralError &error) {
+      std::cerr << "Error: " << error.what() << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (option.compile_only) { return 0; }
+
+  std::cout.flush();
+  auto io = pl0::MakeIo(option.io);
+
+  std::unique_ptr<pl0::jit::NativeCode> native;
+  if ((option.jit || option.tiering) && pl0::jit::kJitAvailable) {
+    native = std::make_unique<pl0::jit::NativeCode>(code);
+  } else if (option.jit) {
+    std::cerr << "Warning: jit: not supported on this platform, falling back "
+                 "to the interpreter\n";
+  }
+
+  // keeps what is written before the snapshot is taken
+  pl0::RecordingIo recorder{*io};
+  pl0::VirtualMachine vm{
+      code, option.snapshot_file.empty() ? *io : recorder, option.stack_size};
+  try {
+    if (option.jit && native) {
+      try {
+        native->Compile(0);
+      } catch (pl0::GeneralError &error) {
+        std::cerr << "Warning: " << error.what()
+                  << ", falling back to the interpreter\n";
+        native.reset();
+      }
+    }
+    if (option.jit && native) {
+      native->Run(option.stack_size, *io);
+    } else {
+      pl0::Tiering tiering;
+      tiering.tier = option.tiering ? native.get() : nullptr;
+      tiering.threshold = option.tier_threshold;
+      tiering.verbose = option.show_tiers;
+      if (restore != nullptr) {
+        vm.Restore(*restore);
+        for (int value : restore->output) { io->Write(value); }
+        vm.Continue(option.dispatch, tiering);
+      } else if (!option.snapshot_file.empty()) {
+        const bool reading = vm.RunToFirstRead(option.dispatch);
+        auto snapshot = vm.Save();
+        snapshot.output = recorder.written();
+        recorder.StopRecording();
+        try {
+          pl0::WriteSnapshot(snapshot, option.snapshot_file);
+        } catch (pl0::GeneralError &error) {
+          io->Flush();
+          std::cerr << "Error: " << error.what() << '\n';
+          return EXIT_FAILURE;
+        }
+        if (reading) { vm.Continue(option.dispatch, tiering); }
+      } else {
+        vm.Run(option.dispatch, tiering);
+      }
+      if (option.show_stats) {
+        io->Flush();
+        const auto &stats = vm.statistics();
+        std::cerr << "calls: " << stats.calls
+                  << "\npromotions: " << stats.promotions
+                  << "\npeak stack: " << stats.peak_stack << " slots\n";
+      }
+    }
+  } catch (pl0::RuntimeError &error) {
+    io->Flush();
+    std::cerr << "Runtime error: " << error.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
+
 int main(int argc, const char *argv[]) {
   auto option = parse_args(argc, argv);
 
+  if (option.restore) {
+    pl0::Snapshot snapshot;
+    try {
+      snapshot = pl0::LoadSnapshot(option.input_file);
+    } catch (pl0::GeneralError &error) {
+      std::cerr << "Error: " << error.what() << '\n';
+      return EXIT_FAILURE;
+    }
+    return RunBytecode(option, snapshot.code, &snapshot);
+  }
+
+  if (option.image) {
+    pl0::bytecode code;
+    try {
+      code = pl0::LoadImage(option.input_file).code;
+    } catch (pl0::GeneralError &error) {
+      std::cerr << "Error: " << error.what() << '\n';
+      return EXIT_FAILURE;
+    }
+    return RunBytecode(option, code);
+  }
+
   std::ifstream fin(option.input_file);
   if (fin.fail()) {
     std::cerr << "Error: failed to open file: \"" << option.input_file
               << "\"\n";
     return -1;
   }
+  std::stringstream source;
+  source << fin.rdbuf();
+
+  // everything asking for more than the bytecode needs the whole pipeline
+  std::optional<pl0::CompilationCache> cache;
+  std::string cache_key;
+  if (option.cache && !option.show_tokens && !option.show_ast
+      && !option.show_ir && !option.show_ngrams && !option.register_vm) {
+    cache.emplace(
+        option.cache_dir.empty() ? pl0::CompilationCache::DefaultDirectory()
+                                 : option.cache_dir,
+        static_cast<uint64_t>(option.cache_size) << 20);
+    std::string flags = option.superinstructions ? "fused" : "unfused";
+    if (!option.peephole) { flags += "/no-peephole"; }
+    if (!option.inlining) { flags += "/no-inline"; }
+    if (!option.folding) { flags += "/no-fold"; }
+    if (!option.dead_code_elimination) { flags += "/no-dce"; }
+    if (!option.ir) { flags += "/no-ir"; }
+    if (!option.gvn) { flags += "/no-gvn"; }
+    if (!option.licm) { flags += "/no-licm"; }
+    if (!option.strength_reduction) { flags += "/no-strength-reduction"; }
+    if (!option.closed_form) { flags += "/no-closed-form"; }
+    flags += pl0::Concat(
+        "/unroll ", option.unroll_factor, ' ', option.unroll_budget);
+    if (option.partial_eval) {
+      // both decide where folding stops
+      flags += pl0::Concat("/fuel ", option.fuel, "/stack ", option.stack_size);
+    }
+    cache_key = pl0::CompilationCache::Key(source.str(), flags);
+    auto entry = cache->Find(cache_key);
+    if (option.show_cache) { ReportCache(*cache, entry.has_value()); }
+    if (entry) {
+      return RunBytecode(
+          option, entry->code, entry->prefix ? &*entry->prefix : nullptr);
+    }
+  }
 
-  pl0::Lexer lex(fin);
+  pl0::Lexer lex(source);
   if (option.show_tokens) { PrintTokens(lex); }
 
   pl0::Parser parser(lex);
@@ -87,10 +520,29 @@ int main(int argc, const char *argv[]) {
     return EXIT_FAILURE;
   }
 
-  pl0::code::Compiler compiler{};
+  pl0::code::Compiler compiler{
+      option.inlining, option.dead_code_elimination};
+  pl0::code::RegisterCompiler register_compiler{};
+  pl0::ir::Lowering lowering;
+  const bool through_ir = option.ir && !option.register_vm;
 
   try {
-    compiler.Generate(program);
+    if (option.folding) { pl0::ast::ConstantFolder{}.Fold(program); }
+    if (option.dead_code_elimination) {
+      pl0::ast::DeadCodeEliminator{}.Eliminate(program);
+    }
+    if (option.register_vm) {
+      register_compiler.Generate(program);
+    } else if (through_ir) {
+      auto module =
+          pl0::ir::Builder{option.inlining, option.dead_code_elimination}
+              .Build(program);
+      Optimize(option, *module);
+      if (option.show_ir) { pl0::ir::Print(*module, std::cout); }
+      lowering.Generate(*module);
+    } else {
+      compiler.Generate(program);
+    }
   } catch (pl0::GeneralError &error) {
     pl0::Location const loc = lex.loc();
     std::cout << "Error(" << loc.to_string() << "): " << error.what() << '\n';
@@ -102,9 +554,33 @@ int main(int argc, const char *argv[]) {
     printer.VisitBlock(program);
   }
 
-  if (option.show_bytecode) { PrintBytecode(compiler.code()); }
+  if (option.register_vm) {
+    if (option.show_bytecode) { PrintBytecode(register_compiler.code()); }
+    if (!option.compile_only) {
+      // what has been printed so far comes before the program's output
+      std::cout.flush();
+      auto io = pl0::MakeIo(option.io);
+      try {
+        pl0::reg::Execute(
+            register_compiler.code(), option.stack_size, option.dispatch, *io);
+      } catch (pl0::RuntimeError &error) {
+        io->Flush();
+        std::cerr << "Runtime error: " << error.what() << '\n';
+        return EXIT_FAILURE;
+      }
+    }
+    return 0;
+  }
 
-  if (!option.compile_only) { pl0::Execute(compiler.code()); }
+  pl0::bytecode code = through_ir ? lowering.code() : compiler.code();
+  if (option.peephole) { pl0::OptimizePeepholes(code); }
+  if (option.show_ngrams) { pl0::PrintNgrams(code, std::cout); }
+  if (option.superinstructions) { pl0::FuseSuperinstructions(code); }
+  std::optional<pl0::Snapshot> prefix;
+  if (option.partial_eval) {
+    prefix = pl0::EvaluatePrefix(code, option.fuel, option.stack_size);
+  }
+  if (cache) { cache->Store(cache_key, code, prefix ? &*prefix : nullptr); }
 
-  return 0;
-}
\ No newline at end of file
+  return RunBytecode(option, code, prefix ? &*prefix : nullptr);
+}
@@ -0,0 +1,160 @@
+#include "partial_eval.h"
+
+#include <algorithm>
+#include <climits>
+
+#include "bytecode/superinstruction.h"
+
+namespace pl0 {
+
+Snapshot EvaluatePrefix(const bytecode &code, int64_t fuel, int stack_size) {
+  const auto length = static_cast<int>(code.size());
+  // the same bounds as VirtualMachine, so that it overflows where the run does
+  const int reserve = MaxOperandDepth(code) + Stack::kHeaderSize;
+  Stack stack{stack_size};
+  Display display{DisplaySize(code, [](const Instruction &ins) {
+    return IsCall(ins.op) ? ins.address : -1;
+  })};
+  std::vector<opcode> ops(code.size());
+  std::transform(code.begin(), code.end(), ops.begin(), [](const auto &ins) {
+    return Unfused(ins.op);
+  });
+  std::vector<int> output;
+
+  int pc = 0, bp = 0, sp = Stack::kHeaderSize;
+  stack[Stack::kDynamicLink] = 0;
+  stack[Stack::kReturnAddress] = length;
+  stack[Stack::kSavedDisplay] = 0;
+  stack[Stack::kCallerLevel] = 0;
+
+  auto local = [&](int level, int index) -> int & {
+    const int base = level == 0 ? bp : display.Resolve(level);
+    return stack[base + Stack::kHeaderSize + index];
+  };
+
+  for (; pc < length && fuel > 0; fuel--) {
+    const auto &ins = code[pc];
+    const auto op = ops[pc];
+    if (op == opcode::READ) { break; }
+    if (op == opcode::CAL && reserve > stack.capacity() - sp) { break; }
+    if (op == opcode::INT
+        && ins.address - kFrameBookkeeping + reserve > stack.capacity() - sp) {
+      break;
+    }
+    if ((op == opcode::DIV || op == opcode::DVD)
+        && (stack[sp - 1] == 0
+            || (stack[sp - 2] == INT_MIN && stack[sp - 1] == -1))) {
+      break;
+    }
+    pc++;
+
+    const int64_t lhs = sp >= 2 ? stack[sp - 2] : 0;
+    const int64_t rhs = sp >= 1 ? stack[sp - 1] : 0;
+    switch (op) {
+      case opcode::LIT:
+        stack[sp++] = ins.address;
+        break;
+      case opcode::LOD:
+        stack[sp++] = local(ins.level, ins.address);
+        break;
+      case opcode::STO:
+        local(ins.level, ins.address) = stack[--sp];
+        break;
+      case opcode::DUP:
+        stack[sp] = stack[sp - 1];
+        sp++;
+        break;
+      case opcode::CAL:
+        stack[sp + Stack::kDynamicLink] = bp;
+        stack[sp + Stack::kReturnAddress] = pc;
+        display.Enter(stack, sp, ins.level);
+        bp = sp;
+        sp += Stack::kHeaderSize;
+        pc = ins.address;
+        break;
+      case opcode::TCL:
+        display.Replace(stack, bp, ins.level);
+        sp = bp + Stack::kHeaderSize;
+        pc = ins.address;
+        break;
+      case opcode::INT: {
+        const int locals = ins.address - kFrameBookkeeping;
+        std::fill_n(&stack[sp], locals, 0);
+        sp += locals;
+        break;
+      }
+      case opcode::JMP:
+        pc = ins.address;
+        break;
+      case opcode::JPC:
+        if (!stack[--sp]) { pc = ins.address; }
+        break;
+      case opcode::ADD:
+        stack[--sp - 1] = Wrap(lhs + rhs);
+        break;
+      case opcode::SUB:
+        stack[--sp - 1] = Wrap(lhs - rhs);
+        break;
+      case opcode::MUL:
+        stack[--sp - 1] = Wrap(lhs * rhs);
+        break;
+      case opcode::DIV:
+        stack[--sp - 1] = static_cast<int>(lhs / rhs);
+        break;
+      case opcode::DVD:
+        stack[--sp - 1] = lhs % rhs == 0;
+        break;
+      case opcode::LT:
+        stack[--sp - 1] = lhs < rhs;
+        break;
+      case opcode::LE:
+        stack[--sp - 1] = lhs <= rhs;
+        break;
+      case opcode::GT:
+        stack[--sp - 1] = lhs > rhs;
+        break;
+      case opcode::GE:
+        stack[--sp - 1] = lhs >= rhs;
+        break;
+      case opcode::EQ:
+        stack[--sp - 1] = lhs == rhs;
+        break;
+      case opcode::NE:
+        stack[--sp - 1] = lhs != rhs;
+        break;
+      case opcode::ODD:
+        stack[sp - 1] %= 2;
+        break;
+      case opcode::WRITE:
+        output.push_back(stack[--sp]);
+        break;
+      case opcode::RET:
+        display.Leave(stack, bp);
+        sp = bp;
+        pc = stack[bp + Stack::kReturnAddress];
+        bp = stack[bp + Stack::kDynamicLink];
+        break;
+      // the loop stops before a READ runs
+      case opcode::READ:
+      // only their first slot is fused, ops holds the opcode it replaced
+#define T(name) case opcode::name:
+        SUPERINSTRUCTION_LIST(T)
+#undef T
+        break;
+    }
+  }
+
+  Snapshot snapshot;
+  snapshot.code = code;
+  snapshot.program_counter = std::min(pc, length);
+  snapshot.bp = bp;
+  snapshot.sp = sp;
+  snapshot.display_level = display.level();
+  snapshot.display.assign(
+      display.frames(), display.frames() + display.levels());
+  snapshot.stack.assign(stack.data(), stack.data() + sp);
+  snapshot.output = std::move(output);
+  return snapshot;
+}
+
+} // namespace pl0
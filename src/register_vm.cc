@@ -0,0 +1,217 @@
+#include "register_vm.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace pl0::reg {
+
+namespace {
+
+struct ThreadedInstruction {
+  const void *handler;
+  int a;
+  int b;
+  int c;
+};
+
+// Only consulted by the switch engine, threaded code never reaches the switch.
+opcode OpOf(const Instruction &ins) {
+  return ins.op;
+}
+
+opcode OpOf(const ThreadedInstruction & /*ins*/) {
+#if PL0_THREADED_DISPATCH
+  __builtin_unreachable();
+#else
+  std::abort();
+#endif
+}
+
+// Same scheme as the stack machine: handlers are written once and VM_NEXT
+// either leaves the switch or jumps to the handler of the next instruction.
+template<bool kThreaded>
+void Interpret(const bytecode &code, Stack &stack, Io &io) {
+  using Ins = std::conditional_t<kThreaded, ThreadedInstruction, Instruction>;
+
+  auto code_length = static_cast<int>(code.size());
+
+  std::vector<ThreadedInstruction> threaded;
+  const Ins *text = nullptr;
+  if constexpr (kThreaded) {
+#if PL0_THREADED_DISPATCH
+#define T(name) &&L_##name,
+    static const void *const handlers[] = {REGISTER_OPCODE_LIST(T)};
+#undef T
+    threaded.reserve(code.size() + 1);
+    for (const auto &ins : code) {
+      threaded.push_back(
+          {handlers[static_cast<int>(ins.op)], ins.a, ins.b, ins.c});
+    }
+    threaded.push_back({&&L_HALT, 0, 0, 0});
+    text = threaded.data();
+#endif
+  } else {
+    text = code.data();
+  }
+
+  int program_counter = 0;
+  int bp = 0, sp = Stack::kHeaderSize;
+  stack.Reserve(0, sp);
+  stack[bp + Stack::kDynamicLink] = 0;
+  stack[bp + Stack::kReturnAddress] = code_length;
+  stack[bp + Stack::kSavedDisplay] = 0;
+  stack[bp + Stack::kCallerLevel] = 0;
+  int *registers = &stack[sp];
+  Display display{DisplaySize(code, [](const Instruction &ins) {
+    return ins.op == opcode::CALL ? ins.b : -1;
+  })};
+
+  const Ins *ins;
+  auto outer = [&](int level, int index) -> int & {
+    return stack[display.Resolve(level) + Stack::kHeaderSize + index];
+  };
+
+#if PL0_THREADED_DISPATCH
+// the switch instantiation never jumps to the labels
+#define VM_CASE(name) \
+  case opcode::name:  \
+  L_##name:           \
+  __attribute__((unused));
+#define VM_NEXT()                   \
+  if constexpr (kThreaded) {        \
+    ins = &text[program_counter++]; \
+    goto *ins->handler;             \
+  } else {                          \
+    break;                          \
+  }
+
+  if constexpr (kThreaded) {
+    ins = &text[program_counter++];
+    goto *ins->handler;
+  }
+#else
+#define VM_CASE(name) case opcode::name:
+#define VM_NEXT() break
+#endif
+
+  while (program_counter < code_length) {
+    ins = &text[program_counter++];
+
+    switch (OpOf(*ins)) {
+      VM_CASE(MOVE) {
+        registers[ins->a] = registers[ins->b];
+        VM_NEXT()
+      }
+      VM_CASE(LOADK) {
+        registers[ins->a] = ins->b;
+        VM_NEXT()
+      }
+      VM_CASE(GETUP) {
+        registers[ins->a] = outer(ins->b, ins->c);
+        VM_NEXT()
+      }
+      VM_CASE(SETUP) {
+        outer(ins->b, ins->c) = registers[ins->a];
+        VM_NEXT()
+      }
+// the test for a division folds away for the other operations
+#define VM_ARITHMETIC(name, op)                                 \
+  VM_CASE(name) {                                               \
+    if (opcode::name == opcode::DIV) {                          \
+      CheckDivision(registers[ins->b], registers[ins->c]);      \
+    }                                                           \
+    registers[ins->a] = registers[ins->b] op registers[ins->c]; \
+    VM_NEXT()                                                   \
+  }                                                             \
+  VM_CASE(name##K) {                                            \
+    if (opcode::name == opcode::DIV) {                          \
+      CheckDivision(registers[ins->b], ins->c);                 \
+    }                                                           \
+    registers[ins->a] = registers[ins->b] op ins->c;            \
+    VM_NEXT()                                                   \
+  }
+      REGISTER_ARITHMETIC_LIST(VM_ARITHMETIC)
+#undef VM_ARITHMETIC
+      VM_CASE(JMP) {
+        program_counter = ins->a;
+        VM_NEXT()
+      }
+#define VM_BRANCH(name, op)                                          \
+  VM_CASE(name) {                                                    \
+    if (registers[ins->b] op registers[ins->c]) {                    \
+      program_counter = ins->a;                                      \
+    }                                                                \
+    VM_NEXT()                                                        \
+  }                                                                  \
+  VM_CASE(name##K) {                                                 \
+    if (registers[ins->b] op ins->c) { program_counter = ins->a; }   \
+    VM_NEXT()                                                        \
+  }
+      REGISTER_BRANCH_LIST(VM_BRANCH)
+#undef VM_BRANCH
+      VM_CASE(JEVEN) {
+        if (registers[ins->b] % 2 == 0) { program_counter = ins->a; }
+        VM_NEXT()
+      }
+      VM_CASE(CALL) {
+        stack.Reserve(sp, Stack::kHeaderSize);
+        stack[sp + Stack::kDynamicLink] = bp;
+        stack[sp + Stack::kReturnAddress] = program_counter;
+        display.Enter(stack, sp, ins->a);
+        bp = sp;
+        sp += Stack::kHeaderSize;
+        registers = &stack[sp];
+        program_counter = ins->b;
+        VM_NEXT()
+      }
+      VM_CASE(ENTER) {
+        stack.Reserve(sp, ins->a);
+        std::fill_n(registers, ins->a, 0);
+        sp += ins->a;
+        VM_NEXT()
+      }
+      VM_CASE(RET) {
+        display.Leave(stack, bp);
+        sp = bp;
+        program_counter = stack[bp + Stack::kReturnAddress];
+        bp = stack[bp + Stack::kDynamicLink];
+        registers = &stack[bp + Stack::kHeaderSize];
+        VM_NEXT()
+      }
+      VM_CASE(READ) {
+        registers[ins->a] = io.Read();
+        VM_NEXT()
+      }
+      VM_CASE(WRITE) {
+        io.Write(registers[ins->a]);
+        VM_NEXT()
+      }
+    }
+  }
+
+#if PL0_THREADED_DISPATCH
+L_HALT:
+  __attribute__((unused));
+#endif
+  return;
+
+#undef VM_CASE
+#undef VM_NEXT
+}
+
+} // namespace
+
+void Execute(
+    const bytecode &code,
+    int stack_size,
+    Dispatch dispatch,
+    Io &io) {
+  Stack stack{stack_size};
+  if (dispatch == Dispatch::kThreaded && kThreadedDispatchAvailable) {
+    Interpret<true>(code, stack, io);
+  } else {
+    Interpret<false>(code, stack, io);
+  }
+}
+
+} // namespace pl0::reg
@@ -0,0 +1,136 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+
+#include "bytecode/verifier.h"
+
+namespace pl0 {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x53304c50; // "PL0S" read little-endian
+constexpr uint32_t kVersion = 1;
+constexpr auto kOpcodeCount = static_cast<uint32_t>(std::size(opcode_name));
+
+class Writer {
+  std::ofstream &out_;
+
+ public:
+  explicit Writer(std::ofstream &out) : out_(out) {}
+
+  void Put(uint32_t value) {
+    out_.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  template<typename T>
+  void Put(const std::vector<T> &values) {
+    Put(static_cast<uint32_t>(values.size()));
+    out_.write(
+        reinterpret_cast<const char *>(values.data()),
+        static_cast<std::streamsize>(values.size() * sizeof(T)));
+  }
+};
+
+class Reader {
+  std::ifstream &in_;
+  const std::string &path_;
+
+ public:
+  Reader(std::ifstream &in, const std::string &path) : in_(in), path_(path) {}
+
+  GeneralError Invalid(const std::string &reason) const {
+    return GeneralError('"', path_, "\" is not a valid snapshot: ", reason);
+  }
+
+  uint32_t Get() {
+    uint32_t value;
+    in_.read(reinterpret_cast<char *>(&value), sizeof(value));
+    if (in_.fail()) { throw Invalid("truncated"); }
+    return value;
+  }
+
+  int GetInt() { return static_cast<int>(Get()); }
+
+  template<typename T>
+  void Get(std::vector<T> &values) {
+    const uint32_t size = Get();
+    // grow with the data actually read, so that a bad length fails cleanly
+    constexpr uint32_t kChunk = 1 << 16;
+    values.clear();
+    for (uint32_t done = 0; done < size;) {
+      const uint32_t count = std::min(kChunk, size - done);
+      values.resize(done + count);
+      in_.read(
+          reinterpret_cast<char *>(values.data() + done),
+          static_cast<std::streamsize>(count * sizeof(T)));
+      if (in_.fail()) { throw Invalid("truncated"); }
+      done += count;
+    }
+  }
+};
+
+} // namespace
+
+void WriteSnapshot(const Snapshot &snapshot, const std::string &path) {
+  std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+  Writer writer{fout};
+  writer.Put(kMagic);
+  writer.Put(kVersion);
+  writer.Put(kOpcodeCount);
+  writer.Put(snapshot.code);
+  writer.Put(snapshot.program_counter);
+  writer.Put(snapshot.bp);
+  writer.Put(snapshot.sp);
+  writer.Put(snapshot.display_level);
+  writer.Put(snapshot.display);
+  writer.Put(snapshot.stack);
+  writer.Put(snapshot.output);
+  fout.close();
+  if (fout.fail()) {
+    throw GeneralError("cannot write snapshot \"", path, '"');
+  }
+}
+
+Snapshot LoadSnapshot(const std::string &path) {
+  std::ifstream fin(path, std::ios::binary);
+  if (fin.fail()) { throw GeneralError("cannot open snapshot \"", path, '"'); }
+  Reader reader{fin, path};
+  if (reader.Get() != kMagic) { throw reader.Invalid("bad magic"); }
+  if (reader.Get() != kVersion) { throw reader.Invalid("unsupported version"); }
+  if (reader.Get() != kOpcodeCount) {
+    throw reader.Invalid("written by a build with a different opcode set");
+  }
+
+  Snapshot snapshot;
+  reader.Get(snapshot.code);
+  snapshot.program_counter = reader.GetInt();
+  snapshot.bp = reader.GetInt();
+  snapshot.sp = reader.GetInt();
+  snapshot.display_level = reader.GetInt();
+  reader.Get(snapshot.display);
+  reader.Get(snapshot.stack);
+  reader.Get(snapshot.output);
+  if (fin.peek() != std::ifstream::traits_type::eof()) {
+    throw reader.Invalid("trailing data");
+  }
+
+  const auto length = static_cast<int>(snapshot.code.size());
+  const auto levels = static_cast<int>(snapshot.display.size());
+  try {
+    VerifyBytecode(snapshot.code);
+  } catch (const GeneralError &error) {
+    throw reader.Invalid(error.what());
+  }
+  if (snapshot.program_counter < 0 || snapshot.program_counter > length
+      || snapshot.bp < 0 || snapshot.bp > snapshot.sp
+      || snapshot.sp != static_cast<int>(snapshot.stack.size())
+      || snapshot.display_level < 0 || snapshot.display_level >= levels) {
+    throw reader.Invalid("inconsistent machine state");
+  }
+  return snapshot;
+}
+
+} // namespace pl0
@@ -1,57 +1,552 @@
 #include "vm.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 
-void pl0::Execute(const bytecode &code) {
-  int program_counter = 0;
+#include "bytecode/superinstruction.h"
+#include "bytecode/verifier.h"
+
+namespace pl0 {
+
+namespace {
+
+// An instruction of the direct-threaded code: the opcode is replaced by the
+// address of its handler, operands are kept as is.
+struct ThreadedInstruction {
+  const void *handler;
+  int level;
+  int address;
+};
+
+// Only consulted by the switch engine, threaded code never reaches the switch.
+opcode OpOf(const Instruction &ins) {
+  return ins.op;
+}
+
+opcode OpOf(const ThreadedInstruction & /*ins*/) {
+#if PL0_THREADED_DISPATCH
+  __builtin_unreachable();
+#else
+  std::abort();
+#endif
+}
+
+} // namespace
+
+/**
+ * The interpreter loop shared by both engines. Every handler is written once
+ * and ends with VM_NEXT, which either leaves the switch (switch engine) or
+ * jumps straight to the handler of the next instruction (threaded engine), so
+ * each instruction gets an indirect branch of its own. The registers of the
+ * machine are kept in locals while it runs.
+ */
+template<bool kThreaded>
+bool VirtualMachine::Interpret(const Tiering &tiering, bool stop_at_read) {
+  using Ins = std::conditional_t<kThreaded, ThreadedInstruction, Instruction>;
+
+  const auto &code = code_;
+  auto &stack = stack_;
+  auto &display = display_;
+  auto &io = io_;
   auto code_length = static_cast<int>(code.size());
-  auto *top_frame = new StackFrame{code_length, nullptr, nullptr};
+  const int reserve = reserve_;
+
+  std::vector<ThreadedInstruction> threaded;
+  const Ins *text = nullptr;
+  if constexpr (kThreaded) {
+#if PL0_THREADED_DISPATCH
+#define T(name) &&L_##name,
+    static const void *const handlers[] = {OPCODE_LIST(T)};
+#undef T
+    threaded.reserve(code.size() + 1);
+    for (const auto &ins : code) {
+      threaded.push_back(
+          {handlers[static_cast<int>(ins.op)], ins.level, ins.address});
+    }
+    // falling off the end of the code or returning from the main program
+    // lands on this sentinel
+    threaded.push_back({&&L_HALT, 0, 0});
+    text = threaded.data();
+#endif
+  } else {
+    text = code.data();
+  }
+
+  int program_counter = program_counter_;
+  int bp = bp_, sp = sp_;
+  int64_t calls = statistics_.calls;
+  int peak_stack = statistics_.peak_stack;
+  bool stopped = false;
+
+  // Hotness of every procedure entry and loop header, counting up to the
+  // threshold, and their code in the next tier once promoted.
+  constexpr int kNotPromotable = -1;
+  std::vector<int> counters;
+  std::vector<const void *> promoted;
+  if (tiering.tier != nullptr) {
+    counters.assign(code_length + 1, 0);
+    promoted.assign(code_length + 1, nullptr);
+  }
+  auto hot = [&](int target, bool loop) -> const void * {
+    if (promoted[target] != nullptr || counters[target] == kNotPromotable) {
+      return promoted[target];
+    }
+    if (++counters[target] < tiering.threshold) { return nullptr; }
+    try {
+      promoted[target] = tiering.tier->Compile(target);
+    } catch (GeneralError &error) {
+      counters[target] = kNotPromotable;
+      if (tiering.verbose) {
+        std::cerr << "tier: " << (loop ? "loop at " : "procedure at ") << target
+                  << " stays interpreted: " << error.what() << '\n';
+      }
+      return nullptr;
+    }
+    statistics_.promotions++;
+    if (tiering.verbose) {
+      std::cerr << "tier: " << (loop ? "loop at " : "procedure at ") << target
+                << " promoted after " << counters[target]
+                << (loop ? " iterations\n" : " calls\n");
+    }
+    return promoted[target];
+  };
+
+  const Ins *ins;
+  auto pop = [&] {
+    sp = bp;
+    program_counter = stack[bp + Stack::kReturnAddress];
+    bp = stack[bp + Stack::kDynamicLink];
+  };
+  auto leave = [&] {
+    display.Leave(stack, bp);
+    pop();
+  };
+  // the rest of the current procedure runs in the next tier
+  auto promote = [&](const void *native) {
+    tiering.tier->Enter(stack, display, io, bp, native);
+    display.Return(stack, bp);
+    pop();
+  };
+  auto local = [&](int level, int index) -> int & {
+    const int base = level == 0 ? bp : display.Resolve(level);
+    return stack[base + Stack::kHeaderSize + index];
+  };
+
+#if PL0_THREADED_DISPATCH
+// the switch instantiation never jumps to the labels
+#define VM_CASE(name) \
+  case opcode::name:  \
+  L_##name:           \
+  __attribute__((unused));
+#define VM_NEXT()                         \
+  if constexpr (kThreaded) {              \
+    ins = &text[program_counter++];       \
+    goto *ins->handler;                   \
+  } else {                                \
+    break;                                \
+  }
+
+  if constexpr (kThreaded) {
+    ins = &text[program_counter++];
+    goto *ins->handler;
+  }
+#else
+#define VM_CASE(name) case opcode::name:
+#define VM_NEXT() break
+#endif
 
   while (program_counter < code_length) {
-    auto ins = code[program_counter++];
+    ins = &text[program_counter++];
+
+    switch (OpOf(*ins)) {
+      VM_CASE(LIT) {
+        stack[sp++] = ins->address;
+        VM_NEXT()
+      }
+      VM_CASE(LOD) {
+        stack[sp++] = local(ins->level, ins->address);
+        VM_NEXT()
+      }
+      VM_CASE(STO) {
+        local(ins->level, ins->address) = stack[--sp];
+        VM_NEXT()
+      }
+      VM_CASE(CAL) {
+        calls++;
+        stack.Reserve(sp, reserve);
+        stack[sp + Stack::kDynamicLink] = bp;
+        stack[sp + Stack::kReturnAddress] = program_counter;
+        display.Enter(stack, sp, ins->level);
+        bp = sp;
+        sp += Stack::kHeaderSize;
+        // a procedure without locals may have no INT
+        peak_stack = std::max(peak_stack, sp);
+        program_counter = ins->address;
+        if (tiering.tier != nullptr) {
+          if (const auto *native = hot(program_counter, false)) {
+            promote(native);
+          }
+        }
+        VM_NEXT()
+      }
+      VM_CASE(TCL) {
+        // the frame of the calling procedure becomes the callee's, it only
+        // grows again by what the callee's INT asks for
+        calls++;
+        display.Replace(stack, bp, ins->level);
+        sp = bp + Stack::kHeaderSize;
+        program_counter = ins->address;
+        if (tiering.tier != nullptr) {
+          if (const auto *native = hot(program_counter, false)) {
+            promote(native);
+          }
+        }
+        VM_NEXT()
+      }
+      VM_CASE(INT) {
+        const int locals = ins->address - kFrameBookkeeping;
+        stack.Reserve(sp, locals + reserve);
+        std::fill_n(&stack[sp], locals, 0);
+        sp += locals;
+        peak_stack = std::max(peak_stack, sp);
+        VM_NEXT()
+      }
+      VM_CASE(JMP) {
+        // a backward jump closes a loop, a candidate for on-stack replacement
+        if (tiering.tier != nullptr && ins->address < program_counter) {
+          if (const auto *native = hot(ins->address, true)) {
+            promote(native);
+            VM_NEXT()
+          }
+        }
+        program_counter = ins->address;
+        VM_NEXT()
+      }
+      VM_CASE(JPC) {
+        if (!stack[--sp]) { program_counter = ins->address; }
+        VM_NEXT()
+      }
+#define VM_BINARY_OPERATION(name, op)           \
+  VM_CASE(name) {                               \
+    sp--;                                       \
+    stack[sp - 1] = stack[sp - 1] op stack[sp]; \
+    VM_NEXT()                                   \
+  }
+      VM_BINARY_OPERATION(ADD, +)
+      VM_BINARY_OPERATION(SUB, -)
+      VM_BINARY_OPERATION(MUL, *)
+      VM_BINARY_OPERATION(LT, <)
+      VM_BINARY_OPERATION(LE, <=)
+      VM_BINARY_OPERATION(GT, >)
+      VM_BINARY_OPERATION(GE, >=)
+      VM_BINARY_OPERATION(EQ, ==)
+      VM_BINARY_OPERATION(NE, !=)
+#undef VM_BINARY_OPERATION
+      VM_CASE(DIV) {
+        sp--;
+        CheckDivision(stack[sp - 1], stack[sp]);
+        stack[sp - 1] /= stack[sp];
+        VM_NEXT()
+      }
+      VM_CASE(DVD) {
+        sp--;
+        CheckDivision(stack[sp - 1], stack[sp]);
+        stack[sp - 1] = stack[sp - 1] % stack[sp] == 0;
+        VM_NEXT()
+      }
+      VM_CASE(ODD) {
+        stack[sp - 1] %= 2;
+        VM_NEXT()
+      }
+      VM_CASE(READ) {
+        if (stop_at_read) {
+          program_counter--;
+          stopped = true;
+          goto stop;
+        }
+        stack[sp++] = io.Read();
+        VM_NEXT()
+      }
+      VM_CASE(WRITE) {
+        io.Write(stack[--sp]);
+        VM_NEXT()
+      }
+      VM_CASE(RET) {
+        leave();
+        VM_NEXT()
+      }
+      VM_CASE(DUP) {
+        stack[sp] = stack[sp - 1];
+        sp++;
+        VM_NEXT()
+      }
+      // superinstructions, operands of the fused sequence are read from the
+      // slots following the first one
+      VM_CASE(INC) {
+        local(ins->level, ins->address) += text[program_counter].address;
+        program_counter += 3;
+        VM_NEXT()
+      }
+      VM_CASE(DEC) {
+        local(ins->level, ins->address) -= text[program_counter].address;
+        program_counter += 3;
+        VM_NEXT()
+      }
+      VM_CASE(LOD2) {
+        const auto &next = text[program_counter++];
+        stack[sp++] = local(ins->level, ins->address);
+        stack[sp++] = local(next.level, next.address);
+        VM_NEXT()
+      }
+      VM_CASE(LODLIT) {
+        stack[sp++] = local(ins->level, ins->address);
+        stack[sp++] = text[program_counter++].address;
+        VM_NEXT()
+      }
+      VM_CASE(MOV) {
+        const auto &next = text[program_counter++];
+        local(next.level, next.address) = local(ins->level, ins->address);
+        VM_NEXT()
+      }
+      VM_CASE(LADD) {
+        stack[sp - 1] += local(ins->level, ins->address);
+        program_counter++;
+        VM_NEXT()
+      }
+      VM_CASE(LSUB) {
+        stack[sp - 1] -= local(ins->level, ins->address);
+        program_counter++;
+        VM_NEXT()
+      }
+      VM_CASE(LMUL) {
+        stack[sp - 1] *= local(ins->level, ins->address);
+        program_counter++;
+        VM_NEXT()
+      }
+      VM_CASE(LDIV) {
+        const int divisor = local(ins->level, ins->address);
+        CheckDivision(stack[sp - 1], divisor);
+        stack[sp - 1] /= divisor;
+        program_counter++;
+        VM_NEXT()
+      }
+#define VM_COMPARE_AND_BRANCH(name, cmp)                     \
+  VM_CASE(name) {                                            \
+    sp -= 2;                                                 \
+    if (stack[sp] cmp stack[sp + 1]) {                       \
+      program_counter = text[program_counter].address;       \
+    } else {                                                 \
+      program_counter++;                                     \
+    }                                                        \
+    VM_NEXT()                                                \
+  }
+      VM_COMPARE_AND_BRANCH(JLT, <)
+      VM_COMPARE_AND_BRANCH(JLE, <=)
+      VM_COMPARE_AND_BRANCH(JGT, >)
+      VM_COMPARE_AND_BRANCH(JGE, >=)
+      VM_COMPARE_AND_BRANCH(JEQ, ==)
+      VM_COMPARE_AND_BRANCH(JNE, !=)
+#undef VM_COMPARE_AND_BRANCH
+      VM_CASE(DUPSTO) {
+        const auto &next = text[program_counter++];
+        local(next.level, next.address) = stack[sp - 1];
+        VM_NEXT()
+      }
+    }
+  }
+
+#if PL0_THREADED_DISPATCH
+L_HALT:
+  __attribute__((unused));
+  // fetching the sentinel went one past it
+  program_counter = std::min(program_counter, code_length);
+#endif
+stop:
+  program_counter_ = program_counter;
+  bp_ = bp;
+  sp_ = sp;
+  statistics_.calls = calls;
+  statistics_.peak_stack = peak_stack;
+  return stopped;
+
+#undef VM_CASE
+#undef VM_NEXT
+}
 
-    switch (ins.op) {
+int MaxOperandDepth(const bytecode &code) {
+  int depth = 0, max_depth = 0;
+  for (const auto &ins : code) {
+    switch (Unfused(ins.op)) {
       case opcode::LIT:
-        top_frame->Push(ins.address);
-        break;
       case opcode::LOD:
-        top_frame->Push(top_frame->Local(ins.level, ins.address));
+      case opcode::READ:
+      case opcode::DUP:
+        depth++;
         break;
-      case opcode::STO:
-        top_frame->Local(ins.level, ins.address) = top_frame->Pop();
+      case opcode::RET:
+        depth = 0;
         break;
       case opcode::CAL:
-        top_frame = new StackFrame{
-            program_counter, top_frame, top_frame->Resolve(ins.level)};
-        program_counter = ins.address;
-        break;
+      case opcode::TCL:
       case opcode::INT:
-        top_frame->Allocate(ins.address - 3);
-        break;
       case opcode::JMP:
-        program_counter = ins.address;
+      case opcode::ODD:
         break;
-      case opcode::JPC:
-        if (!top_frame->Pop()) { program_counter = ins.address; }
-        break;
-      case opcode::OPR:
-        if (ins.address == *opt::ODD) {
-          int const result = top_frame->Pop() % 2;
-          top_frame->Push(result);
-        } else if (ins.address == *opt::READ) {
-          int tmp;
-          std::cin >> tmp;
-          top_frame->Push(tmp);
-        } else if (ins.address == *opt::WRITE) {
-          std::cout << top_frame->Pop() << '\n';
-        } else if (ins.address == *opt::RET) {
-          top_frame->Leave(program_counter, top_frame);
-        } else {
-          const int rhs = top_frame->Pop(), lhs = top_frame->Pop();
-          auto f = opt2functor.find(opt(ins.address))->second;
-          top_frame->Push(f(lhs, rhs));
-        }
+      default:
+        depth--;
         break;
     }
+    depth = std::max(depth, 0);
+    max_depth = std::max(max_depth, depth);
+  }
+  return max_depth;
+}
+
+VirtualMachine::VirtualMachine(const bytecode &code, Io &io, int stack_size)
+    : code_(code),
+      io_(io),
+      stack_(stack_size),
+      display_(DisplaySize(
+          code,
+          [](const Instruction &ins) {
+            return IsCall(ins.op) ? ins.address : -1;
+          })),
+      reserve_(MaxOperandDepth(code) + Stack::kHeaderSize) {}
+
+void VirtualMachine::Start() {
+  program_counter_ = 0;
+  bp_ = 0;
+  sp_ = Stack::kHeaderSize;
+  statistics_ = {};
+  stack_.Reserve(0, sp_);
+  stack_[Stack::kDynamicLink] = 0;
+  stack_[Stack::kReturnAddress] = static_cast<int>(code_.size());
+  stack_[Stack::kSavedDisplay] = 0;
+  stack_[Stack::kCallerLevel] = 0;
+  display_.Reset();
+}
+
+bool VirtualMachine::Interpret(
+    Dispatch dispatch, const Tiering &tiering, bool stop_at_read) {
+  if (dispatch == Dispatch::kThreaded && kThreadedDispatchAvailable) {
+    return Interpret<true>(tiering, stop_at_read);
   }
+  return Interpret<false>(tiering, stop_at_read);
 }
+
+void VirtualMachine::Run(Dispatch dispatch, const Tiering &tiering) {
+  Start();
+  Interpret(dispatch, tiering, false);
+}
+
+bool VirtualMachine::RunToFirstRead(Dispatch dispatch) {
+  Start();
+  return Interpret(dispatch, {}, true);
+}
+
+void VirtualMachine::Continue(Dispatch dispatch, const Tiering &tiering) {
+  Interpret(dispatch, tiering, false);
+}
+
+Snapshot VirtualMachine::Save() const {
+  Snapshot snapshot;
+  snapshot.code = code_;
+  snapshot.program_counter = program_counter_;
+  snapshot.bp = bp_;
+  snapshot.sp = sp_;
+  snapshot.display_level = display_.level();
+  snapshot.display.assign(
+      display_.frames(), display_.frames() + display_.levels());
+  snapshot.stack.assign(stack_.data(), stack_.data() + sp_);
+  return snapshot;
+}
+
+void VirtualMachine::Restore(const Snapshot &snapshot) {
+  const auto sp = static_cast<int>(snapshot.stack.size());
+  if (snapshot.sp != sp || sp > stack_.capacity() - reserve_) {
+    throw RuntimeError("snapshot does not fit the stack");
+  }
+  const auto length = static_cast<int>(code_.size());
+  if (static_cast<int>(snapshot.display.size()) != display_.levels()
+      || snapshot.program_counter < 0 || snapshot.program_counter > length
+      || snapshot.display_level < 0
+      || snapshot.display_level >= display_.levels()) {
+    throw RuntimeError("snapshot is of a different program");
+  }
+  CheckFrames(snapshot);
+  program_counter_ = snapshot.program_counter;
+  bp_ = snapshot.bp;
+  sp_ = sp;
+  std::copy(snapshot.stack.begin(), snapshot.stack.end(), stack_.data());
+  display_.Restore(snapshot.display_level, snapshot.display.data());
+  statistics_ = {};
+}
+
+void VirtualMachine::CheckFrames(const Snapshot &snapshot) const {
+  const auto &stack = snapshot.stack;
+  const auto length = static_cast<int>(code_.size());
+  // a finished program has no frames left
+  if (snapshot.program_counter == length) { return; }
+  const auto layout = LayOutProcedures(code_);
+  auto invalid = [] {
+    return RuntimeError("snapshot frames do not match its stack");
+  };
+
+  // down the dynamic links from the running procedure to the main program,
+  // each frame ending where the one called from it starts
+  std::vector<bool> is_frame(snapshot.sp, false);
+  std::vector<int> frames;
+  int pc = snapshot.program_counter;
+  int level = snapshot.display_level;
+  int top = snapshot.sp;
+  for (int frame = snapshot.bp;;) {
+    if (frame < 0 || frame > top - Stack::kHeaderSize) { throw invalid(); }
+    if (pc < length) {
+      // an INT about to run has yet to reserve the locals
+      const int locals = code_[pc].op == opcode::INT ? 0 : layout.locals[pc];
+      if (layout.levels[pc] != level
+          || locals > top - frame - Stack::kHeaderSize) {
+        throw invalid();
+      }
+    }
+    is_frame[frame] = true;
+    frames.push_back(frame);
+    pc = stack[frame + Stack::kReturnAddress];
+    level = stack[frame + Stack::kCallerLevel];
+    const int link = stack[frame + Stack::kDynamicLink];
+    if (pc < 0 || pc > length || level < 0 || level >= display_.levels()) {
+      throw invalid();
+    }
+    if (frame == 0) {
+      // the main program returns to the end of the code
+      if (link != 0 || pc != length) { throw invalid(); }
+      break;
+    }
+    top = frame;
+    frame = link;
+  }
+
+  // the display only ever holds frames on the stack, saved entries included
+  auto on_stack = [&](int frame) {
+    return frame >= 0 && frame < snapshot.sp && is_frame[frame];
+  };
+  if (!std::all_of(snapshot.display.begin(), snapshot.display.end(), on_stack)
+      || !std::all_of(frames.begin(), frames.end(), [&](int frame) {
+           return on_stack(stack[frame + Stack::kSavedDisplay]);
+         })) {
+    throw invalid();
+  }
+}
+
+void Execute(
+    const bytecode &code,
+    int stack_size,
+    Dispatch dispatch,
+    const Tiering &tiering,
+    Io &io) {
+  VirtualMachine vm{code, io, stack_size};
+  vm.Run(dispatch, tiering);
+}
+
+} // namespace pl0
@@ -0,0 +1,72 @@
+// A loop that only sums induction variables is replaced by what it computes
+// where the closed form provably wraps the same way the loop would, and kept
+// where it might not.
+
+#include <string>
+
+#include "testing.h"
+
+namespace {
+
+// from start while i < limit, or i <= limit if inclusive, stepping i, after
+// the statements of prologue
+std::string Loop(const std::string &start, const std::string &limit,
+                 int step, bool inclusive = false,
+                 const std::string &prologue = "") {
+  return "var a, b, i, s, t;\nbegin\n" + prologue + "  i := " + start
+         + "; s := 0; t := 0;\n  while i " + (inclusive ? "<=" : "<") + ' '
+         + limit + " do\n  begin\n    s := s + i;\n    t := t + 3;\n"
+         + "    i := i + " + std::to_string(step)
+         + "\n  end;\n  write i; write s; write t\nend.\n";
+}
+
+bool Loops(const std::string &source) {
+  const auto listing = pl0::testing::Run("-s -c --no-superinstructions", source);
+  return listing.find("\tJMP\t") != std::string::npos;
+}
+
+void ExpectSame(const std::string &source, const std::string &input = "") {
+  const auto expected = pl0::testing::Run("--no-closed-form", source, input);
+  EXPECT(!expected.empty());
+  EXPECT(pl0::testing::Run("", source, input) == expected);
+  EXPECT(pl0::testing::Run("--unroll 1", source, input) == expected);
+}
+
+} // namespace
+
+int main() {
+  // folded all the way to the sum
+  const auto sum = Loop("0", "1000", 1);
+  EXPECT(pl0::testing::Run("", sum) == "1000\n499500\n3000\n");
+  EXPECT(pl0::testing::Run("-s -c", sum).find("\tLIT\t0\t499500\n")
+         != std::string::npos);
+  EXPECT(!Loops(sum));
+  ExpectSame(sum);
+
+  // stepped once more after the last value the limit lets through, which
+  // still fits
+  const auto edge = Loop("2147483000", "2147483647", 1);
+  EXPECT(!Loops(edge));
+  ExpectSame(edge);
+  const auto inclusive = Loop("2147483000", "2147483646", 1, true);
+  EXPECT(!Loops(inclusive));
+  ExpectSame(inclusive);
+
+  // this one stops at 2147483647, stepped from an even start it would wrap
+  const auto wrapping = Loop("2147483643", "2147483647", 2);
+  EXPECT(Loops(wrapping));
+  ExpectSame(wrapping);
+  // the distance from one side of 0 to the other may not fit
+  const auto across = Loop("0 - 5", "10", 1);
+  EXPECT(Loops(across));
+  ExpectSame(across);
+
+  // bounds only known when the loop is entered are checked then
+  const auto read = Loop("a", "b", 3, true, "  read a; read b;\n");
+  for (const char *input :
+       {"0\n1000\n", "2147483000\n2147483644\n", "-5\n10\n", "10\n-5\n",
+        "-1000\n-10\n", "-2147483648\n-2147483000\n"}) {
+    ExpectSame(read, input);
+  }
+  return pl0::testing::Failures();
+}
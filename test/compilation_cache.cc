@@ -0,0 +1,103 @@
+// The compilation cache hands back what was stored for an unchanged source,
+// compiles again where its entry is damaged and evicts the entries used least
+// recently once it grows beyond its capacity.
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+
+#include <unistd.h>
+
+#include "bytecode/cache.h"
+#include "testing.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char *const kSource = R"(
+var n, f;
+begin
+  read n;
+  f := 1;
+  while n > 1 do
+  begin
+    f := f * n;
+    n := n - 1
+  end;
+  write f
+end.
+)";
+
+const fs::path kDirectory =
+    fs::temp_directory_path() / ("pl0_cache_" + std::to_string(getpid()));
+
+std::string Report(const char *result, int hits, int misses) {
+  return "cache: " + std::string(result) + " (" + std::to_string(hits)
+         + " hits, " + std::to_string(misses) + " misses, 0 evictions)\n";
+}
+
+std::string Run(const std::string &options = "") {
+  return pl0::testing::Run(
+      "--show-cache --cache-dir \"" + kDirectory.string() + "\" " + options,
+      kSource, "10\n");
+}
+
+void ExpectEntries(pl0::CompilationCache &cache,
+                   std::initializer_list<const char *> keys, bool kept) {
+  for (const char *key : keys) {
+    EXPECT(cache.Find(key).has_value() == kept);
+  }
+}
+
+} // namespace
+
+int main() {
+  fs::remove_all(kDirectory);
+  const std::string output = "3628800\n";
+
+  EXPECT(Run() == Report("miss", 0, 1) + output);
+  EXPECT(Run() == Report("hit", 1, 1) + output);
+  // the flags are part of the key
+  EXPECT(Run("--no-superinstructions") == Report("miss", 1, 2) + output);
+  EXPECT(Run("--no-superinstructions") == Report("hit", 2, 2) + output);
+
+  for (const auto &file : fs::directory_iterator(kDirectory)) {
+    if (file.path().extension() == ".pl0b") {
+      std::ofstream(file.path(), std::ios::binary | std::ios::trunc)
+          << "not an image";
+    }
+  }
+  EXPECT(Run() == Report("miss", 2, 3) + output);
+  EXPECT(Run() == Report("hit", 3, 3) + output);
+  fs::remove_all(kDirectory);
+
+  // room for two entries of the same code
+  const auto code = pl0::testing::Compile(kSource);
+  {
+    pl0::CompilationCache sizing{kDirectory.string(), UINT64_MAX};
+    sizing.Store("size", code);
+  }
+  const auto size = fs::file_size(kDirectory / "size.pl0b");
+  fs::remove_all(kDirectory);
+
+  pl0::CompilationCache cache{kDirectory.string(), size * 5 / 2};
+  cache.Store("a", code);
+  cache.Store("b", code);
+  // both used long ago, a before b, then a again
+  const auto long_ago =
+      fs::file_time_type::clock::now() - std::chrono::hours(1);
+  fs::last_write_time(kDirectory / "a.pl0b", long_ago - std::chrono::hours(1));
+  fs::last_write_time(kDirectory / "b.pl0b", long_ago);
+  ExpectEntries(cache, {"a"}, true);
+  cache.Store("c", code);
+  EXPECT(cache.statistics().evictions == 1);
+  ExpectEntries(cache, {"a", "c"}, true);
+  ExpectEntries(cache, {"b"}, false);
+
+  fs::remove_all(kDirectory);
+  return pl0::testing::Failures();
+}
@@ -0,0 +1,81 @@
+// Machines on separate threads share one bytecode, each writes only what its
+// own run of the program writes.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testing.h"
+#include "vm.h"
+
+namespace {
+
+// a recursive procedure deep enough for every machine to grow its stack
+const char *const kSource = R"(
+var n, depth, sum;
+procedure down;
+  var k;
+begin
+  k := depth;
+  depth := depth - 1;
+  if depth > 0 then call down;
+  sum := sum + k
+end;
+begin
+  read n;
+  while n > 0 do
+  begin
+    depth := n;
+    sum := 0;
+    call down;
+    write sum;
+    n := n - 1
+  end
+end.
+)";
+
+constexpr int kMachines = 8;
+
+std::string InputOf(int machine) {
+  return std::to_string(200 + 37 * machine) + '\n';
+}
+
+pl0::Dispatch DispatchOf(int machine) {
+  return machine % 2 == 0 ? pl0::Dispatch::kThreaded : pl0::Dispatch::kSwitch;
+}
+
+} // namespace
+
+int main() {
+  const auto code = pl0::testing::Compile(kSource);
+
+  std::vector<std::string> expected(kMachines);
+  for (int m = 0; m < kMachines; m++) {
+    pl0::MemoryIo io{InputOf(m)};
+    pl0::VirtualMachine{code, io}.Run(DispatchOf(m));
+    expected[m] = io.output();
+  }
+
+  std::vector<std::string> outputs(kMachines);
+  std::vector<std::thread> threads;
+  for (int m = 0; m < kMachines; m++) {
+    threads.emplace_back([&code, &outputs, m] {
+      if (m % 4 < 2) {
+        pl0::MemoryIo io{InputOf(m)};
+        pl0::VirtualMachine{code, io}.Run(DispatchOf(m));
+        outputs[m] = io.output();
+        return;
+      }
+      pl0::CallbackIo io{
+          [m] { return std::stoi(InputOf(m)); },
+          [&outputs, m](int value) {
+            outputs[m] += std::to_string(value) + '\n';
+          }};
+      pl0::VirtualMachine{code, io}.Run(DispatchOf(m));
+    });
+  }
+  for (auto &thread : threads) { thread.join(); }
+
+  for (int m = 0; m < kMachines; m++) { EXPECT(outputs[m] == expected[m]); }
+  return pl0::testing::Failures();
+}
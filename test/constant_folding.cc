@@ -0,0 +1,40 @@
+// The constant folder drops x * 0 only where evaluating x cannot trap.
+
+#include <algorithm>
+
+#include "testing.h"
+#include "vm.h"
+
+namespace {
+
+bool Multiplies(const pl0::bytecode &code) {
+  return std::any_of(code.begin(), code.end(), [](const auto &ins) {
+    return ins.op == pl0::opcode::MUL;
+  });
+}
+
+} // namespace
+
+int main() {
+  const auto trapping = pl0::testing::Compile(R"(
+var z;
+begin
+  z := 0;
+  write 5;
+  write (1 / z) * 0
+end.
+)");
+  pl0::MemoryIo io;
+  pl0::VirtualMachine vm{trapping, io};
+  EXPECT_THROW(vm.Run(), pl0::RuntimeError, "division by zero");
+  EXPECT(io.output() == "5\n");
+
+  EXPECT(!Multiplies(pl0::testing::Compile(R"(
+var z;
+begin
+  read z;
+  write (z / 2 + z) * 0
+end.
+)")));
+  return pl0::testing::Failures();
+}
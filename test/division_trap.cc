@@ -0,0 +1,53 @@
+// A division the machine would trap on is a runtime error in every engine,
+// with everything written before it still there.
+
+#include <string>
+
+#include "testing.h"
+
+namespace {
+
+const char *const kSource = R"(
+var i, x, y;
+begin
+  read x; read y;
+  i := 0;
+  while i < 2000 do
+  begin
+    write i;
+    i := i + 1
+  end;
+  if x / y * y = x then write 1;
+  write x / y
+end.
+)";
+
+std::string Expected(const std::string &what) {
+  std::string output;
+  for (int i = 0; i < 2000; i++) { output += std::to_string(i) + '\n'; }
+  return output + "Runtime error: " + what + '\n';
+}
+
+void ExpectTrap(const std::string &input, const std::string &what) {
+  // the loop moves to native code halfway with --tier-threshold, the
+  // division is interpreted
+  for (const char *options :
+       {"--dispatch switch", "--dispatch threaded", "--no-tiering",
+        "--tier-threshold 1", "--register-vm"}) {
+    EXPECT(pl0::testing::Run(options, kSource, input) == Expected(what));
+  }
+  // without native code on this platform it says so first
+  const auto jit = pl0::testing::Run("--jit", kSource, input);
+  EXPECT(jit.size() >= Expected(what).size()
+         && jit.compare(jit.size() - Expected(what).size(), std::string::npos,
+                        Expected(what))
+                == 0);
+}
+
+} // namespace
+
+int main() {
+  ExpectTrap("7\n0\n", "division by zero");
+  ExpectTrap("-2147483648\n-1\n", "division overflow");
+  return pl0::testing::Failures();
+}
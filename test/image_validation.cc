@@ -0,0 +1,118 @@
+// An image is checked before the machine runs it: code it would run off its
+// display, stack or code with is rejected on loading.
+
+#include <filesystem>
+#include <string>
+
+#include "bytecode/image.h"
+#include "bytecode/superinstruction.h"
+#include "testing.h"
+
+namespace {
+
+const char *const kSource = R"(
+var x;
+procedure p;
+  var y;
+begin
+  y := x;
+  x := y - 1;
+  if x > 0 then call p
+end;
+begin
+  x := 3;
+  call p;
+  write x
+end.
+)";
+
+const std::string kPath =
+    (std::filesystem::temp_directory_path() / "pl0_image_validation.img")
+        .string();
+
+void ExpectValid(const pl0::bytecode &code) {
+  pl0::WriteImage(code, kPath);
+  EXPECT_THROW(pl0::LoadImage(kPath), pl0::GeneralError, "");
+}
+
+void ExpectInvalid(const pl0::bytecode &code, const std::string &reason) {
+  pl0::WriteImage(code, kPath);
+  EXPECT_THROW(
+      pl0::LoadImage(kPath), pl0::GeneralError,
+      '"' + kPath + "\" is not a valid image: " + reason);
+}
+
+// the first instruction that is, or was fused from, op
+int Find(const pl0::bytecode &code, pl0::opcode op) {
+  for (size_t pos = 0; pos < code.size(); pos++) {
+    if (pl0::Unfused(code[pos].op) == op) { return static_cast<int>(pos); }
+  }
+  return -1;
+}
+
+int FindFused(const pl0::bytecode &code) {
+  for (size_t pos = 0; pos < code.size(); pos++) {
+    if (pl0::Unfused(code[pos].op) != code[pos].op) {
+      return static_cast<int>(pos);
+    }
+  }
+  return -1;
+}
+
+} // namespace
+
+int main() {
+  using pl0::opcode;
+  auto code = pl0::testing::Compile(kSource);
+  pl0::FuseSuperinstructions(code);
+  ExpectValid(code);
+
+  const int load = Find(code, opcode::LOD);
+  const int store = Find(code, opcode::STO);
+  const int call = Find(code, opcode::CAL);
+  const int fused = FindFused(code);
+  EXPECT(load >= 0 && store >= 0 && call >= 0 && fused >= 0);
+  if (pl0::testing::Failures() > 0) { return pl0::testing::Failures(); }
+
+  auto crafted = code;
+  crafted[load].level = 100000000;
+  ExpectInvalid(crafted, "variable beyond the main program");
+
+  crafted = code;
+  crafted[load].level = 0;
+  crafted[load].address = 50000000;
+  ExpectInvalid(crafted, "variable outside of its frame");
+
+  crafted = code;
+  crafted[store].address = -1;
+  ExpectInvalid(crafted, "variable outside of its frame");
+
+  crafted = code;
+  crafted[0].address = 1;
+  ExpectInvalid(crafted, "bad frame size");
+
+  crafted = code;
+  crafted[call].level = 100000000;
+  ExpectInvalid(crafted, "call beyond the main program");
+
+  crafted = code;
+  crafted[fused + 1].op = opcode::WRITE;
+  ExpectInvalid(crafted, "superinstruction without its fused sequence");
+
+  ExpectInvalid(
+      {{opcode::INT, 0, 4}, {opcode::LOD2, 0, 0}},
+      "superinstruction without its fused sequence");
+  ExpectInvalid(
+      {{opcode::INT, 0, 5}, {opcode::INC, 0, 0}, {opcode::LIT, 0, 1},
+       {opcode::ADD, 0, 0}, {opcode::STO, 0, 1}, {opcode::RET, 0, 0}},
+      "superinstruction without its fused sequence");
+  ExpectInvalid(
+      {{opcode::INT, 0, 3}, {opcode::ADD, 0, 0}, {opcode::RET, 0, 0}},
+      "operand stack underflow");
+  ExpectInvalid(
+      {{opcode::INT, 0, 3}, {opcode::INT, 0, 1000}, {opcode::RET, 0, 0}},
+      "INT inside of a procedure");
+
+  std::filesystem::remove(kPath);
+  return pl0::testing::Failures();
+}
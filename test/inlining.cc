@@ -0,0 +1,121 @@
+// A procedure expanded in place of its call reaches the variables of the
+// scopes around it just like the call would have, whichever level the caller
+// is at.
+
+#include <string>
+
+#include "testing.h"
+
+namespace {
+
+// bump is expanded into outer and into mid and inner, one and two levels
+// deeper than the scope it is declared in, top into inner and the main
+// program; the locals of both start at 0 on every expansion
+const char *const kNested = R"(
+var g, n;
+procedure top;
+  var t;
+begin
+  t := t + g;
+  g := t + 1
+end;
+procedure outer;
+  var a, i;
+  procedure bump;
+    var t;
+  begin
+    t := t + 1;
+    a := a + t;
+    g := g + a
+  end;
+  procedure mid;
+    var b;
+    procedure inner;
+    begin
+      b := b + a;
+      call bump;
+      call top
+    end;
+  begin
+    b := 1;
+    call bump;
+    call inner;
+    call inner;
+    write b
+  end;
+begin
+  a := n;
+  i := 0;
+  while i < 3 do
+  begin
+    call bump;
+    call mid;
+    i := i + 1
+  end;
+  write a
+end;
+begin
+  read n;
+  g := 0;
+  call outer;
+  call top;
+  write g
+end.
+)";
+
+// note is expanded into every frame of rec, add into note
+const char *const kRecursive = R"(
+var depth, total;
+procedure add;
+begin
+  total := total + depth
+end;
+procedure rec;
+  var saved;
+  procedure note;
+  begin
+    saved := depth;
+    call add
+  end;
+begin
+  call note;
+  depth := depth - 1;
+  if depth > 0 then call rec;
+  total := total * 2 + saved;
+  write total
+end;
+begin
+  read depth;
+  total := 0;
+  call rec
+end.
+)";
+
+int Calls(const std::string &listing) {
+  int calls = 0;
+  for (size_t pos = 0; (pos = listing.find("\tCAL\t", pos)) != std::string::npos;
+       pos++) {
+    calls++;
+  }
+  return calls;
+}
+
+void ExpectSame(const char *source, const std::string &input,
+                const std::string &options) {
+  const auto called =
+      pl0::testing::Run(options + " --no-inline", source, input);
+  EXPECT(!called.empty());
+  EXPECT(pl0::testing::Run(options, source, input) == called);
+  EXPECT(Calls(pl0::testing::Run(options + " -s -c", source))
+         < Calls(pl0::testing::Run(options + " --no-inline -s -c", source)));
+}
+
+} // namespace
+
+int main() {
+  for (const char *options : {"", "--no-ir"}) {
+    ExpectSame(kNested, "5\n", options);
+    ExpectSame(kRecursive, "6\n", options);
+  }
+  return pl0::testing::Failures();
+}
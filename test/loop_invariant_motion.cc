@@ -0,0 +1,78 @@
+// A load stays in its loop when a procedure the loop calls, or one that calls
+// in turn, may store to the variable; it is hoisted where none does.
+
+#include <string>
+
+#include "testing.h"
+
+namespace {
+
+// leaf stores to the variable named, two calls away from the loop
+std::string Source(const std::string &stored) {
+  return R"(
+var g, h, n, s;
+procedure outer;
+  var i, m;
+  procedure mid;
+    procedure leaf;
+    begin
+      )" + stored + " := " + stored + R"( + 1
+    end;
+  begin
+    if i / 3 * 3 = i then call leaf
+  end;
+begin
+  m := n;
+  i := 0;
+  while i < m do
+  begin
+    s := s + g;
+    call mid;
+    i := i + 1
+  end
+end;
+begin
+  read n;
+  g := 5;
+  h := 0;
+  s := 0;
+  call outer;
+  write g; write h; write s
+end.
+)";
+}
+
+// the SSA form of function outer
+std::string Outer(const std::string &options, const std::string &source) {
+  const auto ir = pl0::testing::Run("--show-ir -c " + options, source);
+  const auto begin = ir.find("function outer");
+  const auto end = ir.find("function", begin + 1);
+  return begin == std::string::npos ? "" : ir.substr(begin, end - begin);
+}
+
+void ExpectSame(const std::string &source) {
+  for (const char *input : {"0\n", "1\n", "10\n"}) {
+    const auto expected = pl0::testing::Run("--no-ir", source, input);
+    for (const char *options : {"", "--no-licm", "--no-inline"}) {
+      EXPECT(pl0::testing::Run(options, source, input) == expected);
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  const auto clobbered = Source("g");
+  ExpectSame(clobbered);
+  EXPECT(pl0::testing::Run("", clobbered, "10\n") == "9\n0\n68\n");
+  const auto ir = Outer("--no-inline", clobbered);
+  EXPECT(ir.find("Load g") != std::string::npos);
+  EXPECT(ir == Outer("--no-inline --no-licm", clobbered));
+
+  const auto unclobbered = Source("h");
+  ExpectSame(unclobbered);
+  EXPECT(pl0::testing::Run("", unclobbered, "10\n") == "5\n4\n50\n");
+  EXPECT(Outer("--no-inline", unclobbered)
+         != Outer("--no-inline --no-licm", unclobbered));
+  return pl0::testing::Failures();
+}
@@ -0,0 +1,108 @@
+// A snapshot is checked before the machine resumes it: its code like an
+// image's, its frames against its stack.
+
+#include <filesystem>
+#include <string>
+
+#include "snapshot.h"
+#include "testing.h"
+
+namespace {
+
+// stops on the READ five calls deep into rec
+const char *const kSource = R"(
+var n, r;
+procedure outer;
+  var a;
+  procedure rec;
+    var b;
+  begin
+    b := n;
+    n := n - 1;
+    if n > 0 then call rec;
+    if n = 0 then
+    begin
+      read a;
+      n := 0 - 1
+    end;
+    r := r + b + a
+  end;
+begin
+  a := 0;
+  call rec
+end;
+begin
+  n := 5;
+  r := 0;
+  call outer;
+  write r
+end.
+)";
+
+void ExpectRejected(const pl0::bytecode &code, const pl0::Snapshot &snapshot) {
+  pl0::MemoryIo io{"7\n"};
+  pl0::VirtualMachine vm{code, io};
+  EXPECT_THROW(
+      vm.Restore(snapshot), pl0::RuntimeError,
+      "snapshot frames do not match its stack");
+}
+
+} // namespace
+
+int main() {
+  using pl0::Stack;
+  const auto code = pl0::testing::Compile(kSource);
+  pl0::MemoryIo io{"7\n"};
+  pl0::VirtualMachine vm{code, io};
+  EXPECT(vm.RunToFirstRead());
+  const auto snapshot = vm.Save();
+
+  pl0::MemoryIo expected_io{"7\n"};
+  pl0::VirtualMachine{code, expected_io}.Run();
+  pl0::MemoryIo resumed_io{"7\n"};
+  pl0::VirtualMachine resumed{code, resumed_io};
+  resumed.Restore(snapshot);
+  resumed.Continue();
+  EXPECT(resumed_io.output() == expected_io.output());
+
+  auto crafted = snapshot;
+  crafted.display.back() = crafted.sp + 100;
+  ExpectRejected(code, crafted);
+
+  crafted = snapshot;
+  crafted.stack[crafted.bp + Stack::kDynamicLink] = crafted.bp;
+  ExpectRejected(code, crafted);
+
+  crafted = snapshot;
+  crafted.stack[crafted.bp + Stack::kSavedDisplay] = -Stack::kHeaderSize;
+  ExpectRejected(code, crafted);
+
+  crafted = snapshot;
+  crafted.stack[crafted.bp + Stack::kCallerLevel] = 1000;
+  ExpectRejected(code, crafted);
+
+  crafted = snapshot;
+  crafted.display_level = 0;
+  ExpectRejected(code, crafted);
+
+  crafted = snapshot;
+  crafted.bp = crafted.sp;
+  ExpectRejected(code, crafted);
+
+  // the code is verified on loading, before any machine sees it
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "pl0_snapshot_validation.snap")
+          .string();
+  crafted = snapshot;
+  crafted.code = {
+      {pl0::opcode::INT, 0, 4}, {pl0::opcode::LOD, 0, 50000000},
+      {pl0::opcode::WRITE, 0, 0}, {pl0::opcode::RET, 0, 0}};
+  crafted.program_counter = 0;
+  pl0::WriteSnapshot(crafted, path);
+  EXPECT_THROW(
+      pl0::LoadSnapshot(path), pl0::GeneralError,
+      '"' + path + "\" is not a valid snapshot: variable outside of its frame");
+  std::filesystem::remove(path);
+
+  return pl0::testing::Failures();
+}
@@ -0,0 +1,136 @@
+// Code built into SSA form and lowered back writes what the direct AST
+// compiler's does, keeps divisions that may trap where they were and turns a
+// call followed only by a return into a TCL.
+
+#include <string>
+
+#include "testing.h"
+
+namespace {
+
+const char *const kExamples[] = {
+    "compute", "demo", "fib", "if-else", "prime", "repl", "return", "square"};
+
+const char *const kInput = "30\n-7\n4\n0\n";
+
+// locals in SSA values joined by phis, the variables of the main program in
+// its frame, a loop left early and a while nested in an if
+const char *const kFrames = R"(
+var n, seen, total;
+procedure outer;
+  var i, j, k;
+  procedure look;
+  begin
+    seen := seen + k
+  end;
+begin
+  i := 0;
+  while i < n do
+  begin
+    j := i;
+    if i / 2 * 2 = i then j := j - 1 else j := j * 3;
+    k := j;
+    call look;
+    if j > 40 then i := n;
+    i := i + 1
+  end;
+  if seen > 0 then
+    while k > 0 do
+    begin
+      total := total + k;
+      k := k - 7
+    end;
+  write i; write j; write k; write seen; write total
+end;
+begin
+  read n;
+  seen := 0;
+  total := 0;
+  call outer
+end.
+)";
+
+// count ends in a call followed by nothing but a return
+const char *const kTailCall = R"(
+var n, sum;
+procedure count;
+  procedure step;
+  begin
+    sum := sum + n;
+    n := n - 1;
+    if n > 0 then call count
+  end;
+begin
+  call step
+end;
+procedure again;
+begin
+  if n > 0 then call count
+end;
+begin
+  read n;
+  sum := 0;
+  call again;
+  write sum
+end.
+)";
+
+// the quotient is never used, the division by z still traps between the two
+// writes
+const char *const kDeadDivision = R"(
+var x, y, z, q;
+begin
+  read x;
+  read z;
+  write x;
+  q := x / z;
+  read y;
+  write y
+end.
+)";
+
+std::string Example(const std::string &name) {
+  return std::string(PL0_SOURCE_DIR) + "/example/" + name + ".p";
+}
+
+bool Has(const std::string &listing, const std::string &op) {
+  return listing.find('\t' + op + '\t') != std::string::npos;
+}
+
+void ExpectSame(const char *source, const std::string &input) {
+  const auto direct = pl0::testing::Run("--no-ir", source, input);
+  EXPECT(!direct.empty());
+  EXPECT(pl0::testing::Run("", source, input) == direct);
+  EXPECT(pl0::testing::Run("--no-superinstructions", source, input) == direct);
+}
+
+} // namespace
+
+int main() {
+  for (const char *name : kExamples) {
+    const auto path = Example(name);
+    const auto direct = pl0::testing::RunFile("--no-ir", path, kInput);
+    EXPECT(pl0::testing::RunFile("", path, kInput) == direct);
+  }
+
+  for (const char *input : {"0\n", "5\n", "30\n"}) {
+    ExpectSame(kFrames, input);
+  }
+  const auto ir = pl0::testing::Run("--show-ir -c", kFrames);
+  EXPECT(ir.find("Store seen") != std::string::npos);
+  EXPECT(ir.find("Phi") != std::string::npos);
+
+  ExpectSame(kTailCall, "1000\n");
+  EXPECT(pl0::testing::Run("", kTailCall, "1000\n") == "500500\n");
+  EXPECT(Has(pl0::testing::Run("-s -c --no-superinstructions", kTailCall),
+             "TCL"));
+
+  ExpectSame(kDeadDivision, "7\n0\n3\n");
+  ExpectSame(kDeadDivision, "-2147483648\n-1\n3\n");
+  EXPECT(pl0::testing::Run("", kDeadDivision, "7\n0\n3\n")
+         == "7\nRuntime error: division by zero\n");
+  EXPECT(pl0::testing::Run("", kDeadDivision, "7\n2\n3\n") == "7\n3\n");
+  EXPECT(Has(pl0::testing::Run("-s -c --no-superinstructions", kDeadDivision),
+             "DIV"));
+  return pl0::testing::Failures();
+}
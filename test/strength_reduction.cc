@@ -0,0 +1,70 @@
+// Quotients by constants and divisibility tests come out the same whether
+// the division is interpreted, reduced to a DVD or compiled to shifts and
+// magic multiplications, down to the trap of INT_MIN / -1.
+
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "testing.h"
+
+namespace {
+
+// INT_MIN last, its division by -1, the last divisor, ends the program
+const std::vector<int> kDividends = {
+    0, 1, 7, -7, 100, -100, 65535, 65536, -65536, -65537,
+    INT_MAX, -INT_MAX, INT_MAX - 1, INT_MIN + 1, INT_MIN};
+
+const std::vector<int> kDivisors = {
+    1, 2, 4, 16, 65536, 1 << 30, 3, 5, 7, 10, 641, 65537,
+    -2, -4, -16, -3, -7, -10, INT_MAX, -INT_MAX, -1};
+
+std::string Literal(int value) {
+  return value < 0 ? "(0 - " + std::to_string(-int64_t{value}) + ')'
+                   : std::to_string(value);
+}
+
+// reads how many dividends follow, then writes x / d and whether d divides x
+// for every divisor d and every dividend x
+std::string Source() {
+  std::string source = "var n, x;\nbegin\n  read n;\n"
+                       "  while n > 0 do\n  begin\n    read x;\n";
+  for (int d : kDivisors) {
+    source += "    write x / " + Literal(d) + ";\n    if x / " + Literal(d)
+              + " * " + Literal(d) + " = x then write 1 else write 0;\n";
+  }
+  return source + "    n := n - 1\n  end\nend.\n";
+}
+
+std::string Input() {
+  std::string input = std::to_string(kDividends.size()) + '\n';
+  for (int x : kDividends) { input += std::to_string(x) + '\n'; }
+  return input;
+}
+
+std::string Expected() {
+  std::string output;
+  for (int x : kDividends) {
+    for (int d : kDivisors) {
+      if (x == INT_MIN && d == -1) {
+        return output + "Runtime error: division overflow\n";
+      }
+      output += std::to_string(x / d) + '\n' + (x % d == 0 ? "1\n" : "0\n");
+    }
+  }
+  return output;
+}
+
+} // namespace
+
+int main() {
+  const auto source = Source();
+  const auto input = Input();
+  for (const char *options :
+       {"", "--no-strength-reduction", "--no-ir", "--dispatch switch",
+        "--tier-threshold 1", "--jit", "--jit --tier-threshold 1"}) {
+    EXPECT(pl0::testing::Run(options, source, input) == Expected());
+  }
+  return pl0::testing::Failures();
+}
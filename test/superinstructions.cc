@@ -0,0 +1,71 @@
+// Fusing superinstructions changes how many dispatches a program takes, never
+// what it writes.
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "testing.h"
+
+namespace {
+
+const char *const kExamples[] = {
+    "compute", "demo", "fib", "if-else", "prime", "repl", "return", "square"};
+
+// enough for every example that reads
+const char *const kInput = "30\n-7\n4\n0\n";
+
+std::string Example(const std::string &name) {
+  return std::string(PL0_SOURCE_DIR) + "/example/" + name + ".p";
+}
+
+// slots a superinstruction takes, everything else takes one
+const std::map<std::string, int> kSlots = {
+    {"INC", 4},  {"DEC", 4},  {"LOD2", 2}, {"LODLIT", 2}, {"MOV", 2},
+    {"LADD", 2}, {"LSUB", 2}, {"LMUL", 2}, {"LDIV", 2},   {"JLT", 2},
+    {"JLE", 2},  {"JGT", 2},  {"JGE", 2},  {"JEQ", 2},    {"JNE", 2}};
+
+// instructions and dispatches of the bytecode listed by -s
+std::pair<int, int> Count(const std::string &listing) {
+  std::istringstream lines(listing);
+  int instructions = 0;
+  int dispatches = 0;
+  int skip = 0;
+  for (std::string line; std::getline(lines, line);) {
+    std::istringstream fields(line);
+    int pos;
+    std::string op;
+    if (!(fields >> pos >> op)) { continue; }
+    instructions++;
+    if (skip > 0) {
+      skip--;
+      continue;
+    }
+    dispatches++;
+    auto slots = kSlots.find(op);
+    if (slots != kSlots.end()) { skip = slots->second - 1; }
+  }
+  return {instructions, dispatches};
+}
+
+} // namespace
+
+int main() {
+  for (const char *name : kExamples) {
+    const auto path = Example(name);
+    const auto unfused =
+        pl0::testing::RunFile("--no-superinstructions", path, kInput);
+    EXPECT(!unfused.empty());
+    EXPECT(pl0::testing::RunFile("", path, kInput) == unfused);
+    EXPECT(pl0::testing::RunFile("--dispatch switch", path, kInput) == unfused);
+  }
+
+  // a fifth of the dispatches at least, most of them in the loops
+  for (const char *name : {"prime", "fib"}) {
+    const auto [instructions, dispatches] =
+        Count(pl0::testing::RunFile("-s -c", Example(name)));
+    EXPECT(dispatches > 0 && dispatches * 5 <= instructions * 4);
+  }
+  return pl0::testing::Failures();
+}
@@ -0,0 +1,107 @@
+#ifndef TEST_TESTING_H
+#define TEST_TESTING_H
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "ast/constant_folder.h"
+#include "bytecode/compiler.h"
+#include "parsing/parser.h"
+
+namespace pl0::testing {
+
+// a test passes when its main returns Failures()
+inline int &Failures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define EXPECT(condition)                                                 \
+  do {                                                                    \
+    if (!(condition)) {                                                   \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": expected " #condition \
+                << '\n';                                                  \
+      pl0::testing::Failures()++;                                         \
+    }                                                                     \
+  } while (false)
+
+// the statement throws an Error with the expected message
+#define EXPECT_THROW(statement, Error, expected)                             \
+  do {                                                                      \
+    std::string message_;                                                   \
+    try {                                                                   \
+      statement;                                                            \
+    } catch (Error & error_) {                                              \
+      message_ = error_.what();                                             \
+    }                                                                       \
+    if (message_ != (expected)) {                                           \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": expected " #statement \
+                << " to throw \"" << (expected) << "\", got \"" << message_ \
+                << "\"\n";                                                  \
+      pl0::testing::Failures()++;                                           \
+    }                                                                       \
+  } while (false)
+
+// what PL0, built along with the tests, writes to its standard output and
+// error running the program in path with the given options and input
+inline std::string RunFile(const std::string &options, const std::string &path,
+                           const std::string &input = "") {
+  static int runs = 0;
+  const auto input_path =
+      std::filesystem::temp_directory_path()
+      / ("pl0_test_" + std::to_string(getpid()) + '_' + std::to_string(runs++)
+         + ".in");
+  std::ofstream(input_path) << input;
+  const std::string command = std::string(PL0_BINARY) + ' ' + options + " \""
+                              + path + "\" < \"" + input_path.string()
+                              + "\" 2>&1";
+  std::string output;
+  if (auto *pipe = popen(command.c_str(), "r")) {
+    char buffer[4096];
+    for (size_t n; (n = fread(buffer, 1, sizeof buffer, pipe)) > 0;) {
+      output.append(buffer, n);
+    }
+    pclose(pipe);
+  }
+  std::filesystem::remove(input_path);
+  return output;
+}
+
+inline std::string Run(const std::string &options, const std::string &source,
+                       const std::string &input = "") {
+  static int programs = 0;
+  const auto path =
+      std::filesystem::temp_directory_path()
+      / ("pl0_test_" + std::to_string(getpid()) + '_'
+         + std::to_string(programs++) + ".p");
+  std::ofstream(path) << source;
+  auto output = RunFile(options, path.string(), input);
+  std::filesystem::remove(path);
+  return output;
+}
+
+inline ast::Block *Parse(const std::string &source) {
+  std::istringstream input(source);
+  Lexer lexer(input);
+  Parser parser(lexer);
+  return parser.Program();
+}
+
+// through the constant folder and the AST compiler, as PL0 --no-ir does
+inline bytecode Compile(const std::string &source) {
+  auto *program = Parse(source);
+  ast::ConstantFolder{}.Fold(program);
+  code::Compiler compiler;
+  compiler.Generate(program);
+  return compiler.code();
+}
+
+} // namespace pl0::testing
+
+#endif // TEST_TESTING_H
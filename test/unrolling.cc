@@ -0,0 +1,78 @@
+// An unrolled loop runs exactly the iterations the loop would have, however
+// many are left over after the unrolled copies and whichever way it counts;
+// the budget shrinks the factor down to leaving the loop alone.
+
+#include <sstream>
+#include <string>
+
+#include "testing.h"
+
+namespace {
+
+// i from start while i compare limit, stepping by step, summing i times a
+// number read
+std::string Loop(int start, const std::string &compare, int limit, int step) {
+  auto number = [](int value) {
+    return value < 0 ? "(0 - " + std::to_string(-value) + ')'
+                     : std::to_string(value);
+  };
+  return "var i, n, s;\nbegin\n  read n;\n  i := " + number(start)
+         + "; s := 0;\n  while i " + compare + ' ' + number(limit)
+         + " do\n  begin\n    write i;\n    s := s + i * n;\n    i := i + "
+         + number(step) + "\n  end;\n  write s; write i\nend.\n";
+}
+
+int Instructions(const std::string &options, const std::string &source) {
+  std::istringstream listing(
+      pl0::testing::Run("-s -c --no-superinstructions " + options, source));
+  int count = 0;
+  for (std::string line; std::getline(listing, line);) {
+    if (!line.empty() && line[0] >= '0' && line[0] <= '9') { count++; }
+  }
+  return count;
+}
+
+void ExpectSame(const std::string &source) {
+  for (const char *input : {"1\n", "-3\n"}) {
+    const auto expected = pl0::testing::Run("--unroll 1", source, input);
+    EXPECT(!expected.empty());
+    for (const char *options :
+         {"", "--unroll 2", "--unroll 3", "--unroll 5", "--unroll 8",
+          "--unroll 16 --unroll-budget 1000", "--jit"}) {
+      EXPECT(pl0::testing::Run(options, source, input) == expected);
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  // trip counts of 0 to 18 leave every remainder over for the factors tried
+  for (int trips = 0; trips <= 18; trips++) {
+    ExpectSame(Loop(0, "<", trips, 1));
+  }
+  ExpectSame(Loop(5, "<", 5, 1));
+  ExpectSame(Loop(7, "<=", 30, 3));
+  ExpectSame(Loop(7, "<=", 31, 3));
+  ExpectSame(Loop(-10, "#", 11, 1));
+  // counting down
+  ExpectSame(Loop(10, ">", 0, -1));
+  ExpectSame(Loop(10, ">=", -7, -2));
+  ExpectSame(Loop(10, ">", 10, -1));
+  ExpectSame(Loop(0, ">", -17, -3));
+  // near the ends of the range, where moving the bound would wrap
+  ExpectSame(Loop(2147483600, "<", 2147483647, 1));
+  ExpectSame(Loop(-2147483600, ">", -2147483647, -1));
+
+  const auto loop = Loop(0, "<", 100, 1);
+  const int kept = Instructions("--unroll 1", loop);
+  EXPECT(Instructions("", loop) > kept);
+  EXPECT(Instructions("--unroll 8 --unroll-budget 1000", loop)
+         > Instructions("", loop));
+  // too small for even two copies
+  EXPECT(Instructions("--unroll-budget 1", loop) == kept);
+  // two copies fit where four do not
+  EXPECT(Instructions("--unroll-budget 12", loop) > kept);
+  EXPECT(Instructions("--unroll-budget 12", loop) < Instructions("", loop));
+  return pl0::testing::Failures();
+}
@@ -0,0 +1,82 @@
+// A load is not replaced by an earlier one of the same variable when a
+// procedure called in between, directly or on one path into a join, may store
+// to it; it is where none does.
+
+#include <string>
+
+#include "testing.h"
+
+namespace {
+
+// leaf stores to the variable named, two calls away from outer
+std::string Source(const std::string &stored) {
+  return R"(
+var g, h, n;
+procedure outer;
+  var a, b, c;
+  procedure mid;
+    procedure leaf;
+    begin
+      )" + stored + " := " + stored + R"( + n
+    end;
+  begin
+    call leaf
+  end;
+begin
+  a := g;
+  if n > 2 then call mid;
+  b := g;
+  call mid;
+  c := g;
+  write a; write b; write c
+end;
+begin
+  read n;
+  g := 5;
+  h := 0;
+  call outer;
+  write h
+end.
+)";
+}
+
+// in the SSA form of function outer
+int Loads(const std::string &options, const std::string &source) {
+  const auto ir = pl0::testing::Run("--show-ir -c " + options, source);
+  const auto begin = ir.find("function outer");
+  const auto end = ir.find("function", begin + 1);
+  if (begin == std::string::npos) { return -1; }
+  int loads = 0;
+  for (auto pos = ir.find("Load g", begin); pos < end;
+       pos = ir.find("Load g", pos + 1)) {
+    loads++;
+  }
+  return loads;
+}
+
+void ExpectSame(const std::string &source) {
+  for (const char *input : {"1\n", "3\n"}) {
+    const auto expected = pl0::testing::Run("--no-ir", source, input);
+    for (const char *options : {"", "--no-gvn", "--no-inline"}) {
+      EXPECT(pl0::testing::Run(options, source, input) == expected);
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  const auto clobbered = Source("g");
+  ExpectSame(clobbered);
+  EXPECT(pl0::testing::Run("", clobbered, "1\n") == "5\n5\n6\n0\n");
+  EXPECT(pl0::testing::Run("", clobbered, "3\n") == "5\n8\n11\n0\n");
+  EXPECT(Loads("--no-inline", clobbered) == 3);
+  EXPECT(Loads("--no-inline --no-gvn", clobbered) == 3);
+
+  const auto unclobbered = Source("h");
+  ExpectSame(unclobbered);
+  EXPECT(pl0::testing::Run("", unclobbered, "3\n") == "5\n5\n5\n6\n");
+  EXPECT(Loads("--no-inline", unclobbered) == 1);
+  EXPECT(Loads("--no-inline --no-gvn", unclobbered) == 3);
+  return pl0::testing::Failures();
+}